@@ -1,4 +1,5 @@
 from ._diskhash import Diskhash as _Diskhash
+from . import _diskhash
 from .diskhash_version import __version__
 from struct import Struct
 
@@ -50,6 +51,27 @@ class StructHash(object):
         '''
         return self.dh.reserve(n)
 
+    def advise(self, regions, advice):
+        '''Tell the OS how parts of the table will be accessed
+
+        Parameters
+        ----------
+        regions: 'index', 'store', 'dirty', 'arena' or 'all' (or a list of
+            these)
+        advice: 'normal', 'random', 'sequential', 'willneed', 'cold' or
+            'pageout'
+
+        For example, `advise('index', 'willneed')` reads the hash index into
+        memory ahead of lookups, while `advise('store', 'random')` keeps the
+        values from being read ahead.
+        '''
+        if isinstance(regions, str):
+            regions = [regions]
+        flags = 0
+        for r in regions:
+            flags |= getattr(_diskhash, 'REGION_' + r.upper())
+        return self.dh.advise(flags, getattr(_diskhash, 'ADVICE_' + advice.upper()))
+
     def size(self):
         'Return the size()'
         return self.dh.size()
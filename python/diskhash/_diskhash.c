@@ -70,6 +70,25 @@ PyObject* htInsert(htObject* self, PyObject* args) {
     return PyLong_FromLong(r);
 }
 
+PyObject* htAdvise(htObject* self, PyObject* args) {
+    int regions;
+    int advice;
+    if (!PyArg_ParseTuple(args, "ii", &regions, &advice)) {
+        return NULL;
+    }
+    char* err = NULL;
+    int r = dht_advise(self->ht, regions, advice, &err);
+    if (r < 0) {
+        if (!err) {
+            return PyErr_NoMemory();
+        }
+        PyErr_SetString(PyExc_RuntimeError, err);
+        free(err);
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
 PyObject* htLen(htObject* self, PyObject* args) {
     long n = dht_size(self->ht);
     return PyLong_FromLong(n);
@@ -114,6 +133,17 @@ static PyMethodDef htMethods[] = {
 		    "r : int\n"
 		    "   1 if object was inserted, 0 if not.\n" },
 
+    { "advise", (PyCFunction)htAdvise, METH_VARARGS,
+		    "Tell the OS how parts of the table will be accessed.\n"
+		    "\n"
+		    "Parameters\n"
+		    "----------\n"
+		    "\n"
+		    "regions : int\n"
+		    "    Combination of the REGION_* constants\n"
+		    "advice : int\n"
+		    "    One of the ADVICE_* constants\n" },
+
     { "size", (PyCFunction)htLen, METH_VARARGS,
 		    "Return number of elements." },
 
@@ -158,7 +188,7 @@ htInit(htObject *self, PyObject *args, PyObject *kwds) {
         mode_flags = O_RDWR|O_CREAT|O_EXCL;
     }
 
-    HashTableOpts opts;
+    HashTableOpts opts = dht_zero_opts();
     opts.key_maxlen = maxi;
     opts.object_datalen = object_size;
 
@@ -263,6 +293,18 @@ PyInit__diskhash(void)
 
     Py_INCREF(&htWrapperType);
     PyModule_AddObject(m, "Diskhash", (PyObject *)&htWrapperType);
+
+    PyModule_AddIntConstant(m, "REGION_INDEX", DHT_REGION_INDEX);
+    PyModule_AddIntConstant(m, "REGION_STORE", DHT_REGION_STORE);
+    PyModule_AddIntConstant(m, "REGION_DIRTY", DHT_REGION_DIRTY);
+    PyModule_AddIntConstant(m, "REGION_ARENA", DHT_REGION_ARENA);
+    PyModule_AddIntConstant(m, "REGION_ALL", DHT_REGION_ALL);
+    PyModule_AddIntConstant(m, "ADVICE_NORMAL", DHT_ADVICE_NORMAL);
+    PyModule_AddIntConstant(m, "ADVICE_RANDOM", DHT_ADVICE_RANDOM);
+    PyModule_AddIntConstant(m, "ADVICE_SEQUENTIAL", DHT_ADVICE_SEQUENTIAL);
+    PyModule_AddIntConstant(m, "ADVICE_WILLNEED", DHT_ADVICE_WILLNEED);
+    PyModule_AddIntConstant(m, "ADVICE_COLD", DHT_ADVICE_COLD);
+    PyModule_AddIntConstant(m, "ADVICE_PAGEOUT", DHT_ADVICE_PAGEOUT);
     return m;
 }
 
@@ -22,3 +22,17 @@ def test_insert_check():
     del ht
 
     unlink(filename)
+
+def test_advise():
+    if path.exists(filename):
+        unlink(filename)
+    ht = Str2int(filename, 17, 'rw')
+    for i in range(1000):
+        ht.insert('key{}'.format(i), i)
+    ht.advise('index', 'willneed')
+    ht.advise(['index', 'store'], 'random')
+    ht.advise('all', 'normal')
+    assert ht.lookup('key17') == 17
+    del ht
+
+    unlink(filename)
@@ -81,6 +81,6 @@ setuptools.setup(name = 'diskhash',
       url = 'https://github.com/luispedro/diskhash',
       packages = packages,
       package_dir = {'':'python'},
-      ext_modules = [setuptools.Extension('diskhash._diskhash', sources=['python/diskhash/_diskhash.c', 'src/diskhash.c'], depends=['src/diskhash.h'])],
+      ext_modules = [setuptools.Extension('diskhash._diskhash', sources=['python/diskhash/_diskhash.c', 'src/diskhash.c', 'src/os_wrappers.c'], depends=['src/diskhash.h', 'src/os_wrappers.h'])],
       )
 
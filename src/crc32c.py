@@ -0,0 +1,12 @@
+# Lookup table for the software fallback of CRC32C (Castagnoli polynomial,
+# reflected), which must give the same values as the SSE4.2 crc32 instruction
+POLY = 0x82F63B78
+print("#include <inttypes.h>")
+print("uint32_t crc32c_table [] = {")
+for i in range(256):
+    val = i
+    for _ in range(8):
+        val = (val >> 1) ^ (POLY if val & 1 else 0)
+    print("{}U,".format(val))
+print("0 /* sentinel */")
+print("};")
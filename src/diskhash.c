@@ -5,44 +5,183 @@
 #include <assert.h>
 #include <errno.h>
 #include <stdbool.h>
+#ifndef _WIN32
+#include <pthread.h>
+#include <unistd.h>
+#endif
 
 #include "diskhash.h"
 #include "os_wrappers.h"
 #include "primes.h"
 #include "rtable.h"
+#include "crc32c.h"
+
+#if defined(__AVX2__) || ((defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__))
+#include <immintrin.h>
+#elif defined(__SSE4_2__)
+#include <nmmintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+#if defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+/* With GCC and clang on x86-64, the batched hashing kernels are compiled for
+ * AVX2 and AVX-512 whatever the target, and picked at runtime (see
+ * hash_batch) */
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+#define DHT_HASH_DISPATCH 1
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define DHT_PREFETCH(p) __builtin_prefetch((p))
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define DHT_PREFETCH(p) _mm_prefetch((const char*)(p), _MM_HINT_T0)
+#else
+#define DHT_PREFETCH(p) ((void)(p))
+#endif
+
+/* Systems where dht_set_rebuild_threads can use more than one thread */
+#ifndef _WIN32
+#define DHT_REBUILD_THREADS 1
+#endif
 
 static const size_t INITIAL_HT_SIZE = 7;
-static const size_t INITIAL_CAPACITY = 3;
+
+/* Limits of HashTableOpts.max_load_percent and growth_percent: probe
+ * sequences get very long above MAX_LOAD_PERCENT */
+#define MIN_LOAD_PERCENT 10
+#define MAX_LOAD_PERCENT 95
+#define MAX_GROWTH_PERCENT 1000
 
 enum {
     HT_FLAG_CAN_WRITE = 1,
     HT_FLAG_HASH_2 = 2,
     HT_FLAG_IS_LOADED = 4,
+    HT_FLAG_EXT_HEADER = 8,
+    HT_FLAG_HUGE_ALLOC = 16, /* loaded with dht_huge_alloc */
 };
 
+/* All the DHT_OPT_* flags that this code knows how to handle */
+static const unsigned int FORMAT_FLAGS_MASK = DHT_OPT_CONTROL_BYTES
+                                            | DHT_OPT_ROBIN_HOOD
+                                            | DHT_OPT_FINGERPRINTS
+                                            | DHT_OPT_FASTRANGE
+                                            | DHT_OPT_WYHASH
+                                            | DHT_OPT_CRC32C_HASH
+                                            | DHT_OPT_KEY_LENGTHS
+                                            | DHT_OPT_KEY_ARENA
+                                            | DHT_OPT_FIXED_KEYS
+                                            | DHT_OPT_CUCKOO
+                                            | DHT_OPT_COLUMNAR
+                                            | DHT_OPT_HUGE_PAGES
+                                            | DHT_OPT_STORED_HASHES
+                                            | DHT_OPT_INLINE
+                                            | DHT_OPT_COMPACT;
+
+/* Versions 1.0 and 1.1 have no header extension */
+static const size_t LEGACY_HEADER_SIZE = 64;
+
+/* Regions of version 1.2 tables start on cache line boundaries */
+static const size_t REGION_ALIGNMENT = 64;
+
+/* Number of control bytes inspected at once. The tag array is followed by a
+ * copy of its first TAG_GROUP_WIDTH bytes so that a group can be loaded at any
+ * slot without having to wrap around. */
+#define TAG_GROUP_WIDTH 32
+
+/* With DHT_OPT_KEY_ARENA, store entries have room for keys of up to this
+ * many bytes. Longer keys are kept in the arena, and the entry holds their
+ * first ARENA_PREFIX bytes followed by their offset in the arena. */
+#define ARENA_INLINE_KEY 16
+#define ARENA_PREFIX 8
+
+/* With DHT_OPT_CUCKOO, the hash table is split into buckets of this many
+ * slots (a cache line for 32-bit tables with fingerprints) */
+#define CUCKOO_BUCKET_SLOTS 8
+
+/* How many buckets an insertion into a full pair of buckets may visit while
+ * looking for a chain of entries to move before the table is grown instead */
+#define CUCKOO_MAX_SEARCH 256
+
+/* How many keys ahead dht_lookup_batch prefetches: enough to cover the
+ * latency of a cache miss, few enough that the prefetched lines are not
+ * evicted before they are used. Keys are hashed LOOKUP_HASH_BATCH at a time
+ * (see hash_batch). LOOKUP_PIPELINE is a power of two at least as large as
+ * the number of keys in flight (twice LOOKUP_PREFETCH_DISTANCE plus
+ * LOOKUP_HASH_BATCH). */
+#define LOOKUP_PREFETCH_DISTANCE 8
+#define LOOKUP_HASH_BATCH 16
+#define LOOKUP_PIPELINE 32
+
+/* With DHT_OPT_FIXED_KEYS, the first bytes of the key are its hash */
+#define FIXED_KEY_MIN_LENGTH 8
+
+/* Smaller tables are rebuilt by a single thread (see dht_set_rebuild_threads) */
+#define PARALLEL_REBUILD_MIN_ENTRIES 65536
+#define MAX_REBUILD_THREADS 256
+
+/* Access counting (see dht_sample_accesses): rows of the count-min sketch and
+ * bounds on the number of counters per row (as powers of 2) */
+#define SKETCH_ROWS 4
+#define SKETCH_MIN_BITS 10
+#define SKETCH_MAX_BITS 24
+
+/* DHT_OPT_COMPACT tables keep the probe offset of an entry in a single byte,
+ * which holds this value for offsets that do not fit (see probe_offset) */
+#define COMPACT_OFFSET_OVERFLOW 255
+
+/* Size of the arena when the first key is added to it (it doubles after) */
+static const size_t ARENA_INITIAL_SIZE = 4096;
+
+/* An all-zero tag marks an empty slot (so that a freshly truncated file needs
+ * no initialization); used slots have the high bit set. */
+static const uint8_t TAG_EMPTY = 0;
+
+/* On-disk copy of the creation options. HashTableOpts can grow without this
+ * changing. */
+typedef struct HashTableDiskOpts {
+    size_t key_maxlen;
+    size_t object_datalen;
+} HashTableDiskOpts;
+
 typedef struct HashTableHeader {
     char magic[16];
-    HashTableOpts opts_;
+    HashTableDiskOpts opts_;
     size_t cursize_;
     size_t slots_used_;
     size_t dirty_slots_;
     size_t capacity_;
-} HashTableHeader; // 64 bytes
+    /* Only present from version 1.2 on (see LEGACY_HEADER_SIZE) */
+    uint64_t format_;
+    uint64_t arena_size_;
+    uint64_t arena_used_;
+    /* the sizing options of the table (0 for the defaults) */
+    uint64_t max_load_percent_;
+    uint64_t growth_percent_;
+    uint64_t reserved_[3];
+} HashTableHeader; // 128 bytes
 
 typedef struct HashTableEntry {
     const char* ht_key;
     void* ht_data;
     void* offset_;
+    void* key_length_; /* NULL unless the table has DHT_OPT_KEY_LENGTHS */
+    void* hash_; /* NULL unless the table has DHT_OPT_STORED_HASHES */
     const HashTable* ht_;
 } HashTableEntry;
 
+/* Continues hash_key over `len` more bytes, starting from `hash` */
 static
-uint64_t hash_key(const char* k, int use_hash_2) {
-    /* Taken from http://www.cse.yorku.ca/~oz/hash.html */
+uint64_t hash_key_from(uint64_t hash, const char* k, size_t len, int use_hash_2) {
     const unsigned char* ku = (const unsigned char*)k;
-    uint64_t hash = 5381u;
+    const unsigned char* end = ku + len;
     uint64_t next;
-    for ( ; *ku; ++ku) {
+    for ( ; ku != end; ++ku) {
         hash *= 33u;
         next = *ku;
         if (use_hash_2) {
@@ -53,6 +192,306 @@ uint64_t hash_key(const char* k, int use_hash_2) {
     return hash;
 }
 
+static
+uint64_t hash_key(const char* k, size_t len, int use_hash_2) {
+    /* Taken from http://www.cse.yorku.ca/~oz/hash.html */
+    return hash_key_from(5381u, k, len, use_hash_2);
+}
+
+/* Returns the low 64 bits of the 128-bit product a * b and stores the high
+ * ones in *hi */
+inline static
+uint64_t mul128(uint64_t a, uint64_t b, uint64_t* hi) {
+#if defined(_MSC_VER) && defined(_M_X64)
+    return _umul128(a, b, hi);
+#elif defined(__SIZEOF_INT128__)
+    const unsigned __int128 r = (unsigned __int128)a * b;
+    *hi = (uint64_t)(r >> 64);
+    return (uint64_t)r;
+#else
+    const uint64_t a_lo = (uint32_t)a, a_hi = a >> 32;
+    const uint64_t b_lo = (uint32_t)b, b_hi = b >> 32;
+    const uint64_t lo_lo = a_lo * b_lo;
+    const uint64_t hi_lo = a_hi * b_lo;
+    const uint64_t lo_hi = a_lo * b_hi;
+    const uint64_t cross = (lo_lo >> 32) + (uint32_t)hi_lo + lo_hi;
+    *hi = a_hi * b_hi + (hi_lo >> 32) + (cross >> 32);
+    return (cross << 32) | (uint32_t)lo_lo;
+#endif
+}
+
+inline static
+uint64_t mulhi64(uint64_t a, uint64_t b) {
+    uint64_t hi;
+    mul128(a, b, &hi);
+    return hi;
+}
+
+/* Multiply-fold: the basic mixing step of wyhash */
+inline static
+uint64_t wymix(uint64_t a, uint64_t b) {
+    uint64_t hi;
+    const uint64_t lo = mul128(a, b, &hi);
+    return lo ^ hi;
+}
+
+/* Unaligned little-endian loads (table files are in native byte order anyway) */
+inline static
+uint64_t read64(const unsigned char* p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline static
+uint64_t read32(const unsigned char* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/* Little-endian integers of `width` bytes (at most 8), for the packed hash
+ * table elements of DHT_OPT_COMPACT tables */
+inline static
+uint64_t read_packed(const unsigned char* p, size_t width) {
+    uint64_t v = 0;
+    while (width--) v = (v << 8) | p[width];
+    return v;
+}
+
+inline static
+void write_packed(unsigned char* p, size_t width, uint64_t v) {
+    size_t i;
+    for (i = 0; i < width; ++i) {
+        p[i] = (unsigned char)v;
+        v >>= 8;
+    }
+}
+
+/* wyhash (final version 4, by Wang Yi; public domain) with the default seed and
+ * secret. Keys are consumed 16 (or 48) bytes per step instead of one. */
+static
+uint64_t wyhash(const char* k, size_t len) {
+    static const uint64_t secret[4] = {
+        UINT64_C(0xa0761d6478bd642f), UINT64_C(0xe7037ed1a0b428db),
+        UINT64_C(0x8ebc6af09c88c6e3), UINT64_C(0x589965cc75374cc3)
+    };
+    const unsigned char* p = (const unsigned char*)k;
+    uint64_t seed = wymix(secret[0], secret[1]);
+    uint64_t a, b;
+    if (len <= 16) {
+        if (len >= 4) {
+            const size_t mid = (len >> 3) << 2;
+            a = (read32(p) << 32) | read32(p + mid);
+            b = (read32(p + len - 4) << 32) | read32(p + len - 4 - mid);
+        } else if (len > 0) {
+            a = ((uint64_t)p[0] << 16) | ((uint64_t)p[len >> 1] << 8) | p[len - 1];
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        size_t i = len;
+        if (i > 48) {
+            uint64_t see1 = seed, see2 = seed;
+            do {
+                seed = wymix(read64(p) ^ secret[1], read64(p + 8) ^ seed);
+                see1 = wymix(read64(p + 16) ^ secret[2], read64(p + 24) ^ see1);
+                see2 = wymix(read64(p + 32) ^ secret[3], read64(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16) {
+            seed = wymix(read64(p) ^ secret[1], read64(p + 8) ^ seed);
+            i -= 16;
+            p += 16;
+        }
+        a = read64(p + i - 16);
+        b = read64(p + i - 8);
+    }
+    a ^= secret[1];
+    b ^= seed;
+    a = mul128(a, b, &b);
+    return wymix(a ^ secret[0] ^ len, b ^ secret[1]);
+}
+
+/* CRC32C of the key, 8 bytes per instruction when the CPU has it (SSE4.2 or
+ * ARMv8 CRC). The table-driven fallback gives the same values, so tables
+ * remain readable on any machine.
+ *
+ * A CRC only has 32 bits; it is combined with the length and spread over 64
+ * bits with a multiplication so that the tag and fingerprint bits are usable. */
+static
+uint64_t crc32c_hash(const char* k, size_t len) {
+    const uint64_t key_len = len;
+    const unsigned char* p = (const unsigned char*)k;
+    uint64_t crc = 0xFFFFFFFFu;
+#if defined(__SSE4_2__) && (defined(__x86_64__) || defined(_M_X64))
+    for ( ; len >= 8; len -= 8, p += 8) crc = _mm_crc32_u64(crc, read64(p));
+    for ( ; len; --len, ++p) crc = _mm_crc32_u8((uint32_t)crc, *p);
+#elif defined(__ARM_FEATURE_CRC32)
+    for ( ; len >= 8; len -= 8, p += 8) crc = __crc32cd((uint32_t)crc, read64(p));
+    for ( ; len; --len, ++p) crc = __crc32cb((uint32_t)crc, *p);
+#else
+    for ( ; len; --len, ++p) crc = crc32c_table[(crc ^ *p) & 0xFF] ^ (crc >> 8);
+#endif
+    const uint64_t h = ((crc ^ 0xFFFFFFFFu) | (key_len << 32)) * UINT64_C(0x9FB21C651E98DF25);
+    return h ^ (h >> 29);
+}
+
+/* Hash function used by the table: djb2 for version 1.0/1.1 tables (see
+ * HT_FLAG_HASH_2), or the one selected when a 1.2 table was created.
+ * Fixed-length keys are taken to be random already (digests), so their first
+ * 8 bytes are used as they are. */
+static
+uint64_t hash_of(const HashTable* ht, const char* key, size_t len) {
+    if (ht->format_ & DHT_OPT_FIXED_KEYS) return read64((const unsigned char*)key);
+    if (ht->format_ & DHT_OPT_WYHASH) return wyhash(key, len);
+    if (ht->format_ & DHT_OPT_CRC32C_HASH) return crc32c_hash(key, len);
+    return hash_key(key, len, ht->flags_ & HT_FLAG_HASH_2);
+}
+
+#ifdef DHT_HASH_DISPATCH
+/* The 8 bytes of the key starting at `off`, zero padded past its end */
+inline static
+uint64_t read_chunk(const char* key, size_t len, size_t off) {
+    const unsigned char* p = (const unsigned char*)key + off;
+    uint64_t v = 0;
+    int i;
+    if (off + 8 <= len) return read64(p);
+    for (i = 0; off + i < len; ++i) v |= (uint64_t)p[i] << (8 * i);
+    return v;
+}
+
+/* hash_key of 4 keys at once, one per AVX2 lane.
+ *
+ * The lanes step through their keys together, 8 bytes at a time. Once the
+ * shortest key is done, each lane only takes the steps for bytes that its
+ * own key has (the others are masked off). */
+__attribute__((target("avx2")))
+static
+void hash_key_x4_avx2(const char* const* keys, const size_t* lens, int use_hash_2, uint64_t* hashes) {
+    const __m256i low_byte = _mm256_set1_epi64x(0xFF);
+    __m256i h = _mm256_set1_epi64x(5381);
+    __m256i left = _mm256_set_epi64x((long long)lens[3], (long long)lens[2], (long long)lens[1], (long long)lens[0]);
+    size_t shortest = lens[0], longest = lens[0];
+    size_t off;
+    int i;
+    for (i = 1; i < 4; ++i) {
+        if (lens[i] < shortest) shortest = lens[i];
+        if (lens[i] > longest) longest = lens[i];
+    }
+    for (off = 0; off < longest; off += 8) {
+        __m256i bytes = _mm256_set_epi64x((long long)read_chunk(keys[3], lens[3], off),
+                                          (long long)read_chunk(keys[2], lens[2], off),
+                                          (long long)read_chunk(keys[1], lens[1], off),
+                                          (long long)read_chunk(keys[0], lens[0], off));
+        const bool all_active = off + 8 <= shortest;
+        const int steps = (longest - off < 8) ? (int)(longest - off) : 8;
+        for (i = 0; i < steps; ++i) {
+            __m256i next = _mm256_and_si256(bytes, low_byte);
+            if (use_hash_2) next = _mm256_i64gather_epi64((const long long*)rtable, next, 8);
+            next = _mm256_xor_si256(_mm256_add_epi64(_mm256_slli_epi64(h, 5), h), next);
+            if (all_active) {
+                h = next;
+            } else {
+                const __m256i active = _mm256_cmpgt_epi64(_mm256_sub_epi64(left, _mm256_set1_epi64x(i)), _mm256_setzero_si256());
+                h = _mm256_blendv_epi8(h, next, active);
+            }
+            bytes = _mm256_srli_epi64(bytes, 8);
+        }
+        left = _mm256_sub_epi64(left, _mm256_set1_epi64x(8));
+    }
+    _mm256_storeu_si256((__m256i*)hashes, h);
+}
+
+/* Same as hash_key_x4_avx2, for 8 keys with AVX-512 */
+__attribute__((target("avx512f")))
+static
+void hash_key_x8_avx512(const char* const* keys, const size_t* lens, int use_hash_2, uint64_t* hashes) {
+    const __m512i low_byte = _mm512_set1_epi64(0xFF);
+    __m512i h = _mm512_set1_epi64(5381);
+    __m512i left = _mm512_loadu_si512(lens);
+    uint64_t chunk[8];
+    size_t shortest = lens[0], longest = lens[0];
+    size_t off;
+    int i;
+    for (i = 1; i < 8; ++i) {
+        if (lens[i] < shortest) shortest = lens[i];
+        if (lens[i] > longest) longest = lens[i];
+    }
+    for (off = 0; off < longest; off += 8) {
+        for (i = 0; i < 8; ++i) chunk[i] = read_chunk(keys[i], lens[i], off);
+        __m512i bytes = _mm512_loadu_si512(chunk);
+        const bool all_active = off + 8 <= shortest;
+        const int steps = (longest - off < 8) ? (int)(longest - off) : 8;
+        for (i = 0; i < steps; ++i) {
+            __m512i next = _mm512_and_si512(bytes, low_byte);
+            if (use_hash_2) next = _mm512_i64gather_epi64(next, (const void*)rtable, 8);
+            next = _mm512_xor_si512(_mm512_add_epi64(_mm512_slli_epi64(h, 5), h), next);
+            if (all_active) {
+                h = next;
+            } else {
+                const __mmask8 active = _mm512_cmpgt_epi64_mask(left, _mm512_set1_epi64(i));
+                h = _mm512_mask_mov_epi64(h, active, next);
+            }
+            bytes = _mm512_srli_epi64(bytes, 8);
+        }
+        left = _mm512_sub_epi64(left, _mm512_set1_epi64(8));
+    }
+    _mm512_storeu_si512(hashes, h);
+}
+#endif
+
+#ifdef DHT_HASH_DISPATCH
+/* Whether the n keys are close enough in length to be worth hashing in SIMD
+ * lanes: lanes whose key is done still take the steps of the longer ones. */
+inline static
+bool similar_lengths(const size_t* lens, size_t n) {
+    size_t shortest = lens[0], longest = lens[0];
+    size_t i;
+    for (i = 1; i < n; ++i) {
+        if (lens[i] < shortest) shortest = lens[i];
+        if (lens[i] > longest) longest = lens[i];
+    }
+    return longest - shortest < 16;
+}
+#endif
+
+/* Sets hashes[i] to hash_of(ht, keys[i], lens[i]) for all i < n.
+ *
+ * djb2 (the hash of tables created without DHT_OPT_WYHASH or
+ * DHT_OPT_CRC32C_HASH) does one dependent multiply-xor per byte, so keys of
+ * similar lengths are hashed several at once in SIMD lanes when the CPU has
+ * AVX-512 (8 keys) or AVX2 (4 keys). The other hash functions are computed
+ * one key at a time: fixed-length keys are not hashed at all, and wyhash and
+ * CRC32C already consume 8 bytes or more per step. */
+static
+void hash_batch(const HashTable* ht, const char* const* keys, const size_t* lens, size_t n, uint64_t* hashes) {
+    size_t i = 0;
+    size_t j;
+#ifdef DHT_HASH_DISPATCH
+    if (!(ht->format_ & (DHT_OPT_FIXED_KEYS | DHT_OPT_WYHASH | DHT_OPT_CRC32C_HASH))) {
+        const int use_hash_2 = ht->flags_ & HT_FLAG_HASH_2;
+        const size_t lanes = __builtin_cpu_supports("avx512f") ? 8
+                            : __builtin_cpu_supports("avx2") ? 4
+                            : 0;
+        for ( ; lanes && i + lanes <= n; i += lanes) {
+            if (!similar_lengths(lens + i, lanes)) {
+                for (j = i; j < i + lanes; ++j) hashes[j] = hash_of(ht, keys[j], lens[j]);
+            } else if (lanes == 8) {
+                hash_key_x8_avx512(keys + i, lens + i, use_hash_2, hashes + i);
+            } else {
+                hash_key_x4_avx2(keys + i, lens + i, use_hash_2, hashes + i);
+            }
+        }
+    }
+#endif
+    for (j = i; j < n; ++j) hashes[j] = hash_of(ht, keys[j], lens[j]);
+}
+
 inline static
 bool is_64bit(const size_t number_of_elements) {
     return number_of_elements > (1L << 32);
@@ -85,15 +524,55 @@ size_t sizeof_table_element(const size_t number_of_elements) {
     return is_64bit(number_of_elements) ? sizeof(uint64_t) : sizeof(uint32_t);
 }
 
+/* Bytes per hash table element. Store indices go up to the capacity, so
+ * DHT_OPT_COMPACT tables use as few bytes as that takes (from 2 up to 6,
+ * which is enough for 2^48 entries); the others use 4 or 8 bytes depending on
+ * the number of slots. */
+inline static
+size_t sizeof_index_element(unsigned int format, const size_t cursize, const size_t capacity) {
+    if (format & DHT_OPT_COMPACT) {
+        size_t width = 2;
+        while (width < 6 && (capacity >> (8 * width))) ++width;
+        return width;
+    }
+    return sizeof_table_element(cursize);
+}
+
+/* Bytes reserved for the key in each store entry (fixed-length keys are not
+ * NUL-terminated).
+ *
+ * In DHT_OPT_COMPACT tables, the field ends with the 1-byte probe offset of
+ * the entry. NUL-terminated keys are shorter than key_maxlen, so that byte is
+ * one that the key never uses. */
+inline static
+size_t sizeof_key_field(unsigned int format, HashTableDiskOpts opts) {
+    if (format & DHT_OPT_KEY_ARENA) return ARENA_INLINE_KEY + ((format & DHT_OPT_COMPACT) ? 1 : 0);
+    if (format & DHT_OPT_FIXED_KEYS) return opts.key_maxlen + ((format & DHT_OPT_COMPACT) ? 1 : 0);
+    return opts.key_maxlen + 1;
+}
+
+/* Bytes of the offset (unless it is in the key field), (optional) key length
+ * and (optional) hash of a store entry */
+inline static
+size_t sizeof_st_meta(unsigned int format, const size_t capacity) {
+    return ((format & DHT_OPT_COMPACT) ? 0 : sizeof_table_element(capacity))  // offset
+            + ((format & DHT_OPT_KEY_LENGTHS) ? sizeof_table_element(capacity) : 0)  // key length
+            + ((format & DHT_OPT_STORED_HASHES) ? sizeof(uint64_t) : 0);  // hash
+}
+
 inline static
-size_t sizeof_st_element(HashTableOpts opts, const size_t capacity) {
-    return  aligned_size(opts.key_maxlen + 1, capacity)
+size_t sizeof_st_element(unsigned int format, HashTableDiskOpts opts, const size_t capacity) {
+    return  aligned_size(sizeof_key_field(format, opts), capacity)
             + aligned_size(opts.object_datalen, capacity)
-            + sizeof_table_element(capacity);  // offset
+            + sizeof_st_meta(format, capacity);
 }
 
 static
 void set_offset(HashTableEntry et, uint64_t offset_value) {
+    if (et.ht_->format_ & DHT_OPT_COMPACT) {
+        *(uint8_t*)et.offset_ = offset_value < COMPACT_OFFSET_OVERFLOW ? (uint8_t)offset_value : COMPACT_OFFSET_OVERFLOW;
+        return;
+    }
     if(is_64bit(cheader_of(et.ht_)->cursize_)) {
         *((uint64_t*)et.offset_) = offset_value;
     } else {
@@ -101,8 +580,11 @@ void set_offset(HashTableEntry et, uint64_t offset_value) {
     }
 }
 
+/* The stored offset, which is 0 for unused entries. It is only the probe
+ * offset of the entry if that fits (see probe_offset). */
 static
 uint64_t get_offset(const HashTableEntry et) {
+    if (et.ht_->format_ & DHT_OPT_COMPACT) return *(const uint8_t*)et.offset_;
     if (is_64bit(cheader_of(et.ht_)->cursize_)) {
         return *((uint64_t*)et.offset_);
     } else {
@@ -110,601 +592,2533 @@ uint64_t get_offset(const HashTableEntry et) {
     }
 }
 
-inline static
-int entry_empty(const HashTableEntry et) {
-    return et.ht_key == NULL || et.offset_ == NULL || get_offset(et) == 0;
-}
-
-static
-void* hashtable_of(HashTable* ht) {
-    return (unsigned char*)ht->data_ + sizeof(HashTableHeader);
-}
-
 static
-uint64_t get_table_at(const HashTable* ht, const uint64_t hash) {
-    assert(hash < cheader_of(ht)->cursize_);
-    if (is_64bit(cheader_of(ht)->cursize_)) {
-        uint64_t* table = (uint64_t*)hashtable_of((HashTable*)ht);
-        return table[hash];
+void set_key_length(HashTableEntry et, uint64_t len) {
+    if (is_64bit(cheader_of(et.ht_)->capacity_)) {
+        *((uint64_t*)et.key_length_) = len;
     } else {
-        uint32_t* table = (uint32_t*)hashtable_of((HashTable*)ht);
-        return table[hash];
+        *((uint32_t*)et.key_length_) = (uint32_t) len;
     }
 }
 
+/* Length of the key stored in the entry */
 static
-void set_table_at(HashTable* ht, const uint64_t hash, const uint64_t val) {
-    if (is_64bit(cheader_of(ht)->cursize_)) {
-        uint64_t* table = (uint64_t*)hashtable_of(ht);
-        table[hash] = val;
+size_t get_key_length(const HashTableEntry et) {
+    if (!et.key_length_) {
+        if (et.ht_->format_ & DHT_OPT_FIXED_KEYS) return cheader_of(et.ht_)->opts_.key_maxlen;
+        return strlen(et.ht_key);
+    }
+    if (is_64bit(cheader_of(et.ht_)->capacity_)) {
+        return (size_t)*((uint64_t*)et.key_length_);
     } else {
-        uint32_t* table = (uint32_t*)hashtable_of(ht);
-        table[hash] = val;
+        return *((uint32_t*)et.key_length_);
     }
 }
 
+/* The stored hash may not be 8-byte aligned (entries with 32-bit fields) */
 static
-void* dirty_at(HashTable* ht, size_t dirty_slot) {
-    const size_t sizeof_ht_element = sizeof_table_element(cheader_of(ht)->cursize_);
-    const size_t sizeof_ds_element = sizeof_table_element(cheader_of(ht)->capacity_);
-    const char* ds_data = (const char*)ht->data_
-                          + sizeof(HashTableHeader)
-                          + cheader_of(ht)->cursize_ * sizeof_ht_element
-                          + cheader_of(ht)->capacity_ * sizeof_st_element(cheader_of(ht)->opts_,
-                                                                          cheader_of(ht)->capacity_);
+void set_entry_hash(HashTableEntry et, uint64_t hash) {
+    if (et.hash_) memcpy(et.hash_, &hash, sizeof(hash));
+}
 
-    void* dirty_entry = (void*)( ds_data + dirty_slot * sizeof_ds_element );
-    return dirty_entry;
+inline static
+bool in_arena(const HashTableEntry et, size_t len) {
+    return (et.ht_->format_ & DHT_OPT_KEY_ARENA) && len > ARENA_INLINE_KEY;
+}
+
+inline static
+char* arena_of(const HashTable* ht) {
+    return (char*)ht->data_ + ht->layout_.arena_;
 }
 
+/* The key bytes of the entry (only NUL-terminated in tables without a key
+ * arena) */
 static
-void set_dirty_index (HashTable* ht, uint64_t dirty_slot, uint64_t dirty_index) {
-    assert(dirty_slot < cheader_of(ht)->capacity_);
-    if (is_64bit(cheader_of(ht)->capacity_)) {
-        *((uint64_t*)dirty_at(ht, dirty_slot)) = dirty_index;
-    } else {
-        *((uint32_t*)dirty_at(ht, dirty_slot)) = (uint32_t) dirty_index;
+const char* entry_key(const HashTableEntry et) {
+    if (in_arena(et, get_key_length(et))) {
+        uint64_t arena_offset;
+        memcpy(&arena_offset, et.ht_key + ARENA_PREFIX, sizeof(arena_offset));
+        return arena_of(et.ht_) + arena_offset;
     }
+    return et.ht_key;
 }
 
-static
-uint64_t get_dirty_index (HashTable* ht, size_t dirty_slot) {
-    assert(dirty_slot < cheader_of(ht)->capacity_);
-    assert(dirty_slot < cheader_of(ht)->dirty_slots_);
-    if (is_64bit(cheader_of(ht)->capacity_)) {
-        return *((uint64_t*)dirty_at(ht, dirty_slot));
-    } else {
-        return *((uint32_t*)dirty_at(ht, dirty_slot));
+/* Compares two fixed-length keys. The common digest sizes get a memcmp() of
+ * constant size, which compilers expand to a few (vector) loads. */
+inline static
+bool fixed_keys_equal(const char* a, const char* b, size_t len) {
+    switch (len) {
+        case 16: return !memcmp(a, b, 16);
+        case 20: return !memcmp(a, b, 20);
+        case 32: return !memcmp(a, b, 32);
+        case 64: return !memcmp(a, b, 64);
+        default: return !memcmp(a, b, len);
     }
 }
 
-static
-HashTableEntry entry_by_index(const HashTable*, size_t);
+/* Whether the entry holds the key key[0..len), which must fit in the table
+ * (see key_fits). Without stored lengths, stored keys are NUL-terminated, so
+ * the byte after the first `len` ones tells whether the lengths are equal. */
+inline static
+bool entry_has_key(const HashTableEntry et, const char* key, size_t len) {
+    if (et.ht_->format_ & DHT_OPT_FIXED_KEYS) return fixed_keys_equal(et.ht_key, key, len);
+    if (et.key_length_) {
+        if (get_key_length(et) != len) return false;
+    } else if (et.ht_key[len] != '\0') {
+        return false;
+    }
+    if (in_arena(et, len)) {
+        /* the prefix is checked first as it avoids a (likely) cache miss */
+        return !memcmp(et.ht_key, key, ARENA_PREFIX)
+                && !memcmp(entry_key(et), key, len);
+    }
+    return !memcmp(et.ht_key, key, len);
+}
 
+/* Stores key[0..len) in the entry (followed by a NUL, so that it can still
+ * be read as a string when it has no NUL bytes itself, unless it goes to a key
+ * arena or has a fixed length).
+ *
+ * Keys are appended to the arena, which must have room for them (see
+ * reserve_arena). */
 static
-HashTableEntry entry_at(const HashTable*, size_t);
-
-void show_ht(const HashTable* ht) {
-    fprintf(stderr, "Hash Table {\n"
-                "\tmagic = \"%s\",\n"
-                "\tcursize = %d,\n"
-                "\tslots used = %zd\n"
-                "\tdirty slots = %zd\n"
-                "\tcapacity = %zd\n"
-                "\n",
-                cheader_of(ht)->magic,
-                (int)cheader_of(ht)->cursize_,
-                cheader_of(ht)->slots_used_,
-                cheader_of(ht)->dirty_slots_,
-                cheader_of(ht)->capacity_);
-
-    uint64_t i;
-    for (i = 0; i < cheader_of(ht)->cursize_; ++i) {
-        int store_index = (int)get_table_at(ht, i);
-        if (store_index > 0) {
-            HashTableEntry et = entry_at(ht, i);
-            fprintf(stderr, "\t[ %d ] = %d    [ %s ]\n",(int)i, store_index, et.ht_key);
-        } else {
-            fprintf(stderr, "\t[ %d ] = %d\n",(int)i, store_index);
-        }
+void set_entry_key(HashTableEntry et, const char* key, size_t len) {
+    if (et.key_length_) set_key_length(et, len);
+    if (in_arena(et, len)) {
+        HashTableHeader* header = (HashTableHeader*)et.ht_->data_;
+        const uint64_t arena_offset = header->arena_used_;
+        assert(arena_offset + len <= header->arena_size_);
+        memcpy(arena_of(et.ht_) + arena_offset, key, len);
+        header->arena_used_ += len;
+        memcpy((char*)et.ht_key, key, ARENA_PREFIX);
+        memcpy((char*)et.ht_key + ARENA_PREFIX, &arena_offset, sizeof(arena_offset));
+        return;
     }
-    fprintf(stderr, "}\n");
+    memcpy((char*)et.ht_key, key, len);
+    if (!(et.ht_->format_ & (DHT_OPT_KEY_ARENA | DHT_OPT_FIXED_KEYS))) ((char*)et.ht_key)[len] = '\0';
 }
 
-void show_st(const HashTable* ht) {
-    fprintf(stderr, "Store Table {\n"
-                    "\tslots used = %zd\n"
-                    "\tdirty slots = %zd\n"
-                    "\tcapacity = %zd\n"
-                    "\n",
-            cheader_of(ht)->slots_used_,
-            cheader_of(ht)->dirty_slots_,
-            cheader_of(ht)->capacity_);
-
-    uint64_t i;
-    for (i = 0; i <= cheader_of(ht)->slots_used_; ++i) {
-        HashTableEntry et = entry_by_index(ht, i);
-        if (!entry_empty(et)) {
-            fprintf(stderr, "\t[ %d ] = { key: %s, offset: %lu }\n",(int)i, et.ht_key, (unsigned long)get_offset(et));
-        } else {
-            if (i == 0) {
-                fprintf(stderr, "\t[ %d ] = { zero }\n",(int)i);
-            } else {
-                fprintf(stderr, "\t[ %d ] = { dirty }\n",(int)i);
-            }
-        }
+/* The hash of the key of the entry: the stored one in DHT_OPT_STORED_HASHES
+ * tables, otherwise computed again from the key */
+inline static
+uint64_t entry_hash(const HashTableEntry et) {
+    if (et.hash_) {
+        uint64_t hash;
+        memcpy(&hash, et.hash_, sizeof(hash));
+        return hash;
     }
-    fprintf(stderr, "}\n");
+    return hash_of(et.ht_, entry_key(et), get_key_length(et));
 }
 
-void show_ds(const HashTable* ht) {
-    fprintf(stderr, "DS {\n"
-                    "\tdirty slots = %zd\n"
-                    "\tcapacity = %zd\n"
-                    "\n",
-            cheader_of(ht)->dirty_slots_,
-            cheader_of(ht)->capacity_);
+/* Whether the entry holds the key (of the given hash). With stored hashes,
+ * entries with a different hash are rejected without comparing keys. */
+inline static
+bool entry_holds(const HashTableEntry et, const char* key, size_t len, uint64_t hash) {
+    if (et.hash_ && entry_hash(et) != hash) return false;
+    return entry_has_key(et, key, len);
+}
 
-    uint64_t i;
-    for (i = 0; i < cheader_of(ht)->dirty_slots_; ++i) {
-        uint64_t dirty_index = get_dirty_index((HashTable *)ht, i);
-        fprintf(stderr, "\t[ %lu ] = %lu\n", (unsigned long)i, (unsigned long)dirty_index);
-    }
-    fprintf(stderr, "}\n");
+inline static
+int entry_empty(const HashTableEntry et) {
+    return et.ht_key == NULL || et.offset_ == NULL || get_offset(et) == 0;
 }
 
 static
-HashTableEntry entry_by_index(const HashTable* ht, size_t ix) {
-    HashTableEntry r;
-    r.ht_ = ht;
-    if (ix == 0) {
-        r.offset_ = 0;
-        r.ht_key = 0;
-        r.ht_data = 0;
-        return r;
-    }
-    --ix;
-    const size_t sizeof_ht_element = sizeof_table_element(cheader_of(ht)->cursize_);
-    const char* st_data = (const char*)ht->data_
-                          + sizeof(HashTableHeader)
-                          + cheader_of(ht)->cursize_ * sizeof_ht_element;
-    char* base_address = 0;
-    r.ht_key = base_address = (char*)st_data + ix * sizeof_st_element(cheader_of(ht)->opts_, cheader_of(ht)->capacity_);
-    r.ht_data = (void*)( base_address += aligned_size(cheader_of(ht)->opts_.key_maxlen + 1, cheader_of(ht)->capacity_) );
-    r.offset_ = (void*)( base_address += aligned_size(cheader_of(ht)->opts_.object_datalen, cheader_of(ht)->capacity_) );
-    return r;
+void* hashtable_of(HashTable* ht) {
+    return (unsigned char*)ht->data_ + ht->layout_.index_;
 }
 
 inline static
-HashTableEntry entry_at(const HashTable* ht, size_t hash) {
-    size_t ix = get_table_at(ht, hash);
-    return entry_by_index(ht, ix);
+size_t region_aligned(size_t s) {
+    return (s + REGION_ALIGNMENT - 1) & ~(REGION_ALIGNMENT - 1);
 }
 
-HashTableOpts dht_zero_opts() {
-    HashTableOpts r;
-    r.key_maxlen = 0;
-    r.object_datalen = 0;
-    return r;
+inline static
+size_t huge_page_aligned(size_t s) {
+    return (s + DHT_HUGE_PAGE_SIZE - 1) & ~(DHT_HUGE_PAGE_SIZE - 1);
 }
 
+/* Computes where each region of a table with the given dimensions lives and
+ * returns the total size of the table.
+ *
+ * Versions 1.0/1.1 pack the regions one after the other; version 1.2 tables
+ * (extended header) align every region to a cache line. The key arena comes
+ * last so that it can grow without moving anything else.
+ *
+ * DHT_OPT_HUGE_PAGES tables start the hash table and the store table on huge
+ * page boundaries, so that neither shares its first huge page with the
+ * previous region.
+ *
+ * The store table is one array of (key, data, offset[, key length]) entries,
+ * except for DHT_OPT_COLUMNAR tables, where each of key, data and the rest is
+ * an array of its own (starting at store_, values_ and meta_).
+ *
+ * DHT_OPT_INLINE tables have neither a hash table nor a dirty stack: their
+ * store table has one entry per slot (the entry of slot h is store entry
+ * h + 1). */
 static
-int check_ht(HashTable* ht, char** err) {
-    if (ht == NULL) {
-        if (err) { *err = strdup("The informed HashTable is an invalid NULL pointer."); }
-        return -EINVAL;
+size_t compute_layout(bool extended, unsigned int format, HashTableDiskOpts opts,
+                      size_t cursize, size_t capacity, size_t arena_size,
+                      HashTableLayout* layout) {
+    HashTableLayout r;
+    if (!extended) {
+        r.tags_ = 0;
+        r.index_ = LEGACY_HEADER_SIZE;
+        r.store_ = r.index_ + cursize * sizeof_table_element(cursize);
+        r.values_ = r.store_;
+        r.meta_ = r.store_;
+        r.dirty_ = r.store_ + capacity * sizeof_st_element(format, opts, capacity);
+        r.total_ = r.dirty_ + capacity * sizeof_table_element(capacity);
+        r.arena_ = r.total_;
+    } else {
+        r.tags_ = sizeof(HashTableHeader);
+        r.index_ = r.tags_;
+        if (format & DHT_OPT_CONTROL_BYTES) {
+            r.index_ = region_aligned(r.tags_ + cursize + TAG_GROUP_WIDTH);
+        }
+        const size_t index_stride = (format & DHT_OPT_FINGERPRINTS) ? 2 : 1;
+        const size_t index_slots = (format & DHT_OPT_INLINE) ? 0 : cursize;
+        const size_t store_entries = (format & DHT_OPT_INLINE) ? cursize : capacity;
+        const size_t dirty_entries = (format & DHT_OPT_INLINE) ? 0 : capacity;
+        if (format & DHT_OPT_HUGE_PAGES) r.index_ = huge_page_aligned(r.index_);
+        r.store_ = region_aligned(r.index_ + index_slots * index_stride * sizeof_index_element(format, cursize, capacity));
+        if (format & DHT_OPT_HUGE_PAGES) r.store_ = huge_page_aligned(r.store_);
+        if (format & DHT_OPT_COLUMNAR) {
+            r.values_ = region_aligned(r.store_ + store_entries * aligned_size(sizeof_key_field(format, opts), capacity));
+            r.meta_ = region_aligned(r.values_ + store_entries * aligned_size(opts.object_datalen, capacity));
+            r.dirty_ = region_aligned(r.meta_ + store_entries * sizeof_st_meta(format, capacity));
+        } else {
+            r.values_ = r.store_;
+            r.meta_ = r.store_;
+            r.dirty_ = region_aligned(r.store_ + store_entries * sizeof_st_element(format, opts, capacity));
+        }
+        r.arena_ = region_aligned(r.dirty_ + dirty_entries * sizeof_table_element(capacity));
+        r.total_ = region_aligned(r.arena_ + arena_size);
     }
-    return 1;
+    if (layout) *layout = r;
+    return r.total_;
+}
+
+inline static
+size_t header_size(const HashTable* ht) {
+    return (ht->flags_ & HT_FLAG_EXT_HEADER) ? sizeof(HashTableHeader) : LEGACY_HEADER_SIZE;
 }
 
 static
-int check_key(const char* key, char** err) {
-    if (key == NULL) {
-        if (err) { *err = strdup("The informed key is an invalid NULL pointer."); }
-        return -EINVAL;
+void update_layout(HashTable* ht) {
+    compute_layout(ht->flags_ & HT_FLAG_EXT_HEADER,
+                   ht->format_,
+                   cheader_of(ht)->opts_,
+                   cheader_of(ht)->cursize_,
+                   cheader_of(ht)->capacity_,
+                   (ht->flags_ & HT_FLAG_EXT_HEADER) ? cheader_of(ht)->arena_size_ : 0,
+                   &ht->layout_);
+}
+
+/* Maps the table file, asking for huge pages if the table was created with
+ * DHT_OPT_HUGE_PAGES */
+static
+bool map_table_file(HashTable* ht, size_t size, int protections) {
+    if (ht->format_ & DHT_OPT_HUGE_PAGES) {
+        return dht_memory_map_file_huge(ht->fd_, &ht->data_, size, protections);
     }
-    return 1;
+    return dht_memory_map_file(ht->fd_, &ht->data_, size, protections);
 }
 
+/* Resizes the table file and its mapping (the contents are kept). The
+ * layout must be updated by the caller.
+ *
+ * If this fails, the table keeps its size, except if it cannot be mapped
+ * again: then data_ is NULL and the table can only be freed. */
 static
-int check_data(const void* data, char** err) {
-    if (data == NULL) {
-        if (err) { *err = strdup("The informed data value is an invalid NULL pointer."); }
-        return -EINVAL;
+int resize_table_file(HashTable* ht, size_t new_size, char** err) {
+    if (!dht_truncate_file(ht->fd_, new_size)) {
+        if (err) {
+            *err = malloc(256);
+            if (*err) {
+                snprintf(*err, 256, "Could not allocate disk space. Error: %s.", strerror(errno));
+            }
+        }
+        return -ENOMEM;
+    }
+    bool map_success;
+    if (ht->format_ & DHT_OPT_HUGE_PAGES) {
+        /* a remapped range would not stay aligned to huge pages */
+        dht_memory_unmap_file(ht->data_, ht->datasize_);
+        map_success = map_table_file(ht, new_size, PROT_READ | PROT_WRITE);
+    } else {
+        map_success = dht_memory_remap_file(ht->fd_, &ht->data_, ht->datasize_, new_size, PROT_READ | PROT_WRITE);
+    }
+    if (!map_success) {
+        if (err) { *err = strdup("mmap() call failed."); }
+        ht->data_ = NULL;
+        return -ENOMEM;
     }
+    ht->datasize_ = new_size;
     return 1;
 }
 
+/* Bytes of key arena used, including those of deleted keys (versions 1.0 and
+ * 1.1 have no arena) */
+inline static
+size_t arena_bytes_used(const HashTable* ht) {
+    return (ht->flags_ & HT_FLAG_EXT_HEADER) ? cheader_of(ht)->arena_used_ : 0;
+}
+
+/* Makes sure that `n` more bytes can be appended to the key arena, growing
+ * it (by doubling) if necessary. */
 static
-int check_ht_writable(HashTable* ht, char** err) {
-    if (!(ht->flags_ & HT_FLAG_CAN_WRITE)) {
-        if (err) { *err = strdup ("Hash table is read-only."); }
-        return -EACCES;
-    }
+int reserve_arena(HashTable* ht, size_t n, char** err) {
+    const uint64_t used = cheader_of(ht)->arena_used_;
+    uint64_t arena_size = cheader_of(ht)->arena_size_;
+    if (used + n <= arena_size) return 1;
+    if (!arena_size) arena_size = ARENA_INITIAL_SIZE;
+    while (arena_size < used + n) arena_size *= 2;
+    HashTableLayout layout;
+    const size_t total_size = compute_layout(true,
+                                             ht->format_,
+                                             cheader_of(ht)->opts_,
+                                             cheader_of(ht)->cursize_,
+                                             cheader_of(ht)->capacity_,
+                                             arena_size,
+                                             &layout);
+    const int r = resize_table_file(ht, total_size, err);
+    if (r != 1) return r;
+    header_of(ht)->arena_size_ = arena_size;
+    ht->layout_ = layout;
     return 1;
 }
 
+inline static
+bool has_tags(const HashTable* ht) {
+    return ht->format_ & DHT_OPT_CONTROL_BYTES;
+}
+
+inline static
+bool is_robin_hood(const HashTable* ht) {
+    return ht->format_ & DHT_OPT_ROBIN_HOOD;
+}
+
+inline static
+bool has_fingerprints(const HashTable* ht) {
+    return ht->format_ & DHT_OPT_FINGERPRINTS;
+}
+
+inline static
+bool is_cuckoo(const HashTable* ht) {
+    return ht->format_ & DHT_OPT_CUCKOO;
+}
+
+inline static
+bool is_inline(const HashTable* ht) {
+    return ht->format_ & DHT_OPT_INLINE;
+}
+
+/* Maps `hash` onto [0, n) (see home_slot) */
+inline static
+uint64_t hash_range(const HashTable* ht, uint64_t hash, uint64_t n) {
+    if (ht->format_ & DHT_OPT_FASTRANGE) {
+        return mulhi64(hash * UINT64_C(0xD6E8FEB86659FD93), n);
+    }
+    return hash % n;
+}
+
+/* Slot at which probing for `hash` starts.
+ *
+ * DHT_OPT_FASTRANGE tables map the hash onto [0, cursize) by taking the high
+ * half of hash * cursize instead of dividing. That uses the top bits of the
+ * hash, which djb2 leaves mostly zero for short keys, so the hash is first
+ * multiplied by a constant (one that is not used for the tag or fingerprint,
+ * so those stay independent of the slot). */
+inline static
+uint64_t home_slot(const HashTable* ht, uint64_t hash) {
+    return hash_range(ht, hash, cheader_of(ht)->cursize_);
+}
+
+/* Number of table elements per hash table slot: with fingerprints, each slot
+ * is a (store index, fingerprint) pair. */
+inline static
+size_t index_stride(const HashTable* ht) {
+    return has_fingerprints(ht) ? 2 : 1;
+}
+
+/* Default maximum load of the hash table, in percent of its slots.
+ *
+ * Robin Hood keeps probe sequences short enough at high loads that the table
+ * can be filled much further before growing. Cuckoo tables never probe
+ * further than two buckets, whatever their load. */
+inline static
+size_t default_max_load(unsigned int format) {
+    if (format & DHT_OPT_CUCKOO) return 90;
+    return (format & DHT_OPT_ROBIN_HOOD) ? 85 : 50;
+}
+
+/* The number of hash table slots is a prime number times this */
+inline static
+size_t slots_per_bucket(unsigned int format) {
+    return (format & DHT_OPT_CUCKOO) ? CUCKOO_BUCKET_SLOTS : 1;
+}
+
+/* Number of store entries in use (and of dirty ones) in a new table with n
+ * hash table slots: DHT_OPT_INLINE tables count every slot's entry as used
+ * and those of empty slots as dirty, so that dht_size is still the
+ * difference and dht_indexed_lookup reaches every slot. */
+inline static
+size_t initial_store_entries(unsigned int format, size_t n) {
+    return (format & DHT_OPT_INLINE) ? n : 0;
+}
+
+/* Maximum load of ht: the one it was created with or the default one */
+inline static
+size_t max_load(const HashTable* ht) {
+    const uint64_t load = (ht->flags_ & HT_FLAG_EXT_HEADER) ? cheader_of(ht)->max_load_percent_ : 0;
+    return load ? (size_t)load : default_max_load(ht->format_);
+}
+
+/* n percent of x (without overflowing for large x) */
+inline static
+size_t percent_of(size_t x, size_t n) {
+    return x / 100 * n + x % 100 * n / 100;
+}
+
+/* Store capacity of a table with n hash table slots and a maximum load of
+ * `load` percent */
+inline static
+size_t capacity_for_slots(size_t load, size_t n) {
+    return percent_of(n, load);
+}
+
+/* Number of hash table slots of the largest table (the last prime) */
 static
-int check_key_size(HashTable* ht, const char* key, char** err) {
-    if (strlen(key) >= header_of(ht)->opts_.key_maxlen) {
-        if (err) { *err = strdup("Key is too long."); }
-        return -EINVAL;
+uint64_t max_slots(unsigned int format) {
+    uint64_t i = 0;
+    while (primes[i + 1]) ++i;
+    return primes[i] * slots_per_bucket(format);
+}
+
+/* Number of hash table slots of a table with room for (at least) cap entries
+ * at a maximum load of `load` percent. Capacities that do not fit in the
+ * largest table get the largest table. */
+static
+uint64_t slots_for_capacity(unsigned int format, size_t load, size_t cap) {
+    const uint64_t min_slots = cap > SIZE_MAX / 100 ? UINT64_MAX : cap * 100 / load + 1;
+    uint64_t i = 0;
+    const uint64_t bucket_slots = slots_per_bucket(format);
+    while (primes[i + 1] && primes[i] * bucket_slots < min_slots) ++i;
+    return primes[i] * bucket_slots;
+}
+
+inline static
+uint8_t* tags_of(const HashTable* ht) {
+    return (uint8_t*)ht->data_ + ht->layout_.tags_;
+}
+
+/* The top bits of djb2 are zero for short keys, so the 7 tag bits are taken
+ * from a multiplicative mix of the hash rather than directly. */
+inline static
+uint8_t tag_of_hash(uint64_t hash) {
+    return (uint8_t)(0x80u | ((hash * UINT64_C(0x9E3779B97F4A7C15)) >> 57));
+}
+
+static
+void set_tag(HashTable* ht, uint64_t pos, uint8_t tag) {
+    uint8_t* tags = tags_of(ht);
+    tags[pos] = tag;
+    if (pos < TAG_GROUP_WIDTH) {
+        tags[cheader_of(ht)->cursize_ + pos] = tag;
     }
-    return 1;
 }
 
-HashTable* dht_open(const char* fpath, HashTableOpts opts, int flags, char** err) {
-    if (!fpath || !*fpath) return NULL;
-    const dht_file_t fd = dht_open_file(fpath, flags, false);
-    int needs_init = 0;
-    bool fd_err = false;
-#ifdef _WIN32
-    fd_err = fd == NULL;
+inline static
+unsigned lowest_bit(uint32_t mask) {
+#ifdef _MSC_VER
+    unsigned long ix;
+    _BitScanForward(&ix, mask);
+    return (unsigned)ix;
 #else
-    fd_err = fd < 0;
+    return (unsigned)__builtin_ctz(mask);
 #endif
-    if (fd_err) {
-        if (err) { *err = strdup("open call failed."); }
-        return NULL;
+}
+
+/* Compares TAG_GROUP_WIDTH tags starting at `group` against `tag`.
+ *
+ * Returns the bitmask of matching positions and stores the bitmask of empty
+ * positions in *empty.
+ */
+inline static
+uint32_t tag_group_match(const uint8_t* group, uint8_t tag, uint32_t* empty) {
+#if defined(__AVX2__)
+    const __m256i g = _mm256_loadu_si256((const __m256i*)group);
+    *empty = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(g, _mm256_setzero_si256()));
+    return (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(g, _mm256_set1_epi8((char)tag)));
+#elif defined(__SSE2__) || defined(_M_X64)
+    const __m128i lo = _mm_loadu_si128((const __m128i*)group);
+    const __m128i hi = _mm_loadu_si128((const __m128i*)(group + 16));
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i t = _mm_set1_epi8((char)tag);
+    *empty = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(lo, zero))
+            | ((uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(hi, zero)) << 16);
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(lo, t))
+            | ((uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(hi, t)) << 16);
+#else
+    uint32_t match = 0;
+    unsigned i;
+    *empty = 0;
+    for (i = 0; i < TAG_GROUP_WIDTH; ++i) {
+        if (group[i] == tag) match |= (uint32_t)1 << i;
+        if (group[i] == TAG_EMPTY) *empty |= (uint32_t)1 << i;
     }
-    HashTable* rp = (HashTable*)malloc(sizeof(HashTable));
-    if (!rp) {
-        if (err) { *err = NULL; }
-        return NULL;
+    return match;
+#endif
+}
+
+static
+HashTableEntry entry_by_index(const HashTable*, size_t);
+
+/* Bytes per hash table element (see sizeof_index_element) */
+inline static
+size_t index_width(const HashTable* ht) {
+    return sizeof_index_element(ht->format_, cheader_of(ht)->cursize_, cheader_of(ht)->capacity_);
+}
+
+/* The store index held by slot `hash` (0 if it is empty). In DHT_OPT_INLINE
+ * tables, that is the slot's own entry if it is in use. */
+static
+uint64_t get_table_at(const HashTable* ht, const uint64_t hash) {
+    assert(hash < cheader_of(ht)->cursize_);
+    if (is_inline(ht)) {
+        return get_offset(entry_by_index(ht, hash + 1)) ? hash + 1 : 0;
     }
-    rp->fd_ = fd;
-    rp->fname_ = strdup(fpath);
-    if (!rp->fname_) {
-        if (err) { *err = NULL; }
-        dht_close_file(rp->fd_);
-        free(rp);
-        return NULL;
+    if (ht->format_ & DHT_OPT_COMPACT) {
+        const size_t width = index_width(ht);
+        return read_packed((const unsigned char*)hashtable_of((HashTable*)ht) + hash * index_stride(ht) * width, width);
     }
-    dht_file_size(rp->fd_, &rp->datasize_);
-    if (rp->datasize_ == 0) {
-        needs_init = 1;
-        rp->datasize_ = sizeof(HashTableHeader)
-                + INITIAL_HT_SIZE * sizeof_table_element(INITIAL_HT_SIZE)        // hash table
-                + INITIAL_CAPACITY * sizeof_st_element(opts, INITIAL_CAPACITY)   // store table
-                + INITIAL_CAPACITY * sizeof_table_element(INITIAL_CAPACITY);     // dirty stack (deleted slots)
-        if (!dht_truncate_file(fd, rp->datasize_)) {
+    if (is_64bit(cheader_of(ht)->cursize_)) {
+        uint64_t* table = (uint64_t*)hashtable_of((HashTable*)ht);
+        return table[hash * index_stride(ht)];
+    } else {
+        uint32_t* table = (uint32_t*)hashtable_of((HashTable*)ht);
+        return table[hash * index_stride(ht)];
+    }
+}
+
+/* Does nothing in DHT_OPT_INLINE tables, where whether a slot is used is only
+ * recorded in its entry (see get_table_at) */
+static
+void set_table_at(HashTable* ht, const uint64_t hash, const uint64_t val) {
+    if (is_inline(ht)) {
+        assert(val == 0 || val == hash + 1);
+        return;
+    }
+    if (ht->format_ & DHT_OPT_COMPACT) {
+        const size_t width = index_width(ht);
+        write_packed((unsigned char*)hashtable_of(ht) + hash * index_stride(ht) * width, width, val);
+        return;
+    }
+    if (is_64bit(cheader_of(ht)->cursize_)) {
+        uint64_t* table = (uint64_t*)hashtable_of(ht);
+        table[hash * index_stride(ht)] = val;
+    } else {
+        uint32_t* table = (uint32_t*)hashtable_of(ht);
+        table[hash * index_stride(ht)] = val;
+    }
+}
+
+/* Fingerprints are only meaningful for used slots (and DHT_OPT_FINGERPRINTS
+ * tables). */
+static
+uint32_t get_fingerprint_at(const HashTable* ht, const uint64_t hash) {
+    assert(has_fingerprints(ht));
+    assert(hash < cheader_of(ht)->cursize_);
+    if (is_64bit(cheader_of(ht)->cursize_)) {
+        uint64_t* table = (uint64_t*)hashtable_of((HashTable*)ht);
+        return (uint32_t)table[2 * hash + 1];
+    } else {
+        uint32_t* table = (uint32_t*)hashtable_of((HashTable*)ht);
+        return table[2 * hash + 1];
+    }
+}
+
+static
+void set_fingerprint_at(HashTable* ht, const uint64_t hash, const uint32_t fp) {
+    assert(has_fingerprints(ht));
+    if (is_64bit(cheader_of(ht)->cursize_)) {
+        uint64_t* table = (uint64_t*)hashtable_of(ht);
+        table[2 * hash + 1] = fp;
+    } else {
+        uint32_t* table = (uint32_t*)hashtable_of(ht);
+        table[2 * hash + 1] = fp;
+    }
+}
+
+/* Uses different hash bits than tag_of_hash (and than the slot position) so
+ * that entries whose tags collide still mostly have different fingerprints. */
+inline static
+uint32_t fingerprint_of_hash(uint64_t hash) {
+    return (uint32_t)((hash * UINT64_C(0xC2B2AE3D27D4EB4F)) >> 32);
+}
+
+/* Everything derived from the key's hash that is kept next to a hash table
+ * slot (depending on the table format). It must move whenever the contents
+ * of the slot move. */
+typedef struct SlotMeta {
+    uint8_t tag;
+    uint32_t fingerprint;
+} SlotMeta;
+
+inline static
+SlotMeta slot_meta_of_hash(uint64_t hash) {
+    SlotMeta m;
+    m.tag = tag_of_hash(hash);
+    m.fingerprint = fingerprint_of_hash(hash);
+    return m;
+}
+
+inline static
+SlotMeta empty_slot_meta(void) {
+    SlotMeta m;
+    m.tag = TAG_EMPTY;
+    m.fingerprint = 0;
+    return m;
+}
+
+inline static
+SlotMeta get_slot_meta(const HashTable* ht, uint64_t h) {
+    SlotMeta m = empty_slot_meta();
+    if (has_tags(ht)) m.tag = tags_of(ht)[h];
+    if (has_fingerprints(ht)) m.fingerprint = get_fingerprint_at(ht, h);
+    return m;
+}
+
+inline static
+void set_slot_meta(HashTable* ht, uint64_t h, SlotMeta m) {
+    if (has_tags(ht)) set_tag(ht, h, m.tag);
+    if (has_fingerprints(ht)) set_fingerprint_at(ht, h, m.fingerprint);
+}
+
+static
+void* dirty_at(HashTable* ht, size_t dirty_slot) {
+    const size_t sizeof_ds_element = sizeof_table_element(cheader_of(ht)->capacity_);
+    const char* ds_data = (const char*)ht->data_ + ht->layout_.dirty_;
+
+    void* dirty_entry = (void*)( ds_data + dirty_slot * sizeof_ds_element );
+    return dirty_entry;
+}
+
+static
+void set_dirty_index (HashTable* ht, uint64_t dirty_slot, uint64_t dirty_index) {
+    assert(dirty_slot < cheader_of(ht)->capacity_);
+    if (is_64bit(cheader_of(ht)->capacity_)) {
+        *((uint64_t*)dirty_at(ht, dirty_slot)) = dirty_index;
+    } else {
+        *((uint32_t*)dirty_at(ht, dirty_slot)) = (uint32_t) dirty_index;
+    }
+}
+
+static
+uint64_t get_dirty_index (HashTable* ht, size_t dirty_slot) {
+    assert(dirty_slot < cheader_of(ht)->capacity_);
+    assert(dirty_slot < cheader_of(ht)->dirty_slots_);
+    if (is_64bit(cheader_of(ht)->capacity_)) {
+        return *((uint64_t*)dirty_at(ht, dirty_slot));
+    } else {
+        return *((uint32_t*)dirty_at(ht, dirty_slot));
+    }
+}
+
+static
+HashTableEntry entry_at(const HashTable*, size_t);
+
+void show_ht(const HashTable* ht) {
+    fprintf(stderr, "Hash Table {\n"
+                "\tmagic = \"%s\",\n"
+                "\tcursize = %d,\n"
+                "\tslots used = %zd\n"
+                "\tdirty slots = %zd\n"
+                "\tcapacity = %zd\n"
+                "\n",
+                cheader_of(ht)->magic,
+                (int)cheader_of(ht)->cursize_,
+                cheader_of(ht)->slots_used_,
+                cheader_of(ht)->dirty_slots_,
+                cheader_of(ht)->capacity_);
+
+    uint64_t i;
+    for (i = 0; i < cheader_of(ht)->cursize_; ++i) {
+        int store_index = (int)get_table_at(ht, i);
+        if (store_index > 0) {
+            HashTableEntry et = entry_at(ht, i);
+            fprintf(stderr, "\t[ %d ] = %d    [ %.*s ]\n",(int)i, store_index, (int)get_key_length(et), entry_key(et));
+        } else {
+            fprintf(stderr, "\t[ %d ] = %d\n",(int)i, store_index);
+        }
+    }
+    fprintf(stderr, "}\n");
+}
+
+void show_st(const HashTable* ht) {
+    fprintf(stderr, "Store Table {\n"
+                    "\tslots used = %zd\n"
+                    "\tdirty slots = %zd\n"
+                    "\tcapacity = %zd\n"
+                    "\n",
+            cheader_of(ht)->slots_used_,
+            cheader_of(ht)->dirty_slots_,
+            cheader_of(ht)->capacity_);
+
+    uint64_t i;
+    for (i = 0; i <= cheader_of(ht)->slots_used_; ++i) {
+        HashTableEntry et = entry_by_index(ht, i);
+        if (!entry_empty(et)) {
+            fprintf(stderr, "\t[ %d ] = { key: %.*s, offset: %lu }\n",(int)i, (int)get_key_length(et), entry_key(et), (unsigned long)get_offset(et));
+        } else {
+            if (i == 0) {
+                fprintf(stderr, "\t[ %d ] = { zero }\n",(int)i);
+            } else {
+                fprintf(stderr, "\t[ %d ] = { dirty }\n",(int)i);
+            }
+        }
+    }
+    fprintf(stderr, "}\n");
+}
+
+void show_ds(const HashTable* ht) {
+    fprintf(stderr, "DS {\n"
+                    "\tdirty slots = %zd\n"
+                    "\tcapacity = %zd\n"
+                    "\n",
+            cheader_of(ht)->dirty_slots_,
+            cheader_of(ht)->capacity_);
+
+    uint64_t i;
+    for (i = 0; i < cheader_of(ht)->dirty_slots_; ++i) {
+        uint64_t dirty_index = get_dirty_index((HashTable *)ht, i);
+        fprintf(stderr, "\t[ %lu ] = %lu\n", (unsigned long)i, (unsigned long)dirty_index);
+    }
+    fprintf(stderr, "}\n");
+}
+
+static
+HashTableEntry entry_by_index(const HashTable* ht, size_t ix) {
+    HashTableEntry r;
+    r.ht_ = ht;
+    if (ix == 0) {
+        r.offset_ = 0;
+        r.key_length_ = 0;
+        r.hash_ = 0;
+        r.ht_key = 0;
+        r.ht_data = 0;
+        return r;
+    }
+    --ix;
+    if (ht->format_ & DHT_OPT_COLUMNAR) {
+        const size_t capacity = cheader_of(ht)->capacity_;
+        const char* data = (const char*)ht->data_;
+        const size_t key_field = sizeof_key_field(ht->format_, cheader_of(ht)->opts_);
+        char* meta = (char*)data + ht->layout_.meta_ + ix * sizeof_st_meta(ht->format_, capacity);
+        r.ht_key = data + ht->layout_.store_ + ix * aligned_size(key_field, capacity);
+        r.ht_data = (void*)(data + ht->layout_.values_ + ix * aligned_size(cheader_of(ht)->opts_.object_datalen, capacity));
+        r.offset_ = (ht->format_ & DHT_OPT_COMPACT) ? (void*)(r.ht_key + key_field - 1) : (void*)meta;
+        r.key_length_ = (ht->format_ & DHT_OPT_KEY_LENGTHS)
+                            ? (void*)(meta + sizeof_st_meta(ht->format_, capacity)
+                                        - ((ht->format_ & DHT_OPT_STORED_HASHES) ? sizeof(uint64_t) : 0)
+                                        - sizeof_table_element(capacity))
+                            : NULL;
+        r.hash_ = (ht->format_ & DHT_OPT_STORED_HASHES)
+                            ? (void*)(meta + sizeof_st_meta(ht->format_, capacity) - sizeof(uint64_t))
+                            : NULL;
+        return r;
+    }
+    const char* st_data = (const char*)ht->data_ + ht->layout_.store_;
+    const size_t key_field = sizeof_key_field(ht->format_, cheader_of(ht)->opts_);
+    char* base_address = 0;
+    r.ht_key = base_address = (char*)st_data + ix * sizeof_st_element(ht->format_, cheader_of(ht)->opts_, cheader_of(ht)->capacity_);
+    r.ht_data = (void*)( base_address += aligned_size(key_field, cheader_of(ht)->capacity_) );
+    base_address += aligned_size(cheader_of(ht)->opts_.object_datalen, cheader_of(ht)->capacity_);
+    if (ht->format_ & DHT_OPT_COMPACT) {
+        r.offset_ = (void*)(r.ht_key + key_field - 1);
+        r.key_length_ = (ht->format_ & DHT_OPT_KEY_LENGTHS) ? (void*)base_address : NULL;
+    } else {
+        r.offset_ = (void*)base_address;
+        r.key_length_ = (ht->format_ & DHT_OPT_KEY_LENGTHS)
+                            ? (void*)( base_address + sizeof_table_element(cheader_of(ht)->capacity_) )
+                            : NULL;
+    }
+    r.hash_ = (ht->format_ & DHT_OPT_STORED_HASHES)
+                        ? (void*)( base_address + sizeof_st_meta(ht->format_, cheader_of(ht)->capacity_) - sizeof(uint64_t) )
+                        : NULL;
+    return r;
+}
+
+/* The entry of slot `hash`. In DHT_OPT_INLINE tables, that of an empty slot
+ * is its own (unused) entry rather than none. */
+inline static
+HashTableEntry entry_at(const HashTable* ht, size_t hash) {
+    if (is_inline(ht)) return entry_by_index(ht, hash + 1);
+    size_t ix = get_table_at(ht, hash);
+    return entry_by_index(ht, ix);
+}
+
+/* The probe offset (1 for its home slot) of et, the entry of the used slot h.
+ * DHT_OPT_COMPACT tables only store offsets below COMPACT_OFFSET_OVERFLOW, so
+ * longer ones are computed from the hash of the key. */
+static
+uint64_t probe_offset(const HashTable* ht, uint64_t h, const HashTableEntry et) {
+    const uint64_t offset = get_offset(et);
+    if (offset != COMPACT_OFFSET_OVERFLOW || !(ht->format_ & DHT_OPT_COMPACT)) return offset;
+    const uint64_t home = home_slot(ht, entry_hash(et));
+    return (h >= home ? h - home : h + cheader_of(ht)->cursize_ - home) + 1;
+}
+
+/* Whether the used slot h holds `key` (whose hash is `hash`). When the table
+ * has fingerprints, they are compared first so that other keys are (almost
+ * always) rejected without reading the store table. */
+inline static
+bool slot_holds(const HashTable* ht, uint64_t h, const char* key, size_t len, uint64_t hash) {
+    if (has_fingerprints(ht) && get_fingerprint_at(ht, h) != fingerprint_of_hash(hash)) return false;
+    return entry_holds(entry_at(ht, h), key, len, hash);
+}
+
+HashTableOpts dht_zero_opts() {
+    HashTableOpts r;
+    r.key_maxlen = 0;
+    r.object_datalen = 0;
+    r.flags = 0;
+    r.initial_capacity = 0;
+    r.max_load_percent = 0;
+    r.growth_percent = 0;
+    return r;
+}
+
+static
+HashTableOpts opts_of(const HashTable* ht) {
+    HashTableOpts r = dht_zero_opts();
+    r.key_maxlen = cheader_of(ht)->opts_.key_maxlen;
+    r.object_datalen = cheader_of(ht)->opts_.object_datalen;
+    r.flags = ht->format_;
+    if (ht->flags_ & HT_FLAG_EXT_HEADER) {
+        r.max_load_percent = (unsigned int)cheader_of(ht)->max_load_percent_;
+        r.growth_percent = (unsigned int)cheader_of(ht)->growth_percent_;
+    }
+    return r;
+}
+
+/* The initial capacity is only used when the table is created, so it is not
+ * compared */
+static
+bool opts_mismatch(const HashTable* ht, HashTableOpts opts) {
+    const HashTableOpts table_opts = opts_of(ht);
+    return (table_opts.key_maxlen != opts.key_maxlen && opts.key_maxlen != 0)
+        || (table_opts.object_datalen != opts.object_datalen && opts.object_datalen != 0)
+        || (table_opts.flags != opts.flags && opts.flags != 0)
+        || (table_opts.max_load_percent != opts.max_load_percent && opts.max_load_percent != 0)
+        || (table_opts.growth_percent != opts.growth_percent && opts.growth_percent != 0);
+}
+
+static
+int check_ht(HashTable* ht, char** err) {
+    if (ht == NULL) {
+        if (err) { *err = strdup("The informed HashTable is an invalid NULL pointer."); }
+        return -EINVAL;
+    }
+    return 1;
+}
+
+static
+int check_key(const char* key, char** err) {
+    if (key == NULL) {
+        if (err) { *err = strdup("The informed key is an invalid NULL pointer."); }
+        return -EINVAL;
+    }
+    return 1;
+}
+
+static
+int check_data(const void* data, char** err) {
+    if (data == NULL) {
+        if (err) { *err = strdup("The informed data value is an invalid NULL pointer."); }
+        return -EINVAL;
+    }
+    return 1;
+}
+
+static
+int check_ht_writable(HashTable* ht, char** err) {
+    if (!(ht->flags_ & HT_FLAG_CAN_WRITE)) {
+        if (err) { *err = strdup ("Hash table is read-only."); }
+        return -EACCES;
+    }
+    return 1;
+}
+
+/* Whether a key of `len` bytes can be stored in the table */
+inline static
+bool key_fits(const HashTable* ht, size_t len) {
+    if (ht->format_ & DHT_OPT_FIXED_KEYS) return len == cheader_of(ht)->opts_.key_maxlen;
+    return len < cheader_of(ht)->opts_.key_maxlen;
+}
+
+/* Length of a key given without one: tables with fixed-length keys read
+ * key_maxlen bytes, the others take a NUL-terminated string */
+inline static
+size_t key_length_of(const HashTable* ht, const char* key) {
+    if (ht->format_ & DHT_OPT_FIXED_KEYS) return cheader_of(ht)->opts_.key_maxlen;
+    return strlen(key);
+}
+
+static
+int check_key_size(HashTable* ht, size_t len, char** err) {
+    if (!key_fits(ht, len)) {
+        if (err) {
+            *err = strdup((ht->format_ & DHT_OPT_FIXED_KEYS) && len < cheader_of(ht)->opts_.key_maxlen ?
+                                "Key is too short." : "Key is too long.");
+        }
+        return -EINVAL;
+    }
+    return 1;
+}
+
+/* Keys passed with an explicit length can only contain NUL bytes if the table
+ * stores key lengths (or all keys have the same length) */
+static
+int check_key_bytes(HashTable* ht, const char* key, size_t len, char** err) {
+    if (!(ht->format_ & (DHT_OPT_KEY_LENGTHS | DHT_OPT_FIXED_KEYS)) && memchr(key, '\0', len)) {
+        if (err) { *err = strdup("Key contains NUL bytes (only tables created with DHT_OPT_KEY_LENGTHS can store them)."); }
+        return -EINVAL;
+    }
+    return 1;
+}
+
+/* Returns why `flags` is not a valid combination of DHT_OPT_* values (or NULL
+ * if it is). */
+static
+const char* format_flags_error(unsigned int flags, size_t key_maxlen) {
+    if (flags & ~FORMAT_FLAGS_MASK) return "Unknown table format flags.";
+    if ((flags & DHT_OPT_WYHASH) && (flags & DHT_OPT_CRC32C_HASH)) {
+        return "At most one hash function can be selected.";
+    }
+    if ((flags & DHT_OPT_KEY_ARENA) && !(flags & DHT_OPT_KEY_LENGTHS)) {
+        return "DHT_OPT_KEY_ARENA requires DHT_OPT_KEY_LENGTHS.";
+    }
+    if (flags & DHT_OPT_FIXED_KEYS) {
+        if (flags & (DHT_OPT_WYHASH | DHT_OPT_CRC32C_HASH)) {
+            return "DHT_OPT_FIXED_KEYS tables do not hash their keys (no hash function can be selected).";
+        }
+        if (flags & (DHT_OPT_KEY_LENGTHS | DHT_OPT_KEY_ARENA)) {
+            return "DHT_OPT_FIXED_KEYS cannot be combined with DHT_OPT_KEY_LENGTHS or DHT_OPT_KEY_ARENA.";
+        }
+        if (key_maxlen < FIXED_KEY_MIN_LENGTH) {
+            return "DHT_OPT_FIXED_KEYS requires keys of at least 8 bytes.";
+        }
+    }
+    if ((flags & DHT_OPT_CUCKOO) && (flags & (DHT_OPT_CONTROL_BYTES | DHT_OPT_ROBIN_HOOD))) {
+        return "DHT_OPT_CUCKOO cannot be combined with DHT_OPT_CONTROL_BYTES or DHT_OPT_ROBIN_HOOD.";
+    }
+    if ((flags & DHT_OPT_INLINE) && (flags & (DHT_OPT_CONTROL_BYTES | DHT_OPT_ROBIN_HOOD | DHT_OPT_FINGERPRINTS
+                                              | DHT_OPT_CUCKOO | DHT_OPT_KEY_ARENA | DHT_OPT_COLUMNAR))) {
+        return "DHT_OPT_INLINE cannot be combined with DHT_OPT_CONTROL_BYTES, DHT_OPT_ROBIN_HOOD, DHT_OPT_FINGERPRINTS, "
+               "DHT_OPT_CUCKOO, DHT_OPT_KEY_ARENA or DHT_OPT_COLUMNAR.";
+    }
+    if ((flags & DHT_OPT_COMPACT) && (flags & DHT_OPT_FINGERPRINTS)) {
+        return "DHT_OPT_COMPACT cannot be combined with DHT_OPT_FINGERPRINTS.";
+    }
+    return NULL;
+}
+
+/* Returns why the sizing options are not valid (or NULL if they are) */
+static
+const char* sizing_opts_error(HashTableOpts opts) {
+    if (opts.max_load_percent
+            && (opts.max_load_percent < MIN_LOAD_PERCENT || opts.max_load_percent > MAX_LOAD_PERCENT)) {
+        return "max_load_percent must be between 10 and 95.";
+    }
+    if (opts.growth_percent && (opts.growth_percent <= 100 || opts.growth_percent > MAX_GROWTH_PERCENT)) {
+        return "growth_percent must be more than 100 and at most 1000.";
+    }
+    const size_t load = opts.max_load_percent ? opts.max_load_percent : default_max_load(opts.flags);
+    if (opts.initial_capacity > SIZE_MAX / 100
+            || opts.initial_capacity * 100 / load + 1 > max_slots(opts.flags)) {
+        return "initial_capacity is too large.";
+    }
+    return NULL;
+}
+
+HashTable* dht_open(const char* fpath, HashTableOpts opts, int flags, char** err) {
+    if (!fpath || !*fpath) return NULL;
+    const dht_file_t fd = dht_open_file(fpath, flags, false);
+    int needs_init = 0;
+    size_t initial_size = INITIAL_HT_SIZE;
+    size_t load = 0;
+    bool fd_err = false;
+#ifdef _WIN32
+    fd_err = fd == NULL;
+#else
+    fd_err = fd < 0;
+#endif
+    if (fd_err) {
+        if (err) { *err = strdup("open call failed."); }
+        return NULL;
+    }
+    HashTable* rp = (HashTable*)malloc(sizeof(HashTable));
+    if (!rp) {
+        if (err) { *err = NULL; }
+        return NULL;
+    }
+    rp->fd_ = fd;
+    rp->growth_step_ = 0;
+    rp->growth_ = NULL;
+    rp->rebuild_threads_ = 1;
+    rp->sketch_ = NULL;
+    rp->fname_ = strdup(fpath);
+    if (!rp->fname_) {
+        if (err) { *err = NULL; }
+        dht_close_file(rp->fd_);
+        free(rp);
+        return NULL;
+    }
+    rp->format_ = 0;
+    rp->flags_ = HT_FLAG_HASH_2;
+    dht_file_size(rp->fd_, &rp->datasize_);
+    if (rp->datasize_ == 0) {
+        needs_init = 1;
+        const char* flags_error = format_flags_error(opts.flags, opts.key_maxlen);
+        if (!flags_error) flags_error = sizing_opts_error(opts);
+        if (flags_error) {
+            if (err) { *err = strdup(flags_error); }
+            dht_close_file(rp->fd_);
+            free((char*)rp->fname_);
+            free(rp);
+            return NULL;
+        }
+        rp->format_ = opts.flags;
+        /* the sizing options are kept in the header extension */
+        if (rp->format_ || opts.max_load_percent || opts.growth_percent) rp->flags_ |= HT_FLAG_EXT_HEADER;
+        load = opts.max_load_percent ? opts.max_load_percent : default_max_load(rp->format_);
+        initial_size = opts.initial_capacity
+                        ? slots_for_capacity(rp->format_, load, opts.initial_capacity)
+                        : INITIAL_HT_SIZE * slots_per_bucket(rp->format_);
+        HashTableDiskOpts disk_opts;
+        disk_opts.key_maxlen = opts.key_maxlen;
+        disk_opts.object_datalen = opts.object_datalen;
+        rp->datasize_ = compute_layout(rp->flags_ & HT_FLAG_EXT_HEADER,
+                                       rp->format_,
+                                       disk_opts,
+                                       initial_size,
+                                       capacity_for_slots(load, initial_size),
+                                       0,
+                                       NULL);
+        if (!dht_truncate_file(fd, rp->datasize_)) {
+            if (err) {
+                *err = malloc(256);
+                if (*err) {
+                    snprintf(*err, 256, "Could not allocate disk space. Error: %s.", strerror(errno));
+                }
+            }
+            dht_close_file(rp->fd_);
+            free((char*)rp->fname_);
+            free(rp);
+            return NULL;
+        }
+    }
+    const int prot = (flags == O_RDONLY) ?
+                                PROT_READ
+                                : PROT_READ|PROT_WRITE;
+    if (prot & PROT_WRITE) rp->flags_ |= HT_FLAG_CAN_WRITE;
+    bool map_success = map_table_file(rp, rp->datasize_, prot);
+    if (!map_success) {
+        if (err) { *err = strdup("mmap() call failed."); }
+        dht_close_file(rp->fd_);
+        free((char*)rp->fname_);
+        free(rp);
+        return NULL;
+    }
+    if (needs_init) {
+        if (rp->flags_ & HT_FLAG_EXT_HEADER) {
+            strcpy(header_of(rp)->magic, "DiskBasedHash12");
+            header_of(rp)->format_ = rp->format_;
+            header_of(rp)->max_load_percent_ = opts.max_load_percent;
+            header_of(rp)->growth_percent_ = opts.growth_percent;
+        } else {
+            strcpy(header_of(rp)->magic, "DiskBasedHash11");
+        }
+        header_of(rp)->opts_.key_maxlen = opts.key_maxlen;
+        header_of(rp)->opts_.object_datalen = opts.object_datalen;
+        header_of(rp)->cursize_ = initial_size;
+        header_of(rp)->slots_used_ = initial_store_entries(rp->format_, initial_size);
+        header_of(rp)->dirty_slots_ = initial_store_entries(rp->format_, initial_size);
+        header_of(rp)->capacity_ = capacity_for_slots(load, initial_size);
+    } else if (!strcmp(header_of(rp)->magic, "DiskBasedHash12")) {
+        rp->flags_ |= HT_FLAG_EXT_HEADER;
+        if (header_of(rp)->format_ & ~(uint64_t)FORMAT_FLAGS_MASK) {
+            if (err) { *err = strdup("Unsupported table format (table was created by a newer version)."); }
+            dht_free(rp);
+            return 0;
+        }
+        rp->format_ = (unsigned int)header_of(rp)->format_;
+        if (rp->format_ & DHT_OPT_HUGE_PAGES) {
+            /* the format was not known when the file was first mapped */
+            dht_memory_unmap_file(rp->data_, rp->datasize_);
+            if (!map_table_file(rp, rp->datasize_, prot)) {
+                if (err) { *err = strdup("mmap() call failed."); }
+                dht_close_file(rp->fd_);
+                free((char*)rp->fname_);
+                free(rp);
+                return NULL;
+            }
+        }
+        if (opts_mismatch(rp, opts)) {
+            if (err) { *err = strdup("Options mismatch (diskhash table on disk was not created with the same options used to open it)."); }
+            dht_free(rp);
+            return 0;
+        }
+    } else if (strcmp(header_of(rp)->magic, "DiskBasedHash11")) {
+        if (!strcmp(header_of(rp)->magic, "DiskBasedHash10")) {
+            rp->flags_ &= ~HT_FLAG_HASH_2;
+        } else {
+            char start[16];
+            strncpy(start, header_of(rp)->magic, 14);
+            start[13] = '\0';
+            if (!strcmp(start, "DiskBasedHash")) {
+                if (err) { *err = strdup("Version mismatch. This code can only load version 1.0, 1.1 or 1.2."); }
+            } else {
+                if (err) { *err = strdup("No magic number found."); }
+            }
+            dht_free(rp);
+            return 0;
+        }
+    } else if (opts_mismatch(rp, opts)) {
+        if (err) { *err = strdup("Options mismatch (diskhash table on disk was not created with the same options used to open it)."); }
+        dht_free(rp);
+        return 0;
+    }
+    update_layout(rp);
+    return rp;
+}
+
+/* An incremental growth (see dht_set_growth_step).
+ *
+ * The table being grown is left as it was: store entries up to cursor_ have
+ * been copied to next_ and deletions of the others are only recorded in the
+ * deleted_ bitmap (indexed by store entry), so that entries never move under
+ * the cursor. */
+typedef struct HashTableGrowth {
+    HashTable* next_;
+    uint64_t cursor_;
+    size_t remaining_;
+    uint8_t* deleted_;
+} HashTableGrowth;
+
+static
+int finish_growth(HashTable* ht, char** err);
+
+static
+void abandon_growth(HashTable* ht);
+
+/* Lookup counts (see dht_sample_accesses): a count-min sketch of
+ * SKETCH_ROWS rows of 2^(64 - shift_) counters. Each row maps the hash of a
+ * key to a counter with its own multiplier. */
+typedef struct HashTableSketch {
+    uint32_t rate_;
+    uint32_t countdown_; /* lookups until the next one that is counted */
+    unsigned int shift_;
+    uint32_t* counters_;
+} HashTableSketch;
+
+static const uint64_t SKETCH_MULTIPLIERS[SKETCH_ROWS] = {
+    UINT64_C(0x9E3779B97F4A7C15),
+    UINT64_C(0xC2B2AE3D27D4EB4F),
+    UINT64_C(0x165667B19E3779F9),
+    UINT64_C(0xFF51AFD7ED558CCD),
+};
+
+inline static
+uint32_t* sketch_counter(const HashTableSketch* sketch, int row, uint64_t hash) {
+    const size_t row_size = (size_t)1 << (64 - sketch->shift_);
+    return sketch->counters_ + row * row_size + ((hash * SKETCH_MULTIPLIERS[row]) >> sketch->shift_);
+}
+
+static
+void sample_access(HashTableSketch* sketch, uint64_t hash) {
+    int row;
+    if (--sketch->countdown_) return;
+    sketch->countdown_ = sketch->rate_;
+    for (row = 0; row < SKETCH_ROWS; ++row) {
+        uint32_t* counter = sketch_counter(sketch, row, hash);
+        if (*counter != UINT32_MAX) ++*counter;
+    }
+}
+
+/* Estimated number of counted lookups of the key with the given hash */
+static
+uint32_t access_estimate(const HashTableSketch* sketch, uint64_t hash) {
+    uint32_t estimate = UINT32_MAX;
+    int row;
+    for (row = 0; row < SKETCH_ROWS; ++row) {
+        const uint32_t count = *sketch_counter(sketch, row, hash);
+        if (count < estimate) estimate = count;
+    }
+    return estimate;
+}
+
+int dht_load_to_memory(HashTable* ht, char** err) {
+    if (ht->flags_ & HT_FLAG_CAN_WRITE) {
+        if (err) *err = "Cannot call dht_load_to_memory on a read/write Diskhash";
+        return 1;
+    }
+    if (ht->flags_ & HT_FLAG_IS_LOADED) {
+        if (err) *err = "dht_load_to_memory had already been called.";
+        return 1;
+    }
+    dht_memory_unmap_file(ht->data_, ht->datasize_);
+    if (ht->format_ & DHT_OPT_HUGE_PAGES) {
+        ht->data_ = dht_huge_alloc(ht->datasize_);
+        ht->flags_ |= HT_FLAG_HUGE_ALLOC;
+    } else {
+        ht->data_ = malloc(ht->datasize_);
+    }
+    if (ht->data_) {
+        size_t n = (size_t) dht_read_file(ht->fd_, ht->data_, ht->datasize_);
+        if (n == ht->datasize_) {
+            ht->flags_ |= HT_FLAG_IS_LOADED;
+            return 0;
+        }
+        else if (err) *err = "dht_load_to_memory: could not read data from file";
+    } else {
+        if (err) *err = "dht_load_to_memory: could not allocate memory.";
+    }
+    if (ht->flags_ & HT_FLAG_HUGE_ALLOC) {
+        dht_huge_free(ht->data_, ht->datasize_);
+    } else {
+        free(ht->data_);
+    }
+    dht_file_sync(ht->fd_);
+    dht_close_file(ht->fd_);
+    free((char*)ht->fname_);
+    free(ht);
+    return 2;
+}
+
+void dht_free(HashTable* ht) {
+    bool success;
+    if (ht->growth_ && finish_growth(ht, NULL) != 1) {
+        abandon_growth(ht);
+    }
+    if (ht->sketch_) {
+        free(ht->sketch_->counters_);
+        free(ht->sketch_);
+    }
+    if (ht->flags_ & HT_FLAG_HUGE_ALLOC) {
+        dht_huge_free(ht->data_, ht->datasize_);
+    } else if (ht->flags_ & HT_FLAG_IS_LOADED) {
+        free(ht->data_);
+    } else {
+        success = dht_memory_unmap_file(ht->data_, ht->datasize_);
+        assert(success);
+    }
+    success = dht_file_sync(ht->fd_);
+    success = dht_close_file(ht->fd_);
+    assert(success);
+    free((char*)ht->fname_);
+    free(ht);
+}
+
+char random_char(void) {
+    const char* available =
+        "0123456789"
+        "abcdefghijklmnopqrstuvwxyz"
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+    return available[rand() % (26*2 + 10)];
+}
+
+char* generate_tempname_from(const char* base) {
+    char* res = (char*)malloc(strlen(base) + 21);
+    if (!res) return NULL;
+    strcpy(res, base);
+    char* p = res;
+    while (*p) ++p;
+    *p++ = '.';
+    int i;
+    for (i = 0; i < 19; ++i) {
+        *p++ = random_char();
+    }
+    *p = 0;
+    return res;
+}
+
+/* Creates an empty table in a temporary file next to ht, with room for (at
+ * least) cap entries, arena_size bytes of key arena and the same format. On
+ * success, *cap is set to the actual capacity. */
+static
+HashTable* create_resized_table(HashTable* ht, size_t* cap, size_t arena_size, char** err) {
+    const uint64_t n = slots_for_capacity(ht->format_, max_load(ht), *cap);
+    const size_t new_cap = capacity_for_slots(max_load(ht), n);
+    if (!(ht->flags_ & HT_FLAG_EXT_HEADER)) arena_size = 0;
+    HashTableLayout layout;
+    const size_t total_size = compute_layout(ht->flags_ & HT_FLAG_EXT_HEADER,
+                                             ht->format_,
+                                             cheader_of(ht)->opts_,
+                                             n,
+                                             new_cap,
+                                             arena_size,
+                                             &layout);
+
+    HashTable* temp_ht = (HashTable*)malloc(sizeof(HashTable));
+    if (!temp_ht) {
+        if (err) { *err = strdup("dht_reserve: could not allocate memory."); }
+        return NULL;
+    }
+    temp_ht->growth_step_ = 0;
+    temp_ht->growth_ = NULL;
+    temp_ht->rebuild_threads_ = ht->rebuild_threads_;
+    temp_ht->sketch_ = NULL;
+    while (1) {
+        temp_ht->fname_ = generate_tempname_from(ht->fname_);
+        if (!temp_ht->fname_) {
+            if (err) { *err = strdup("dht_reserve: could not allocate memory."); }
+            free(temp_ht);
+            return NULL;
+        }
+        temp_ht->fd_ = dht_open_file(temp_ht->fname_, O_EXCL | O_CREAT | O_RDWR, true);
+        if (temp_ht->fd_) break;
+        free((char*)temp_ht->fname_);
+    }
+    if (!dht_truncate_file(temp_ht->fd_, total_size)) {
+        if (err) {
+            *err = malloc(256);
+            if (*err) {
+                snprintf(*err, 256, "Could not allocate disk space. Error: %s.", strerror(errno));
+            }
+        }
+        free((char*)temp_ht->fname_);
+        free(temp_ht);
+        return NULL;
+    }
+    temp_ht->datasize_ = total_size;
+    temp_ht->flags_ = ht->flags_;
+    temp_ht->format_ = ht->format_;
+    temp_ht->layout_ = layout;
+    bool map_success = map_table_file(temp_ht, temp_ht->datasize_, PROT_READ | PROT_WRITE);
+    if (!map_success) {
+        if (err) {
+            const int errorbufsize = 512;
+            *err = (char*)malloc(errorbufsize);
+            if (*err) {
+                snprintf(*err, errorbufsize, "Could not dht_memory_map_file() new hashtable: %s.\n", strerror(errno));
+            }
+        }
+        dht_close_file(temp_ht->fd_);
+        dht_delete_file(temp_ht->fname_);
+        free((char*)temp_ht->fname_);
+        free(temp_ht);
+        return NULL;
+    }
+    memcpy(header_of(temp_ht), header_of(ht), header_size(ht));
+    header_of(temp_ht)->cursize_ = n;
+    header_of(temp_ht)->slots_used_ = initial_store_entries(temp_ht->format_, n);
+    header_of(temp_ht)->dirty_slots_ = initial_store_entries(temp_ht->format_, n);
+    header_of(temp_ht)->capacity_ = new_cap;
+    if (temp_ht->flags_ & HT_FLAG_EXT_HEADER) {
+        header_of(temp_ht)->arena_size_ = arena_size;
+        header_of(temp_ht)->arena_used_ = 0;
+    }
+
+    if (!strcmp(header_of(temp_ht)->magic, "DiskBasedHash10")) {
+        strcpy(header_of(temp_ht)->magic, "DiskBasedHash11");
+        temp_ht->flags_ |= HT_FLAG_HASH_2;
+    }
+    *cap = new_cap;
+    return temp_ht;
+}
+
+/* Replaces the file of ht by that of temp_ht (created by create_resized_table)
+ * and makes ht use the new table. temp_ht is freed. */
+static
+int replace_table(HashTable* ht, HashTable* temp_ht, char** err) {
+#ifdef _WIN32
+    /* open files cannot be renamed: the new table is closed and reopened */
+    char* temp_fname = strdup(temp_ht->fname_);
+    if (!temp_fname) {
+        if (err) { *err = NULL; }
+        dht_delete_file(temp_ht->fname_);
+        dht_free(temp_ht);
+        return -ENOMEM;
+    }
+
+    dht_free(temp_ht);
+    const HashTableOpts opts = opts_of(ht);
+
+    dht_memory_unmap_file(ht->data_, ht->datasize_);
+    dht_close_file(ht->fd_);
+
+    dht_delete_file(ht->fname_);
+    int renaming_ret = rename(temp_fname, ht->fname_);
+    assert(renaming_ret == 0);
+    free((char*)temp_fname);
+
+    temp_ht = dht_open(ht->fname_, opts, O_RDWR, err);
+    if (!temp_ht) {
+        /* err is set by dht_open */
+        return -EIO;
+    }
+    const size_t growth_step = ht->growth_step_;
+    const unsigned int rebuild_threads = ht->rebuild_threads_;
+    struct HashTableSketch* sketch = ht->sketch_;
+    free((char*)ht->fname_);
+    memcpy(ht, temp_ht, sizeof(HashTable));
+    ht->growth_step_ = growth_step;
+    ht->rebuild_threads_ = rebuild_threads;
+    ht->sketch_ = sketch;
+    free(temp_ht);
+    return 1;
+#else
+    /* open files can be renamed, so the new table is used as it is mapped
+     * (without syncing and mapping it again). The old file is deleted first
+     * as replacing it with rename() makes some file systems (e.g., ext4)
+     * write out the new one right away. */
+    dht_delete_file(ht->fname_);
+    if (rename(temp_ht->fname_, ht->fname_) != 0) {
+        /* the new table is kept, as it is the only copy of the data */
+        if (err) {
+            const int errorbufsize = 512;
+            *err = (char*)malloc(errorbufsize);
+            if (*err) {
+                snprintf(*err, errorbufsize, "Could not rename the new table file '%s'. Error: %s.", temp_ht->fname_, strerror(errno));
+            }
+        }
+        dht_free(temp_ht);
+        return -EIO;
+    }
+    dht_memory_unmap_file(ht->data_, ht->datasize_);
+    dht_close_file(ht->fd_);
+    ht->fd_ = temp_ht->fd_;
+    ht->data_ = temp_ht->data_;
+    ht->datasize_ = temp_ht->datasize_;
+    ht->flags_ = temp_ht->flags_;
+    ht->format_ = temp_ht->format_;
+    ht->layout_ = temp_ht->layout_;
+    free((char*)temp_ht->fname_);
+    free(temp_ht);
+    return 1;
+#endif
+}
+
+static
+void robin_hood_place(HashTable* ht, uint64_t h, uint64_t offset, uint64_t ix, SlotMeta meta);
+
+/* Adds store entry ix (which holds a key) to the index, which is being rebuilt */
+static
+void index_store_entry(HashTable* ht, uint64_t ix) {
+    const uint64_t cursize = cheader_of(ht)->cursize_;
+    HashTableEntry et = entry_by_index(ht, ix);
+    const uint64_t hash = entry_hash(et);
+    uint64_t h = home_slot(ht, hash);
+    uint64_t offset = 1;
+    if (is_robin_hood(ht)) {
+        robin_hood_place(ht, h, offset, ix, slot_meta_of_hash(hash));
+        return;
+    }
+    while (get_table_at(ht, h)) {
+        ++offset;
+        ++h;
+        if (h == cursize) h = 0;
+    }
+    set_table_at(ht, h, ix);
+    set_slot_meta(ht, h, slot_meta_of_hash(hash));
+    set_offset(et, offset);
+}
+
+#ifdef DHT_REBUILD_THREADS
+/* A parallel rebuild of the index (see dht_set_rebuild_threads).
+ *
+ * Worker t first hashes the t-th range of the store table, counting how many
+ * entries fall in each range of the hash table ("partition"), and then lists
+ * them by partition in order. Finally, worker p places the entries of
+ * partition p. An entry whose probe reaches the end of its partition is
+ * deferred: its index is written back over the part of the list that was
+ * already placed, and the probe is finished by a single thread once all
+ * workers are done. The probe can be picked up there because slots are only
+ * ever filled (or, with Robin Hood, given entries that are further from home),
+ * so the slots it already passed still do not take it. */
+typedef struct RebuildShared {
+    HashTable* ht;
+    unsigned int threads;
+    uint64_t part_size;
+    uint64_t* hashes;       /* of each store entry (ix - 1) */
+    uint64_t* order;        /* used store entries, grouped by partition */
+    uint64_t* counts;       /* threads x threads: entries of store range t in partition p */
+    uint64_t* part_begin;   /* threads + 1 */
+    uint64_t* deferred;     /* number of deferred entries of each partition */
+    pthread_t* ids;
+    bool* started;
+} RebuildShared;
+
+typedef struct RebuildWorker {
+    RebuildShared* shared;
+    unsigned int id;
+} RebuildWorker;
+
+static
+void store_range(const RebuildShared* shared, unsigned int t, uint64_t* begin, uint64_t* end) {
+    const uint64_t slots_used = cheader_of(shared->ht)->slots_used_;
+    const uint64_t chunk = (slots_used + shared->threads - 1) / shared->threads;
+    *begin = t * chunk < slots_used ? t * chunk : slots_used;
+    *end = *begin + chunk < slots_used ? *begin + chunk : slots_used;
+}
+
+static
+void* rebuild_hash_worker(void* arg) {
+    const RebuildWorker* worker = (const RebuildWorker*)arg;
+    RebuildShared* shared = worker->shared;
+    const HashTable* ht = shared->ht;
+    uint64_t* counts = shared->counts + worker->id * shared->threads;
+    uint64_t i, begin, end;
+    store_range(shared, worker->id, &begin, &end);
+    for (i = begin; i < end; ++i) {
+        const HashTableEntry et = entry_by_index(ht, i + 1);
+        if (entry_empty(et)) continue;
+        shared->hashes[i] = entry_hash(et);
+        ++counts[home_slot(ht, shared->hashes[i]) / shared->part_size];
+    }
+    return NULL;
+}
+
+static
+void* rebuild_scatter_worker(void* arg) {
+    const RebuildWorker* worker = (const RebuildWorker*)arg;
+    RebuildShared* shared = worker->shared;
+    const HashTable* ht = shared->ht;
+    uint64_t* next = shared->counts + worker->id * shared->threads;
+    uint64_t i, begin, end;
+    store_range(shared, worker->id, &begin, &end);
+    for (i = begin; i < end; ++i) {
+        if (entry_empty(entry_by_index(ht, i + 1))) continue;
+        shared->order[next[home_slot(ht, shared->hashes[i]) / shared->part_size]++] = i + 1;
+    }
+    return NULL;
+}
+
+static
+void* rebuild_place_worker(void* arg) {
+    const RebuildWorker* worker = (const RebuildWorker*)arg;
+    RebuildShared* shared = worker->shared;
+    HashTable* ht = shared->ht;
+    const uint64_t cursize = cheader_of(ht)->cursize_;
+    const uint64_t part_end = (worker->id + 1) * shared->part_size < cursize
+                                ? (worker->id + 1) * shared->part_size
+                                : cursize;
+    uint64_t* deferred_out = shared->order + shared->part_begin[worker->id];
+    uint64_t k;
+    for (k = shared->part_begin[worker->id]; k < shared->part_begin[worker->id + 1]; ++k) {
+        uint64_t ix = shared->order[k];
+        const uint64_t hash = shared->hashes[ix - 1];
+        uint64_t h = home_slot(ht, hash);
+        uint64_t offset = 1;
+        if (is_robin_hood(ht)) {
+            SlotMeta meta = slot_meta_of_hash(hash);
+            while (ix && h < part_end) {
+                const uint64_t resident = get_table_at(ht, h);
+                const uint64_t resident_offset = resident ? probe_offset(ht, h, entry_by_index(ht, resident)) : 0;
+                if (resident_offset < offset) {
+                    set_table_at(ht, h, ix);
+                    set_offset(entry_by_index(ht, ix), offset);
+                    const SlotMeta resident_meta = get_slot_meta(ht, h);
+                    set_slot_meta(ht, h, meta);
+                    meta = resident_meta;
+                    ix = resident;
+                    offset = resident_offset;
+                }
+                ++offset;
+                ++h;
+            }
+        } else {
+            while (h < part_end && get_table_at(ht, h)) {
+                ++offset;
+                ++h;
+            }
+            if (h < part_end) {
+                set_table_at(ht, h, ix);
+                set_slot_meta(ht, h, slot_meta_of_hash(hash));
+                set_offset(entry_by_index(ht, ix), offset);
+                ix = 0;
+            }
+        }
+        if (ix) *deferred_out++ = ix;
+    }
+    shared->deferred[worker->id] = deferred_out - (shared->order + shared->part_begin[worker->id]);
+    return NULL;
+}
+
+/* Runs fn for every worker, all but the first one in their own threads (or
+ * in this one, if a thread cannot be started) */
+static
+void run_rebuild_workers(void* (*fn)(void*), RebuildWorker* workers) {
+    RebuildShared* shared = workers[0].shared;
+    unsigned int t;
+    for (t = 1; t < shared->threads; ++t) {
+        shared->started[t] = pthread_create(&shared->ids[t], NULL, fn, &workers[t]) == 0;
+    }
+    fn(&workers[0]);
+    for (t = 1; t < shared->threads; ++t) {
+        if (shared->started[t]) {
+            pthread_join(shared->ids[t], NULL);
+        } else {
+            fn(&workers[t]);
+        }
+    }
+}
+
+/* Rebuilds the index of ht (which must be empty) with `threads` threads.
+ * Returns false, without doing anything, if memory could not be allocated. */
+static
+bool parallel_rebuild_index(HashTable* ht, unsigned int threads) {
+    const uint64_t cursize = cheader_of(ht)->cursize_;
+    RebuildShared shared;
+    shared.ht = ht;
+    shared.threads = threads;
+    shared.part_size = (cursize + threads - 1) / threads;
+    shared.hashes = (uint64_t*)malloc(cheader_of(ht)->slots_used_ * sizeof(uint64_t));
+    shared.order = (uint64_t*)malloc(dht_size(ht) * sizeof(uint64_t));
+    shared.counts = (uint64_t*)calloc((size_t)threads * threads, sizeof(uint64_t));
+    shared.part_begin = (uint64_t*)malloc((threads + 1) * sizeof(uint64_t));
+    shared.deferred = (uint64_t*)malloc(threads * sizeof(uint64_t));
+    shared.ids = (pthread_t*)malloc(threads * sizeof(pthread_t));
+    shared.started = (bool*)malloc(threads * sizeof(bool));
+    RebuildWorker* workers = (RebuildWorker*)malloc(threads * sizeof(RebuildWorker));
+    const bool allocated = shared.hashes && shared.order && shared.counts && shared.part_begin
+                            && shared.deferred && shared.ids && shared.started && workers;
+    if (allocated) {
+        unsigned int t, p;
+        for (t = 0; t < threads; ++t) {
+            workers[t].shared = &shared;
+            workers[t].id = t;
+        }
+        run_rebuild_workers(rebuild_hash_worker, workers);
+
+        /* counts become the positions where each store range lists its entries */
+        uint64_t position = 0;
+        for (p = 0; p < threads; ++p) {
+            shared.part_begin[p] = position;
+            for (t = 0; t < threads; ++t) {
+                const uint64_t count = shared.counts[t * threads + p];
+                shared.counts[t * threads + p] = position;
+                position += count;
+            }
+        }
+        shared.part_begin[threads] = position;
+        run_rebuild_workers(rebuild_scatter_worker, workers);
+        run_rebuild_workers(rebuild_place_worker, workers);
+
+        for (p = 0; p < threads; ++p) {
+            const uint64_t part_end = (p + 1) * shared.part_size < cursize ? (p + 1) * shared.part_size : cursize;
+            uint64_t k;
+            for (k = 0; k < shared.deferred[p]; ++k) {
+                const uint64_t ix = shared.order[shared.part_begin[p] + k];
+                const uint64_t hash = shared.hashes[ix - 1];
+                const uint64_t offset = part_end - home_slot(ht, hash) + 1;
+                uint64_t h = part_end == cursize ? 0 : part_end;
+                if (is_robin_hood(ht)) {
+                    robin_hood_place(ht, h, offset, ix, slot_meta_of_hash(hash));
+                    continue;
+                }
+                uint64_t extra = 0;
+                while (get_table_at(ht, h)) {
+                    ++extra;
+                    ++h;
+                    if (h == cursize) h = 0;
+                }
+                set_table_at(ht, h, ix);
+                set_slot_meta(ht, h, slot_meta_of_hash(hash));
+                set_offset(entry_by_index(ht, ix), offset + extra);
+            }
+        }
+    }
+    free(shared.hashes);
+    free(shared.order);
+    free(shared.counts);
+    free(shared.part_begin);
+    free(shared.deferred);
+    free(shared.ids);
+    free(shared.started);
+    free(workers);
+    return allocated;
+}
+#endif
+
+/* Rebuilds the index of ht (which must be empty) from its store table */
+static
+void rebuild_index(HashTable* ht) {
+    const uint64_t slots_used = cheader_of(ht)->slots_used_;
+#ifdef DHT_REBUILD_THREADS
+    unsigned int threads = ht->rebuild_threads_;
+    if (!threads) {
+        const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (unsigned int)cpus : 1;
+    }
+    if (threads > MAX_REBUILD_THREADS) threads = MAX_REBUILD_THREADS;
+    if (threads > 1 && dht_size(ht) >= PARALLEL_REBUILD_MIN_ENTRIES && parallel_rebuild_index(ht, threads)) {
+        return;
+    }
+#endif
+    uint64_t ix;
+    for (ix = 1; ix <= slots_used; ++ix) {
+        if (!entry_empty(entry_by_index(ht, ix))) index_store_entry(ht, ix);
+    }
+}
+
+/* Whether ht can grow to n slots (and capacity cap) with grow_in_place: the
+ * store entries must keep their size and cuckoo tables are rebuilt from scratch
+ * (placing a key can fail and need an even larger table). Version 1.0 tables are
+ * rebuilt so that they use the current hash function. Entries of
+ * DHT_OPT_INLINE tables cannot keep their store indices, as those are their
+ * slots. */
+static
+bool can_grow_in_place(const HashTable* ht, uint64_t n, size_t cap) {
+    return !is_cuckoo(ht)
+        && !is_inline(ht)
+        && (ht->flags_ & HT_FLAG_HASH_2)
+        && is_64bit(n) == is_64bit(cheader_of(ht)->cursize_)
+        && is_64bit(cap) == is_64bit(cheader_of(ht)->capacity_);
+}
+
+/* Zeroes data[start, end), which only needs to be done below old_end (the
+ * file was extended with zeros past it) */
+inline static
+void clear_stale_bytes(char* data, size_t start, size_t end, size_t old_end) {
+    if (end > old_end) end = old_end;
+    if (start < end) memset(data + start, 0, end - start);
+}
+
+/* Grows ht to n slots (and capacity cap) within its own file.
+ *
+ * The file is extended and the used part of every region after the index is
+ * moved to its new offset; store entries keep their indices, so only the
+ * index has to be rebuilt. */
+static
+int grow_in_place(HashTable* ht, uint64_t n, size_t cap, char** err) {
+    const HashTableLayout old_layout = ht->layout_;
+    const size_t old_capacity = cheader_of(ht)->capacity_;
+    const uint64_t slots_used = cheader_of(ht)->slots_used_;
+    const bool extended = ht->flags_ & HT_FLAG_EXT_HEADER;
+    const size_t arena_size = extended ? cheader_of(ht)->arena_size_ : 0;
+    const size_t arena_used = extended ? cheader_of(ht)->arena_used_ : 0;
+    HashTableLayout layout;
+    const size_t total_size = compute_layout(extended,
+                                             ht->format_,
+                                             cheader_of(ht)->opts_,
+                                             n,
+                                             cap,
+                                             arena_size,
+                                             &layout);
+    int r = resize_table_file(ht, total_size, err);
+    if (r != 1) return r;
+
+    /* Every region starts at least as far into the file as before, so moving
+     * them from the last one back never overwrites one that was not moved. */
+    char* data = (char*)ht->data_;
+    memmove(data + layout.arena_, data + old_layout.arena_, arena_used);
+    const size_t dirty_used = cheader_of(ht)->dirty_slots_ * sizeof_table_element(old_capacity);
+    const size_t key_field = aligned_size(sizeof_key_field(ht->format_, cheader_of(ht)->opts_), old_capacity);
+    const size_t value_field = aligned_size(cheader_of(ht)->opts_.object_datalen, old_capacity);
+    const size_t meta_field = sizeof_st_meta(ht->format_, old_capacity);
+    memmove(data + layout.dirty_, data + old_layout.dirty_, dirty_used);
+    if (ht->format_ & DHT_OPT_COLUMNAR) {
+        memmove(data + layout.meta_, data + old_layout.meta_, slots_used * meta_field);
+        memmove(data + layout.values_, data + old_layout.values_, slots_used * value_field);
+        memmove(data + layout.store_, data + old_layout.store_, slots_used * key_field);
+    } else {
+        memmove(data + layout.store_, data + old_layout.store_,
+                slots_used * sizeof_st_element(ht->format_, cheader_of(ht)->opts_, old_capacity));
+    }
+
+    /* what is left of the old regions past the moved ones is cleared, so that
+     * unused entries read as zeros, as in a new file */
+    const size_t old_end = old_layout.total_;
+    if (ht->format_ & DHT_OPT_COLUMNAR) {
+        clear_stale_bytes(data, layout.store_ + slots_used * key_field, layout.values_, old_end);
+        clear_stale_bytes(data, layout.values_ + slots_used * value_field, layout.meta_, old_end);
+        clear_stale_bytes(data, layout.meta_ + slots_used * meta_field, layout.dirty_, old_end);
+    } else {
+        clear_stale_bytes(data, layout.store_ + slots_used * sizeof_st_element(ht->format_, cheader_of(ht)->opts_, old_capacity),
+                          layout.dirty_, old_end);
+    }
+    clear_stale_bytes(data, layout.dirty_ + dirty_used, layout.arena_, old_end);
+    clear_stale_bytes(data, layout.arena_ + arena_used, total_size, old_end);
+
+    header_of(ht)->cursize_ = n;
+    header_of(ht)->capacity_ = cap;
+    ht->layout_ = layout;
+    const size_t index_start = has_tags(ht) ? layout.tags_ : layout.index_;
+    memset(data + index_start, 0, layout.store_ - index_start);
+    rebuild_index(ht);
+    return 1;
+}
+
+static
+int copy_entry(HashTable* ht, const HashTableEntry et, char** err);
+
+size_t dht_reserve(HashTable* ht, size_t cap, char** err) {
+    if ((check_ht(ht, err)) != 1 ||
+        (check_ht_writable(ht, err)) != 1) {
+        return 0;
+    }
+    if (ht->growth_ && finish_growth(ht, err) != 1) {
+        return 0;
+    }
+    if (cap <= cheader_of(ht)->capacity_) {
+        return cheader_of(ht)->capacity_;
+    }
+    const uint64_t n = slots_for_capacity(ht->format_, max_load(ht), cap);
+    if (can_grow_in_place(ht, n, capacity_for_slots(max_load(ht), n))) {
+        cap = capacity_for_slots(max_load(ht), n);
+        if (grow_in_place(ht, n, cap, err) != 1) return 0;
+        return cap;
+    }
+    const uint64_t starting_slots = dht_size(ht);
+    /* only the keys that were not deleted are copied to the new arena */
+    HashTable* temp_ht = create_resized_table(ht, &cap, arena_bytes_used(ht), err);
+    if (!temp_ht) return 0;
+
+    uint64_t i;
+    HashTableEntry et;
+    int checks_return = 1;
+    for (i = 0; i < header_of(ht)->slots_used_ && checks_return == 1; ++i) {
+        et = entry_by_index(ht, i + 1);
+        if (!entry_empty(et)) {
+            checks_return = copy_entry(temp_ht, et, err);
+        }
+    }
+    /* the table is left as it was rather than replaced by a partial copy */
+    if (checks_return != 1) {
+        dht_delete_file(temp_ht->fname_);
+        dht_free(temp_ht);
+        return 0;
+    }
+
+    if (replace_table(ht, temp_ht, err) != 1) return 0;
+
+    assert(starting_slots == dht_size(ht));
+    assert(is_inline(ht) || dht_size(ht) == cheader_of(ht)->slots_used_);
+    return cap;
+}
+
+size_t dht_size(const HashTable* ht) {
+    if (ht->growth_) return dht_size(ht->growth_->next_) + ht->growth_->remaining_;
+    return cheader_of(ht)->slots_used_ - cheader_of(ht)->dirty_slots_;
+}
+
+size_t dht_capacity(const HashTable* ht) {
+    if (ht->growth_) return dht_capacity(ht->growth_->next_);
+    return cheader_of(ht)->capacity_;
+}
+
+/* Where a single DHT_REGION_* lives in the file */
+static
+void region_bounds(const HashTable* ht, int region, size_t* start, size_t* end) {
+    const HashTableLayout* layout = &ht->layout_;
+    switch (region) {
+        case DHT_REGION_INDEX:
+            *start = has_tags(ht) ? layout->tags_ : layout->index_;
+            *end = layout->store_;
+            break;
+        case DHT_REGION_STORE:
+            *start = layout->store_;
+            *end = layout->dirty_;
+            break;
+        case DHT_REGION_DIRTY:
+            *start = layout->dirty_;
+            *end = layout->arena_;
+            break;
+        default: /* DHT_REGION_ARENA */
+            *start = layout->arena_;
+            *end = layout->total_;
+            break;
+    }
+}
+
+int dht_advise(HashTable* ht, int regions, int advice, char** err) {
+    int checks_return;
+    int region;
+    if ((checks_return = check_ht(ht, err)) != 1) {
+        return checks_return;
+    }
+    if (regions & ~DHT_REGION_ALL) {
+        if (err) { *err = strdup("Unknown table region."); }
+        return -EINVAL;
+    }
+    if (advice < DHT_ADVICE_NORMAL || advice > DHT_ADVICE_PAGEOUT) {
+        if (err) { *err = strdup("Unknown access pattern advice."); }
+        return -EINVAL;
+    }
+    if (ht->growth_ && (checks_return = finish_growth(ht, err)) != 1) {
+        return checks_return;
+    }
+    for (region = 1; region <= DHT_REGION_ARENA; region <<= 1) {
+        size_t start, end;
+        if (!(regions & region)) continue;
+        region_bounds(ht, region, &start, &end);
+        if (start >= end) continue;
+        if (!dht_memory_advise((char*)ht->data_ + start, end - start, advice)
+            || (!(ht->flags_ & HT_FLAG_IS_LOADED) && !dht_file_advise(ht->fd_, start, end - start, advice))) {
+            const int error = errno;
             if (err) {
                 *err = malloc(256);
                 if (*err) {
-                    snprintf(*err, 256, "Could not allocate disk space. Error: %s.", strerror(errno));
+                    snprintf(*err, 256, "Could not apply the advice. Error: %s.", strerror(error));
                 }
             }
-            dht_close_file(rp->fd_);
-            free((char*)rp->fname_);
-            free(rp);
-            return NULL;
+            return -error;
         }
     }
-    rp->flags_ = HT_FLAG_HASH_2;
-    const int prot = (flags == O_RDONLY) ?
-                                PROT_READ
-                                : PROT_READ|PROT_WRITE;
-    if (prot & PROT_WRITE) rp->flags_ |= HT_FLAG_CAN_WRITE;
-    bool map_success = dht_memory_map_file(rp->fd_, &rp->data_, rp->datasize_, prot);
-    if (!map_success) {
-        if (err) { *err = strdup("mmap() call failed."); }
-        dht_close_file(rp->fd_);
-        free((char*)rp->fname_);
-        free(rp);
-        return NULL;
+    return 1;
+}
+
+size_t dht_huge_page_bytes(const HashTable* ht) {
+    return dht_memory_huge_page_bytes(ht->data_, ht->datasize_);
+}
+
+size_t dht_dirty_slots(const HashTable *ht) {
+    if (ht->growth_) return dht_dirty_slots(ht->growth_->next_);
+    return cheader_of(ht)->dirty_slots_;
+}
+
+size_t dht_slots_used(const HashTable *ht) {
+    if (ht->growth_) return dht_slots_used(ht->growth_->next_);
+    return cheader_of(ht)->slots_used_;
+}
+
+int dht_indexed_lookup (HashTable* ht, size_t index, char** key, void* data, char** err) {
+    int checks_return;
+    if (ht->growth_ && (checks_return = finish_growth(ht, err)) != 1) {
+        return checks_return;
     }
-    if (needs_init) {
-        strcpy(header_of(rp)->magic, "DiskBasedHash11");
-        header_of(rp)->opts_ = opts;
-        header_of(rp)->cursize_ = INITIAL_HT_SIZE;
-        header_of(rp)->slots_used_ = 0;
-        header_of(rp)->dirty_slots_ = 0;
-        header_of(rp)->capacity_ = INITIAL_CAPACITY;
-    } else if (strcmp(header_of(rp)->magic, "DiskBasedHash11")) {
-        if (!strcmp(header_of(rp)->magic, "DiskBasedHash10")) {
-            rp->flags_ &= ~HT_FLAG_HASH_2;
+    if (index >= cheader_of(ht)->slots_used_) {
+        if (err) { *err = strdup("The index is out-of-range."); }
+        return -EINVAL;
+    }
+    HashTableEntry et;
+    et = entry_by_index(ht, (index + 1));
+    if (!entry_empty(et)) {
+        if (ht->format_ & DHT_OPT_FIXED_KEYS) {
+            memcpy(*key, et.ht_key, cheader_of(ht)->opts_.key_maxlen);
+        } else if (et.key_length_) {
+            const size_t len = get_key_length(et);
+            memcpy(*key, entry_key(et), len);
+            (*key)[len] = '\0';
         } else {
-            char start[16];
-            strncpy(start, header_of(rp)->magic, 14);
-            start[13] = '\0';
-            if (!strcmp(start, "DiskBasedHash")) {
-                if (err) { *err = strdup("Version mismatch. This code can only load version 1.0 or 1.1."); }
-            } else {
-                if (err) { *err = strdup("No magic number found."); }
-            }
-            dht_free(rp);
-            return 0;
+            strncpy(*key, et.ht_key, cheader_of(ht)->opts_.key_maxlen);
         }
-    } else if ((header_of(rp)->opts_.key_maxlen != opts.key_maxlen && opts.key_maxlen != 0)
-                || (header_of(rp)->opts_.object_datalen != opts.object_datalen && opts.object_datalen != 0)) {
-        if (err) { *err = strdup("Options mismatch (diskhash table on disk was not created with the same options used to open it)."); }
-        dht_free(rp);
-        return 0;
+        memcpy(data, et.ht_data, cheader_of(ht)->opts_.object_datalen);
+        return 1;
     }
-    return rp;
+    if (err) { *err = strdup("The informed index doesn't contain any data."); }
+    return -EFAULT;
 }
 
-int dht_load_to_memory(HashTable* ht, char** err) {
-    if (ht->flags_ & HT_FLAG_CAN_WRITE) {
-        if (err) *err = "Cannot call dht_load_to_memory on a read/write Diskhash";
-        return 1;
-    }
-    if (ht->flags_ & HT_FLAG_IS_LOADED) {
-        if (err) *err = "dht_load_to_memory had already been called.";
-        return 1;
+/* Finds `key` in a DHT_OPT_INLINE table: each probe reads a single entry,
+ * which tells both whether the slot is used and which key it holds.
+ *
+ * Returns the slot holding the key or cursize_ if it is not present. */
+static
+uint64_t inline_find(const HashTable* ht, const char* key, size_t len, uint64_t hash) {
+    const uint64_t cursize = cheader_of(ht)->cursize_;
+    uint64_t h = home_slot(ht, hash);
+    while (1) {
+        const HashTableEntry et = entry_by_index(ht, h + 1);
+        if (!get_offset(et)) return cursize;
+        if (entry_holds(et, key, len, hash)) return h;
+        ++h;
+        if (h == cursize) h = 0;
     }
-    dht_memory_unmap_file(ht->data_, ht->datasize_);
-    ht->data_ = malloc(ht->datasize_);
-    if (ht->data_) {
-        size_t n = (size_t) dht_read_file(ht->fd_, ht->data_, ht->datasize_);
-        if (n == ht->datasize_) {
-            ht->flags_ |= HT_FLAG_IS_LOADED;
-            return 0;
+}
+
+/* Finds `key` by scanning the control bytes.
+ *
+ * Returns the slot holding the key or cursize_ if it is not present, in which
+ * case *free_slot (if not NULL) is set to the first empty slot of its probe
+ * sequence.
+ */
+static
+uint64_t tags_find(const HashTable* ht, const char* key, size_t len, uint64_t hash, uint64_t* free_slot) {
+    const uint64_t cursize = cheader_of(ht)->cursize_;
+    const uint8_t* tags = tags_of(ht);
+    const uint8_t tag = tag_of_hash(hash);
+    uint64_t pos = home_slot(ht, hash);
+    while (1) {
+        uint32_t empty;
+        uint32_t match = tag_group_match(tags + pos, tag, &empty);
+        if (empty) {
+            /* slots after the first empty one are not part of the probe sequence */
+            match &= (empty & (~empty + 1)) - 1;
         }
-        else if (err) *err = "dht_load_to_memory: could not read data from file";
-    } else {
-        if (err) *err = "dht_load_to_memory: could not allocate memory.";
+        while (match) {
+            uint64_t slot = pos + lowest_bit(match);
+            if (slot >= cursize) slot -= cursize;
+            if (slot_holds(ht, slot, key, len, hash)) return slot;
+            match &= match - 1;
+        }
+        if (empty) {
+            if (free_slot) {
+                uint64_t slot = pos + lowest_bit(empty);
+                if (slot >= cursize) slot -= cursize;
+                *free_slot = slot;
+            }
+            return cursize;
+        }
+        pos = (pos + TAG_GROUP_WIDTH) % cursize;
     }
-    free(ht->data_);
-    dht_file_sync(ht->fd_);
-    dht_close_file(ht->fd_);
-    free((char*)ht->fname_);
-    free(ht);
-    return 2;
 }
 
-void dht_free(HashTable* ht) {
-    bool success;
-    if (ht->flags_ & HT_FLAG_IS_LOADED) {
-        free(ht->data_);
-    } else {
-        success = dht_memory_unmap_file(ht->data_, ht->datasize_);
-        assert(success);
+/* Finds `key` in a Robin Hood table.
+ *
+ * The search stops as soon as it reaches an entry that is closer to its home
+ * slot than `key` would be (Robin Hood insertion would have placed `key`
+ * before it). Keys are only compared against entries with the same probe
+ * distance, as only those share the home slot of `key`.
+ *
+ * Reading the probe distances means touching the store table at every step,
+ * so tables with fingerprints only use this to find where to insert; lookups
+ * scan the fingerprints until an empty slot instead.
+ *
+ * Returns the slot holding the key or cursize_ if it is not present, in which
+ * case *insert_pos and *insert_offset (if not NULL) are set to where it belongs.
+ */
+static
+uint64_t robin_hood_find(const HashTable* ht, const char* key, size_t len, uint64_t hash,
+                         uint64_t* insert_pos, uint64_t* insert_offset) {
+    const uint64_t cursize = cheader_of(ht)->cursize_;
+    const uint32_t fingerprint = fingerprint_of_hash(hash);
+    uint64_t h = home_slot(ht, hash);
+    uint64_t offset = 1;
+    while (1) {
+        const uint64_t ix = get_table_at(ht, h);
+        if (!ix) break;
+        HashTableEntry et = entry_by_index(ht, ix);
+        const uint64_t resident_offset = probe_offset(ht, h, et);
+        if (resident_offset < offset) break;
+        if (resident_offset == offset
+                && (!has_fingerprints(ht) || get_fingerprint_at(ht, h) == fingerprint)
+                && entry_holds(et, key, len, hash)) return h;
+        ++offset;
+        ++h;
+        if (h == cursize) h = 0;
     }
-    success = dht_file_sync(ht->fd_);
-    success = dht_close_file(ht->fd_);
-    assert(success);
-    free((char*)ht->fname_);
-    free(ht);
+    if (insert_pos) *insert_pos = h;
+    if (insert_offset) *insert_offset = offset;
+    return cursize;
 }
 
-char random_char(void) {
-    const char* available =
-        "0123456789"
-        "abcdefghijklmnopqrstuvwxyz"
-        "ABCDEFGHIJKLMNOPQRSTUVWXYZ";
-    return available[rand() % (26*2 + 10)];
+/* Places the store entry `ix` at slot h (probe distance `offset`), displacing
+ * entries that are closer to their home slot further along. */
+static
+void robin_hood_place(HashTable* ht, uint64_t h, uint64_t offset, uint64_t ix, SlotMeta meta) {
+    const uint64_t cursize = cheader_of(ht)->cursize_;
+    while (ix) {
+        const uint64_t resident = get_table_at(ht, h);
+        const uint64_t resident_offset = resident ? probe_offset(ht, h, entry_by_index(ht, resident)) : 0;
+        if (resident_offset < offset) {
+            set_table_at(ht, h, ix);
+            set_offset(entry_by_index(ht, ix), offset);
+            const SlotMeta resident_meta = get_slot_meta(ht, h);
+            set_slot_meta(ht, h, meta);
+            meta = resident_meta;
+            ix = resident;
+            offset = resident_offset;
+        }
+        ++offset;
+        ++h;
+        if (h == cursize) h = 0;
+    }
 }
 
-char* generate_tempname_from(const char* base) {
-    char* res = (char*)malloc(strlen(base) + 21);
-    if (!res) return NULL;
-    strcpy(res, base);
-    char* p = res;
-    while (*p) ++p;
-    *p++ = '.';
-    int i;
-    for (i = 0; i < 19; ++i) {
-        *p++ = random_char();
-    }
-    *p = 0;
-    return res;
+/* The two buckets where a key with this hash can be. The second one is
+ * taken from a remixed hash, so that keys that share their first bucket are
+ * spread over different second ones. */
+static
+void cuckoo_buckets_of(const HashTable* ht, uint64_t hash, uint64_t* first, uint64_t* second) {
+    const uint64_t nr_buckets = cheader_of(ht)->cursize_ / CUCKOO_BUCKET_SLOTS;
+    uint64_t alt = (hash ^ (hash >> 31)) * UINT64_C(0xBF58476D1CE4E5B9);
+    alt ^= alt >> 32;
+    *first = hash_range(ht, hash, nr_buckets);
+    *second = hash_range(ht, alt, nr_buckets);
+    if (*second == *first) *second = (*first + 1 == nr_buckets) ? 0 : *first + 1;
 }
 
-size_t dht_reserve(HashTable* ht, size_t cap, char** err) {
-    if ((check_ht(ht, err)) != 1 ||
-        (check_ht_writable(ht, err)) != 1) {
-        return 0;
-    }
-    if (cap <= cheader_of(ht)->capacity_) {
-        return cheader_of(ht)->capacity_;
+/* Element i of the hash table (counting fingerprints as elements), which has
+ * elements of `width` bytes (see index_width) */
+inline static
+uint64_t index_element(const void* table, size_t width, uint64_t i) {
+    switch (width) {
+        case sizeof(uint32_t): return ((const uint32_t*)table)[i];
+        case sizeof(uint64_t): return ((const uint64_t*)table)[i];
+        default: return read_packed((const unsigned char*)table + i * width, width);
     }
-    const uint64_t starting_slots = dht_size(ht);
-    const uint64_t min_slots = cap * 2 + 1;
-    uint64_t i = 0;
-    while (primes[i] && primes[i] < min_slots) ++i;
-    const uint64_t n = primes[i];
-    cap = n / 2;
-    const size_t sizeof_ht_element = sizeof_table_element(n);        // hash table:  size == n (prime number)
-    const size_t sizeof_ds_element = sizeof_table_element(cap);      // dirty stack: size == store capacity
-    const size_t total_size = sizeof(HashTableHeader)
-            + n * sizeof_ht_element                                                      // hash table elements
-            + cap * sizeof_st_element(cheader_of(ht)->opts_, cheader_of(ht)->capacity_)  // store table elements
-            + cap * sizeof_ds_element;                                                   // dirty stack elements
+}
 
-    HashTable* temp_ht = (HashTable*)malloc(sizeof(HashTable));
-    if (!temp_ht) {
-        if (err) { *err = strdup("dht_reserve: could not allocate memory."); }
-        return 0;
-    }
-    while (1) {
-        temp_ht->fname_ = generate_tempname_from(ht->fname_);
-        if (!temp_ht->fname_) {
-            if (err) { *err = strdup("dht_reserve: could not allocate memory."); }
-            free(temp_ht);
-            return 0;
-        }
-        temp_ht->fd_ = dht_open_file(temp_ht->fname_, O_EXCL | O_CREAT | O_RDWR, true);
-        if (temp_ht->fd_) break;
-        free((char*)temp_ht->fname_);
-    }
-    if (!dht_truncate_file(temp_ht->fd_, total_size)) {
-        if (err) {
-            *err = malloc(256);
-            if (*err) {
-                snprintf(*err, 256, "Could not allocate disk space. Error: %s.", strerror(errno));
+/* Finds `key` in its two buckets of a cuckoo table.
+ *
+ * A bucket is scanned directly from memory: with fingerprints, the store
+ * table is only read for slots whose fingerprint matches.
+ *
+ * Returns the slot holding the key or cursize_ if it is not present. */
+static
+uint64_t cuckoo_find(const HashTable* ht, const char* key, size_t len, uint64_t hash) {
+    const void* table = hashtable_of((HashTable*)ht);
+    const size_t width = index_width(ht);
+    const uint64_t fingerprint = fingerprint_of_hash(hash);
+    uint64_t buckets[2];
+    int b, i;
+    cuckoo_buckets_of(ht, hash, &buckets[0], &buckets[1]);
+    for (b = 0; b < 2; ++b) {
+        const uint64_t first_slot = buckets[b] * CUCKOO_BUCKET_SLOTS;
+        if (has_fingerprints(ht)) {
+            for (i = 0; i < CUCKOO_BUCKET_SLOTS; ++i) {
+                const uint64_t h = first_slot + i;
+                if (index_element(table, width, 2 * h + 1) != fingerprint) continue;
+                const uint64_t ix = index_element(table, width, 2 * h);
+                if (ix && entry_holds(entry_by_index(ht, ix), key, len, hash)) return h;
             }
-        }
-        free((char*)temp_ht->fname_);
-        free(temp_ht);
-        return 0;
-    }
-    temp_ht->datasize_ = total_size;
-    bool map_success = dht_memory_map_file(temp_ht->fd_, &temp_ht->data_, temp_ht->datasize_, PROT_READ | PROT_WRITE);
-    temp_ht->flags_ = ht->flags_;
-    if (!map_success) {
-        if (err) {
-            const int errorbufsize = 512;
-            *err = (char*)malloc(errorbufsize);
-            if (*err) {
-                snprintf(*err, errorbufsize, "Could not dht_memory_map_file() new hashtable: %s.\n", strerror(errno));
+        } else {
+            for (i = 0; i < CUCKOO_BUCKET_SLOTS; ++i) {
+                const uint64_t ix = index_element(table, width, first_slot + i);
+                if (ix && entry_holds(entry_by_index(ht, ix), key, len, hash)) return first_slot + i;
             }
         }
-        dht_close_file(temp_ht->fd_);
-        dht_delete_file(temp_ht->fname_);
-        free((char*)temp_ht->fname_);
-        free(temp_ht);
-        return 0;
     }
-    memcpy(header_of(temp_ht), header_of(ht), sizeof(HashTableHeader));
-    header_of(temp_ht)->cursize_ = n;
-    header_of(temp_ht)->slots_used_ = 0;
-    header_of(temp_ht)->dirty_slots_ = 0;
-    header_of(temp_ht)->capacity_ = cap;
+    return cheader_of(ht)->cursize_;
+}
 
-    if (!strcmp(header_of(temp_ht)->magic, "DiskBasedHash10")) {
-        strcpy(header_of(temp_ht)->magic, "DiskBasedHash11");
-        temp_ht->flags_ |= HT_FLAG_HASH_2;
+/* Returns an empty slot of the bucket (or cursize_ if it is full) */
+static
+uint64_t cuckoo_free_slot(const HashTable* ht, uint64_t bucket) {
+    const uint64_t first_slot = bucket * CUCKOO_BUCKET_SLOTS;
+    int i;
+    for (i = 0; i < CUCKOO_BUCKET_SLOTS; ++i) {
+        if (!get_table_at(ht, first_slot + i)) return first_slot + i;
     }
+    return cheader_of(ht)->cursize_;
+}
 
-    HashTableEntry et;
-    for (i = 0; i < header_of(ht)->slots_used_; ++i) {
-        set_table_at(ht, 0, i + 1);
-        et = entry_at(ht, 0);
-        if (!entry_empty(et)) {
-            dht_insert(temp_ht, et.ht_key, et.ht_data, NULL);
+/* The bucket that the entry at slot h (in bucket `bucket`) could move to. The
+ * hash is computed again from the stored key. */
+static
+uint64_t cuckoo_other_bucket(const HashTable* ht, uint64_t h, uint64_t bucket) {
+    const HashTableEntry et = entry_at(ht, h);
+    uint64_t first, second;
+    cuckoo_buckets_of(ht, entry_hash(et), &first, &second);
+    return first == bucket ? second : first;
+}
+
+/* A bucket reached while looking for room for a new key: the entry in slot
+ * `slot` of the bucket of step `parent` can move to it (parent is -1 for the
+ * two buckets of the new key). */
+typedef struct CuckooStep {
+    uint64_t bucket;
+    int parent;
+    int slot;
+} CuckooStep;
+
+/* Makes room for a key whose two buckets are full by moving other entries to
+ * their alternative bucket.
+ *
+ * The buckets reachable from the key's are searched breadth first (so that as
+ * few entries as possible move) until one with an empty slot is found. The
+ * entries on the path are then moved, starting from the end, each into the
+ * slot freed by the previous one. As no bucket is visited twice, no entry
+ * moves twice.
+ *
+ * Returns the freed slot in one of the key's buckets, or cursize_ if no empty
+ * slot was found within CUCKOO_MAX_SEARCH buckets (the table is unchanged). */
+static
+uint64_t cuckoo_make_room(HashTable* ht, uint64_t first, uint64_t second) {
+    const uint64_t cursize = cheader_of(ht)->cursize_;
+    CuckooStep steps[CUCKOO_MAX_SEARCH];
+    int nr_steps = 2;
+    int next, i, j;
+    steps[0].bucket = first;
+    steps[1].bucket = second;
+    steps[0].parent = steps[1].parent = -1;
+    steps[0].slot = steps[1].slot = 0;
+    for (next = 0; next < nr_steps; ++next) {
+        const uint64_t bucket = steps[next].bucket;
+        uint64_t h = cuckoo_free_slot(ht, bucket);
+        if (h != cursize) {
+            int step = next;
+            while (steps[step].parent >= 0) {
+                const uint64_t from = steps[steps[step].parent].bucket * CUCKOO_BUCKET_SLOTS + steps[step].slot;
+                set_table_at(ht, h, get_table_at(ht, from));
+                set_slot_meta(ht, h, get_slot_meta(ht, from));
+                h = from;
+                step = steps[step].parent;
+            }
+            return h;
+        }
+        for (i = 0; i < CUCKOO_BUCKET_SLOTS && nr_steps < CUCKOO_MAX_SEARCH; ++i) {
+            const uint64_t other = cuckoo_other_bucket(ht, bucket * CUCKOO_BUCKET_SLOTS + i, bucket);
+            for (j = 0; j < nr_steps; ++j) {
+                if (steps[j].bucket == other) break;
+            }
+            if (j < nr_steps) continue;
+            steps[nr_steps].bucket = other;
+            steps[nr_steps].parent = next;
+            steps[nr_steps].slot = i;
+            ++nr_steps;
         }
     }
+    return cursize;
+}
 
-    char* temp_fname = strdup(temp_ht->fname_);
-    if (!temp_fname) {
-        if (err) { *err = NULL; }
-        dht_delete_file(temp_ht->fname_);
-        dht_free(temp_ht);
-        return 0;
+/* Finds the slot holding a key that fits in the table, given its hash.
+ *
+ * Returns cursize_ if the key is not present. */
+inline static
+uint64_t find_slot(const HashTable* ht, const char* key, size_t len, uint64_t hash) {
+    if (is_cuckoo(ht)) return cuckoo_find(ht, key, len, hash);
+    if (is_inline(ht)) return inline_find(ht, key, len, hash);
+    if (has_tags(ht)) return tags_find(ht, key, len, hash, NULL);
+    if (is_robin_hood(ht) && !has_fingerprints(ht)) return robin_hood_find(ht, key, len, hash, NULL, NULL);
+    uint64_t h = home_slot(ht, hash);
+    uint64_t i;
+    for (i = 0; i < cheader_of(ht)->cursize_; ++i) {
+        if (!get_table_at(ht, h)) return cheader_of(ht)->cursize_;
+        if (slot_holds(ht, h, key, len, hash)) return h;
+        ++h;
+        if (h == cheader_of(ht)->cursize_) h = 0;
     }
+    fprintf(stderr, "dht_lookup: the code should never have reached this line.\n");
+    return cheader_of(ht)->cursize_;
+}
 
-    dht_free(temp_ht);
-    const HashTableOpts opts = header_of(ht)->opts_;
+/* Looks up a key that fits in the table, given its hash */
+static
+void* lookup_hashed(const HashTable* ht, const char* key, size_t len, uint64_t hash) {
+    const uint64_t slot = find_slot(ht, key, len, hash);
+    if (slot == cheader_of(ht)->cursize_) return NULL;
+    if (ht->sketch_) sample_access(ht->sketch_, hash);
+    return entry_at(ht, slot).ht_data;
+}
 
-    dht_memory_unmap_file(ht->data_, ht->datasize_);
-    dht_close_file(ht->fd_);
+static
+void* growing_lookup(const HashTable* ht, const char* key, size_t len, uint64_t hash);
 
-    dht_delete_file(ht->fname_);
-    int renaming_ret = rename(temp_fname, ht->fname_);
-    assert(renaming_ret == 0);
-    free((char*)temp_fname);
+static
+void* lookup_key(const HashTable* ht, const char* key, size_t len) {
+    /* such a key cannot have been inserted */
+    if (!key_fits(ht, len)) return NULL;
+    const uint64_t hash = hash_of(ht, key, len);
+    if (ht->growth_) return growing_lookup(ht, key, len, hash);
+    return lookup_hashed(ht, key, len, hash);
+}
 
-    temp_ht = dht_open(ht->fname_, opts, O_RDWR, err);
-    if (!temp_ht) {
-        /* err is set by dht_open */
+/* Address of hash table slot h */
+inline static
+const void* index_address(const HashTable* ht, uint64_t h) {
+    return (const char*)hashtable_of((HashTable*)ht) + h * index_stride(ht) * index_width(ht);
+}
+
+/* The store entry that the lookup of `hash` will most likely compare its key
+ * against (or 0 if it will probably not read the store table at all): the
+ * first one in its probe sequence whose tag or fingerprint matches or, for
+ * tables with neither, the one in its home slot. It only reads the hash table
+ * slots that were prefetched (and, for long probe sequences, the ones after). */
+static
+uint64_t likely_store_index(const HashTable* ht, uint64_t hash) {
+    const uint64_t cursize = cheader_of(ht)->cursize_;
+    const uint32_t fingerprint = fingerprint_of_hash(hash);
+    if (is_cuckoo(ht)) {
+        const void* table = hashtable_of((HashTable*)ht);
+        const size_t width = index_width(ht);
+        uint64_t buckets[2];
+        int b, i;
+        cuckoo_buckets_of(ht, hash, &buckets[0], &buckets[1]);
+        for (b = 0; b < 2; ++b) {
+            for (i = 0; i < CUCKOO_BUCKET_SLOTS; ++i) {
+                const uint64_t h = buckets[b] * CUCKOO_BUCKET_SLOTS + i;
+                const uint64_t ix = index_element(table, width, h * index_stride(ht));
+                if (ix && (!has_fingerprints(ht) || index_element(table, width, 2 * h + 1) == fingerprint)) return ix;
+            }
+        }
         return 0;
     }
-    free((char*)ht->fname_);
-    memcpy(ht, temp_ht, sizeof(HashTable));
-    free(temp_ht);
+    uint64_t h = home_slot(ht, hash);
+    if (has_tags(ht)) {
+        uint32_t empty;
+        uint32_t match = tag_group_match(tags_of(ht) + h, tag_of_hash(hash), &empty);
+        if (empty) match &= (empty & (~empty + 1)) - 1;
+        if (!match) return 0;
+        h += lowest_bit(match);
+        if (h >= cursize) h -= cursize;
+    }
+    uint64_t ix = get_table_at(ht, h);
+    if (has_fingerprints(ht) && !has_tags(ht)) {
+        /* the lookup scans the fingerprints up to the first empty slot */
+        while (ix && get_fingerprint_at(ht, h) != fingerprint) {
+            if (++h == cursize) h = 0;
+            ix = get_table_at(ht, h);
+        }
+        return ix;
+    }
+    if (ix && has_fingerprints(ht) && get_fingerprint_at(ht, h) != fingerprint) return 0;
+    return ix;
+}
 
-    assert(starting_slots == cheader_of(ht)->slots_used_);
-    assert(dht_size(ht) == cheader_of(ht)->slots_used_);
-    return cap;
+/* The lookups are software pipelined: while key i is looked up, the store
+ * entry of key i + LOOKUP_PREFETCH_DISTANCE and the hash table slots of key
+ * i + 2 * LOOKUP_PREFETCH_DISTANCE are being prefetched. This way, the cache
+ * misses of consecutive keys overlap instead of being paid one after the
+ * other.
+ *
+ * Keys are hashed LOOKUP_HASH_BATCH at a time, ahead of their prefetches.
+ *
+ * The prefetches are written out here rather than in helper functions: GCC
+ * considers a function that only prefetches to have no effect and drops the
+ * calls to it. */
+size_t dht_lookup_batch(const HashTable* ht, const char* const* keys, size_t n, void** out) {
+    const size_t distance = LOOKUP_PREFETCH_DISTANCE;
+    const bool cuckoo = is_cuckoo(ht);
+    const bool inlined = is_inline(ht);
+    const bool columnar = ht->format_ & DHT_OPT_COLUMNAR;
+    /* the probe distances and stored hashes are in the entry's bookkeeping */
+    const bool reads_meta = (is_robin_hood(ht) && !has_fingerprints(ht)) || (ht->format_ & DHT_OPT_STORED_HASHES);
+    const uint8_t* tags = has_tags(ht) ? tags_of(ht) : NULL;
+    uint64_t hashes[LOOKUP_PIPELINE];
+    size_t lens[LOOKUP_PIPELINE];
+    size_t found = 0;
+    size_t i;
+    if (ht->growth_) {
+        for (i = 0; i < n; ++i) {
+            out[i] = lookup_key(ht, keys[i], key_length_of(ht, keys[i]));
+            found += out[i] != NULL;
+        }
+        return found;
+    }
+    for (i = 0; i < n + 2 * distance; ++i) {
+        if (i < n && i % LOOKUP_HASH_BATCH == 0) {
+            const size_t p = i % LOOKUP_PIPELINE;
+            const size_t batch = (n - i < LOOKUP_HASH_BATCH) ? n - i : LOOKUP_HASH_BATCH;
+            size_t j;
+            for (j = 0; j < batch; ++j) lens[p + j] = key_length_of(ht, keys[i + j]);
+            hash_batch(ht, keys + i, lens + p, batch, hashes + p);
+        }
+        if (i < n) {
+            const size_t p = i % LOOKUP_PIPELINE;
+            if (key_fits(ht, lens[p])) {
+                if (cuckoo) {
+                    uint64_t first, second;
+                    cuckoo_buckets_of(ht, hashes[p], &first, &second);
+                    DHT_PREFETCH(index_address(ht, first * CUCKOO_BUCKET_SLOTS));
+                    DHT_PREFETCH((const char*)index_address(ht, (first + 1) * CUCKOO_BUCKET_SLOTS) - 1);
+                    DHT_PREFETCH(index_address(ht, second * CUCKOO_BUCKET_SLOTS));
+                    DHT_PREFETCH((const char*)index_address(ht, (second + 1) * CUCKOO_BUCKET_SLOTS) - 1);
+                } else if (inlined) {
+                    /* the entry is all that the lookup reads (if its home slot holds the key) */
+                    const HashTableEntry et = entry_by_index(ht, home_slot(ht, hashes[p]) + 1);
+                    DHT_PREFETCH(et.ht_key);
+                    DHT_PREFETCH(et.offset_);
+                } else {
+                    const uint64_t h = home_slot(ht, hashes[p]);
+                    if (tags) DHT_PREFETCH(tags + h);
+                    DHT_PREFETCH(index_address(ht, h));
+                }
+            }
+        }
+        if (i >= distance && i - distance < n) {
+            const size_t p = (i - distance) % LOOKUP_PIPELINE;
+            const uint64_t ix = (key_fits(ht, lens[p]) && !inlined) ? likely_store_index(ht, hashes[p]) : 0;
+            if (ix) {
+                const HashTableEntry et = entry_by_index(ht, ix);
+                DHT_PREFETCH(et.ht_key);
+                if (columnar) DHT_PREFETCH(et.ht_data);
+                if (reads_meta) DHT_PREFETCH(et.offset_);
+            }
+        }
+        if (i >= 2 * distance) {
+            const size_t k = i - 2 * distance;
+            const size_t p = k % LOOKUP_PIPELINE;
+            out[k] = key_fits(ht, lens[p]) ? lookup_hashed(ht, keys[k], lens[p], hashes[p]) : NULL;
+            found += out[k] != NULL;
+        }
+    }
+    return found;
 }
 
-size_t dht_size(const HashTable* ht) {
-    return cheader_of(ht)->slots_used_ - cheader_of(ht)->dirty_slots_;
+void* dht_lookup(const HashTable* ht, const char* key) {
+    return lookup_key(ht, key, key_length_of(ht, key));
 }
 
-size_t dht_capacity(const HashTable* ht) {
-    return cheader_of(ht)->capacity_;
+void* dht_lookup_n(const HashTable* ht, const char* key, size_t len) {
+    if (!(ht->format_ & (DHT_OPT_KEY_LENGTHS | DHT_OPT_FIXED_KEYS)) && memchr(key, '\0', len)) return NULL;
+    return lookup_key(ht, key, len);
 }
 
-size_t dht_dirty_slots(const HashTable *ht) {
-    return cheader_of(ht)->dirty_slots_;
+/* Returns the index of an unused store entry, reusing deleted ones first. */
+static
+uint64_t allocate_store_slot(HashTable* ht) {
+    if (header_of(ht)->dirty_slots_) {
+        const uint64_t dirty_index = get_dirty_index (ht, header_of (ht)->dirty_slots_ - 1);
+        --header_of(ht)->dirty_slots_;
+        return dirty_index;
+    }
+    return ++header_of(ht)->slots_used_;
 }
 
-size_t dht_slots_used(const HashTable *ht) {
-    return cheader_of(ht)->slots_used_;
+/* Adds the (unused) store entry ix to the dirty stack. DHT_OPT_INLINE tables
+ * only count it, as it cannot be given to another slot. */
+static
+void push_dirty_slot(HashTable* ht, uint64_t ix) {
+    if (!is_inline(ht)) {
+        set_dirty_index (ht, header_of(ht)->dirty_slots_, ix);
+        assert(header_of(ht)->dirty_slots_ < header_of(ht)->capacity_);
+    }
+    ++header_of(ht)->dirty_slots_;
 }
 
-int dht_indexed_lookup (HashTable* ht, size_t index, char** key, void* data, char** err) {
-    if (index >= cheader_of(ht)->slots_used_) {
-        if (err) { *err = strdup("The index is out-of-range."); }
-        return -EINVAL;
-    }
-    HashTableEntry et;
-    et = entry_by_index(ht, (index + 1));
-    if (!entry_empty(et)) {
-        strncpy(*key, et.ht_key, cheader_of(ht)->opts_.key_maxlen);
-        memcpy(data, et.ht_data, cheader_of(ht)->opts_.object_datalen);
-        return 1;
-    }
-    if (err) { *err = strdup("The informed index doesn't contain any data."); }
-    return -EFAULT;
+static
+void release_store_slot(HashTable* ht, uint64_t ix) {
+    set_offset(entry_by_index(ht, ix), 0);
+    push_dirty_slot(ht, ix);
 }
 
-void* dht_lookup(const HashTable* ht, const char* key) {
-    uint64_t h = hash_key(key, ht->flags_ & HT_FLAG_HASH_2) % cheader_of(ht)->cursize_;
-    uint64_t i;
-    for (i = 0; i < cheader_of(ht)->cursize_; ++i) {
-        HashTableEntry et = entry_at(ht, h);
-        if (entry_empty(et)) return NULL;
-        if (!strcmp(et.ht_key, key)) return et.ht_data;
-        ++h;
-        if (h == cheader_of(ht)->cursize_) h = 0;
-    }
-    fprintf(stderr, "dht_lookup: the code should never have reached this line.\n");
-    return NULL;
+static
+int start_growth(HashTable* ht, size_t cap, size_t arena_size, char** err);
+
+static
+int growing_insert(HashTable* ht, const char* key, size_t len, const void* data, char** err);
+
+static
+int growing_delete(HashTable* ht, const char* key, size_t len, char** err);
+
+/* The capacity to grow the full table ht to: room for one more entry or, if
+ * it was created with a growth factor, that many times its capacity */
+static
+size_t grown_capacity(const HashTable* ht) {
+    const size_t full = dht_size(ht) > dht_capacity(ht) ? dht_size(ht) : dht_capacity(ht);
+    const uint64_t growth = (ht->flags_ & HT_FLAG_EXT_HEADER) ? cheader_of(ht)->growth_percent_ : 0;
+    const size_t grown = percent_of(full, (size_t)growth);
+    return grown > full ? grown : full + 1;
 }
 
-int dht_insert(HashTable* ht, const char* key, const void* data, char** err) {
+/* dht_insert and dht_insert_n after checking the key. stored_hash is the hash
+ * of the key when it is already known (see copy_entry), otherwise NULL. */
+static
+int insert_hashed(HashTable* ht, const char* key, size_t len, const uint64_t* stored_hash,
+                  const void* data, char** err) {
     int checks_return;
-    if ((checks_return = check_ht(ht, err)) != 1 ||
-        (checks_return = check_key(key, err)) != 1 ||
-        (checks_return = check_data(data, err)) != 1 ||
+    if ((checks_return = check_data(data, err)) != 1 ||
         (checks_return = check_ht_writable(ht, err)) != 1 ||
-        (checks_return = check_key_size(ht, key, err)) != 1) {
+        (checks_return = check_key_size(ht, len, err)) != 1) {
         return checks_return;
     }
-    /* Max load is 50% */
-    if (cheader_of(ht)->cursize_ / 2 <= dht_size(ht)) {
-        if (!dht_reserve(ht, dht_size(ht) + 1, err)) return -ENOMEM;
+    if (ht->growth_) return growing_insert(ht, key, len, data, err);
+    if (capacity_for_slots(max_load(ht), cheader_of(ht)->cursize_) <= dht_size(ht)) {
+        if (ht->growth_step_) {
+            checks_return = start_growth(ht, grown_capacity(ht), arena_bytes_used(ht), err);
+            if (checks_return != 1) return checks_return;
+            return growing_insert(ht, key, len, data, err);
+        }
+        if (!dht_reserve(ht, grown_capacity(ht), err)) return -ENOMEM;
+    }
+    if ((ht->format_ & DHT_OPT_KEY_ARENA) && len > ARENA_INLINE_KEY) {
+        if ((checks_return = reserve_arena(ht, len, err)) != 1) return checks_return;
     }
-    uint64_t h = hash_key(key, ht->flags_ & HT_FLAG_HASH_2) % cheader_of(ht)->cursize_;
+    const uint64_t hash = stored_hash ? *stored_hash : hash_of(ht, key, len);
+    uint64_t h = home_slot(ht, hash);
     uint64_t offset = 1;
-    while (1) {
-        HashTableEntry et = entry_at(ht, h);
-        if (entry_empty(et)) break;
-        if (!strcmp(et.ht_key, key)) {
-            return 0;
+    if (is_cuckoo(ht)) {
+        uint64_t first, second;
+        if (cuckoo_find(ht, key, len, hash) != cheader_of(ht)->cursize_) return 0;
+        cuckoo_buckets_of(ht, hash, &first, &second);
+        while ((h = cuckoo_free_slot(ht, first)) == cheader_of(ht)->cursize_
+                && (h = cuckoo_free_slot(ht, second)) == cheader_of(ht)->cursize_
+                && (h = cuckoo_make_room(ht, first, second)) == cheader_of(ht)->cursize_) {
+            /* rare below the maximum load: growing moves all keys to new buckets */
+            if (!dht_reserve(ht, grown_capacity(ht), err)) return -ENOMEM;
+            if ((ht->format_ & DHT_OPT_KEY_ARENA) && len > ARENA_INLINE_KEY) {
+                if ((checks_return = reserve_arena(ht, len, err)) != 1) return checks_return;
+            }
+            cuckoo_buckets_of(ht, hash, &first, &second);
         }
-        ++offset;
-        ++h;
-        if (h == cheader_of(ht)->cursize_) {
-            h = 0;
+    } else if (is_robin_hood(ht)) {
+        if (robin_hood_find(ht, key, len, hash, &h, &offset) != cheader_of(ht)->cursize_) return 0;
+        const uint64_t ix = allocate_store_slot(ht);
+        HashTableEntry et = entry_by_index(ht, ix);
+        set_entry_key(et, key, len);
+        set_entry_hash(et, hash);
+        memcpy(et.ht_data, data, cheader_of(ht)->opts_.object_datalen);
+        robin_hood_place(ht, h, offset, ix, slot_meta_of_hash(hash));
+        return 1;
+    } else if (has_tags(ht)) {
+        uint64_t free_slot;
+        if (tags_find(ht, key, len, hash, &free_slot) != cheader_of(ht)->cursize_) return 0;
+        offset += (free_slot >= h) ? free_slot - h : free_slot + cheader_of(ht)->cursize_ - h;
+        h = free_slot;
+    } else {
+        while (1) {
+            if (!get_table_at(ht, h)) break;
+            if (slot_holds(ht, h, key, len, hash)) {
+                return 0;
+            }
+            ++offset;
+            ++h;
+            if (h == cheader_of(ht)->cursize_) {
+                h = 0;
+            }
         }
     }
-    if (header_of(ht)->dirty_slots_) {
-        size_t dirty_index = get_dirty_index (ht, header_of (ht)->dirty_slots_ - 1);
+    if (is_inline(ht)) {
+        /* the entry of slot h stops being a dirty one */
         --header_of(ht)->dirty_slots_;
-        set_table_at(ht, h, dirty_index);
     } else {
-        set_table_at(ht, h, header_of(ht)->slots_used_ + 1);
-        ++header_of(ht)->slots_used_;
+        set_table_at(ht, h, allocate_store_slot(ht));
     }
+    set_slot_meta(ht, h, slot_meta_of_hash(hash));
     HashTableEntry et = entry_at(ht, h);
 
     set_offset(et, offset);
-    strcpy((char*)et.ht_key, key);
+    set_entry_key(et, key, len);
+    set_entry_hash(et, hash);
     memcpy(et.ht_data, data, cheader_of(ht)->opts_.object_datalen);
     return 1;
 }
 
+static
+int insert_key(HashTable* ht, const char* key, size_t len, const void* data, char** err) {
+    return insert_hashed(ht, key, len, NULL, data, err);
+}
+
+/* Inserts the key and data of the entry (of another table with the same
+ * format) into ht, without hashing the key again if its hash is stored */
+static
+int copy_entry(HashTable* ht, const HashTableEntry et, char** err) {
+    const uint64_t hash = et.hash_ ? entry_hash(et) : 0;
+    return insert_hashed(ht, entry_key(et), get_key_length(et), et.hash_ ? &hash : NULL, et.ht_data, err);
+}
+
+int dht_insert(HashTable* ht, const char* key, const void* data, char** err) {
+    int checks_return;
+    if ((checks_return = check_ht(ht, err)) != 1 ||
+        (checks_return = check_key(key, err)) != 1) {
+        return checks_return;
+    }
+    return insert_key(ht, key, key_length_of(ht, key), data, err);
+}
+
+int dht_insert_n(HashTable* ht, const char* key, size_t len, const void* data, char** err) {
+    int checks_return;
+    if ((checks_return = check_ht(ht, err)) != 1 ||
+        (checks_return = check_key(key, err)) != 1 ||
+        (checks_return = check_key_bytes(ht, key, len, err)) != 1) {
+        return checks_return;
+    }
+    return insert_key(ht, key, len, data, err);
+}
+
 int dht_update(HashTable* ht, const char* key, const void* data, char** err) {
     int checks_return;
     if ((checks_return = check_ht(ht, err)) != 1 ||
         (checks_return = check_key(key, err)) != 1 ||
         (checks_return = check_data(data, err)) != 1 ||
         (checks_return = check_ht_writable(ht, err)) != 1 ||
-        (checks_return = check_key_size(ht, key, err)) != 1) {
+        (checks_return = check_key_size(ht, key_length_of(ht, key), err)) != 1) {
         return checks_return;
     }
     void * data_ptr = dht_lookup (ht, key);
@@ -718,23 +3132,78 @@ int dht_update(HashTable* ht, const char* key, const void* data, char** err) {
 static
 int table_compression(HashTable*, uint64_t, uint64_t, char** err);
 
-int dht_delete(HashTable* ht, const char* key, char** err) {
+/* Removes the entry at slot h of a Robin Hood table.
+ *
+ * The following entries that are not at their home slot are shifted back by
+ * one. Only the hash table (and slot metadata) are touched: store entries stay where
+ * they are and the freed one goes to the dirty stack.
+ */
+static
+int backward_shift_delete(HashTable* ht, uint64_t h) {
+    const uint64_t cursize = cheader_of(ht)->cursize_;
+    release_store_slot(ht, get_table_at(ht, h));
+    uint64_t next = h + 1;
+    if (next == cursize) next = 0;
+    while (1) {
+        const uint64_t ix = get_table_at(ht, next);
+        if (!ix) break;
+        HashTableEntry et = entry_by_index(ht, ix);
+        const uint64_t offset = probe_offset(ht, next, et);
+        if (offset <= 1) break;
+        set_table_at(ht, h, ix);
+        set_offset(et, offset - 1);
+        set_slot_meta(ht, h, get_slot_meta(ht, next));
+        h = next;
+        ++next;
+        if (next == cursize) next = 0;
+    }
+    set_table_at(ht, h, 0);
+    set_slot_meta(ht, h, empty_slot_meta());
+    return 1;
+}
+
+/* dht_delete and dht_delete_n after checking the key */
+static
+int delete_key(HashTable* ht, const char* key, size_t len, char** err) {
     int checks_return;
-    if ((checks_return = check_ht(ht, err)) != 1 ||
-        (checks_return = check_key(key, err)) != 1 ||
-        (checks_return = check_ht_writable(ht, err)) != 1 ||
-        (checks_return = check_key_size(ht, key, err)) != 1) {
+    if ((checks_return = check_ht_writable(ht, err)) != 1 ||
+        (checks_return = check_key_size(ht, len, err)) != 1) {
         return checks_return;
     }
-    uint64_t i, hash = hash_key(key, ht->flags_ & HT_FLAG_HASH_2) % cheader_of(ht)->cursize_;
-    HashTableEntry et;
+    if (ht->growth_) return growing_delete(ht, key, len, err);
+    const uint64_t full_hash = hash_of(ht, key, len);
+    uint64_t i, hash = home_slot(ht, full_hash);
+    if (is_cuckoo(ht)) {
+        const uint64_t slot = cuckoo_find(ht, key, len, full_hash);
+        if (slot == cheader_of(ht)->cursize_) {
+            if (err) { *err = strdup ("Key was not found."); }
+            return 0;
+        }
+        /* entries never leave their buckets on their own, so nothing has to
+         * move into the freed slot */
+        release_store_slot(ht, get_table_at(ht, slot));
+        set_table_at(ht, slot, 0);
+        set_slot_meta(ht, slot, empty_slot_meta());
+        return 1;
+    }
+    if (has_tags(ht) || (is_robin_hood(ht) && !has_fingerprints(ht))) {
+        const uint64_t slot = has_tags(ht)
+                                ? tags_find(ht, key, len, full_hash, NULL)
+                                : robin_hood_find(ht, key, len, full_hash, NULL, NULL);
+        if (slot == cheader_of(ht)->cursize_) {
+            if (err) { *err = strdup ("Key was not found."); }
+            return 0;
+        }
+        if (is_robin_hood(ht)) return backward_shift_delete(ht, slot);
+        return table_compression(ht, slot, probe_offset(ht, slot, entry_at(ht, slot)) - 1, err);
+    }
     for (i = 0; i < cheader_of(ht)->cursize_; ++i) {
-        et = entry_at (ht, hash);
-        if (entry_empty(et)) {
+        if (!get_table_at(ht, hash)) {
             if (err) { *err = strdup ("Key was not found."); }
             return 0;
         }
-        if (!strcmp (et.ht_key, key)) {
+        if (slot_holds(ht, hash, key, len, full_hash)) {
+            if (is_robin_hood(ht)) return backward_shift_delete(ht, hash);
             // Entry found, now compressing collision list
             return table_compression(ht, hash, i, err);
         }
@@ -748,48 +3217,68 @@ int dht_delete(HashTable* ht, const char* key, char** err) {
     return -ENFILE;
 }
 
+int dht_delete(HashTable* ht, const char* key, char** err) {
+    int checks_return;
+    if ((checks_return = check_ht(ht, err)) != 1 ||
+        (checks_return = check_key(key, err)) != 1) {
+        return checks_return;
+    }
+    return delete_key(ht, key, key_length_of(ht, key), err);
+}
+
+int dht_delete_n(HashTable* ht, const char* key, size_t len, char** err) {
+    int checks_return;
+    if ((checks_return = check_ht(ht, err)) != 1 ||
+        (checks_return = check_key(key, err)) != 1 ||
+        (checks_return = check_key_bytes(ht, key, len, err)) != 1) {
+        return checks_return;
+    }
+    return delete_key(ht, key, len, err);
+}
+
+/* Removes the entry of slot `hash`, which is i slots after its home slot, from
+ * a linear probing table.
+ *
+ * The following entries of the probe sequence that can be closer to their home
+ * slot fill the hole left behind. Only their hash table slots (and slot
+ * metadata) move, so deleting costs the same whatever the size of the data;
+ * the store entry of the deleted key goes to the dirty stack. DHT_OPT_INLINE
+ * tables have to copy the entries, which are their slots. */
+static
 int table_compression(HashTable* ht, uint64_t hash, uint64_t i, char** err) {
-    uint64_t free_slot = get_table_at(ht, hash);
+    const uint64_t cursize = cheader_of(ht)->cursize_;
+    uint64_t free_pos = hash;
     uint64_t hash_offset = 1;
     HashTableEntry et, free_et;
-    for (++i; i < cheader_of(ht)->cursize_; ++i, ++hash_offset) {
+    if (!is_inline(ht)) release_store_slot(ht, get_table_at(ht, hash));
+    for (++i; i < cursize; ++i, ++hash_offset) {
         ++hash;
-        if (hash == cheader_of(ht)->cursize_) {
+        if (hash == cursize) {
             hash = 0;
         }
         et = entry_at (ht, hash);
         if (entry_empty(et)) {
-            // set the freed slot as dirty
-            uint64_t dirty_index = free_slot;
-            set_dirty_index (ht, header_of(ht)->dirty_slots_, dirty_index);
-            ++header_of(ht)->dirty_slots_;
-            assert(header_of(ht)->dirty_slots_ <= header_of(ht)->capacity_);
-
-            // reset freed hash table entry.
-            assert (hash_offset < cheader_of(ht)->cursize_);
-            if (hash_offset > hash) {
-                hash = cheader_of(ht)->cursize_ - (hash_offset - hash);
-            } else {
-                hash -= hash_offset;
-            }
-
-            et = entry_at(ht, hash);
-            set_offset(et, 0);
-
-            set_table_at(ht, hash, 0);
+            if (is_inline(ht)) release_store_slot(ht, free_pos + 1);
+            set_table_at(ht, free_pos, 0);
+            set_slot_meta(ht, free_pos, empty_slot_meta());
             return 1;
         }
-        if (get_offset(et) > hash_offset) {
-            // move current entry
-            free_et = entry_by_index(ht, free_slot);
-            strncpy((char*)free_et.ht_key, et.ht_key, cheader_of(ht)->opts_.key_maxlen);
-            memcpy(free_et.ht_data, et.ht_data, cheader_of(ht)->opts_.object_datalen);
-            set_offset(free_et, get_offset(et) - hash_offset);
-
-            // mark current slot as free
-            free_slot = get_table_at(ht, hash);
-            set_offset(et, 0);
-
+        const uint64_t offset = probe_offset(ht, hash, et);
+        if (offset > hash_offset) {
+            // move current entry back to the free slot
+            if (is_inline(ht)) {
+                free_et = entry_by_index(ht, free_pos + 1);
+                memcpy((char*)free_et.ht_key, et.ht_key, sizeof_key_field(ht->format_, cheader_of(ht)->opts_));
+                if (free_et.key_length_) set_key_length(free_et, get_key_length(et));
+                if (free_et.hash_) set_entry_hash(free_et, entry_hash(et));
+                memcpy(free_et.ht_data, et.ht_data, cheader_of(ht)->opts_.object_datalen);
+                set_offset(free_et, offset - hash_offset);
+            } else {
+                set_table_at(ht, free_pos, get_table_at(ht, hash));
+                set_offset(et, offset - hash_offset);
+            }
+            set_slot_meta(ht, free_pos, get_slot_meta(ht, hash));
+            free_pos = hash;
             hash_offset = 0;
         }
     }
@@ -799,3 +3288,368 @@ int table_compression(HashTable* ht, uint64_t hash, uint64_t i, char** err) {
     assert (false);
     return -ENFILE;
 }
+
+/* Starts growing ht incrementally into a new table with room for cap entries
+ * and arena_size bytes of key arena (see dht_set_growth_step) */
+static
+int start_growth(HashTable* ht, size_t cap, size_t arena_size, char** err) {
+    HashTableGrowth* growth = (HashTableGrowth*)malloc(sizeof(HashTableGrowth));
+    uint8_t* deleted = (uint8_t*)calloc(cheader_of(ht)->slots_used_ / 8 + 1, 1);
+    if (!growth || !deleted) {
+        if (err) { *err = strdup("dht_insert: could not allocate memory."); }
+        free(growth);
+        free(deleted);
+        return -ENOMEM;
+    }
+    growth->next_ = create_resized_table(ht, &cap, arena_size, err);
+    if (!growth->next_) {
+        free(growth);
+        free(deleted);
+        return -ENOMEM;
+    }
+    growth->cursor_ = 0;
+    growth->remaining_ = dht_size(ht);
+    growth->deleted_ = deleted;
+    ht->growth_ = growth;
+    return 1;
+}
+
+inline static
+bool growth_deleted(const HashTableGrowth* growth, uint64_t ix) {
+    return growth->deleted_[ix / 8] & (1 << (ix % 8));
+}
+
+/* Store index of key (whose hash is given) in a table that is being grown, or
+ * 0 if it is not there (or was already copied to the new table). */
+static
+uint64_t pending_index(const HashTable* ht, const char* key, size_t len, uint64_t hash) {
+    const uint64_t slot = find_slot(ht, key, len, hash);
+    if (slot == cheader_of(ht)->cursize_) return 0;
+    const uint64_t ix = get_table_at(ht, slot);
+    if (ix <= ht->growth_->cursor_ || growth_deleted(ht->growth_, ix)) return 0;
+    return ix;
+}
+
+/* Number of entries to copy on an insertion or deletion: the growth step,
+ * raised when needed to copy all entries before the new table fills up */
+static
+size_t growth_quota(const HashTable* ht) {
+    const HashTableGrowth* growth = ht->growth_;
+    const HashTable* next = growth->next_;
+    const size_t free_slots = capacity_for_slots(max_load(next), cheader_of(next)->cursize_) - dht_size(next);
+    if (free_slots <= growth->remaining_ + 1) return growth->remaining_;
+    const size_t needed = growth->remaining_ / (free_slots - growth->remaining_ - 1) + 1;
+    return needed > ht->growth_step_ ? needed : ht->growth_step_;
+}
+
+/* Copies up to n more entries to the new table. Once all have been copied,
+ * the new table replaces the old one. */
+static
+int copy_entries(HashTable* ht, size_t n, char** err) {
+    HashTableGrowth* growth = ht->growth_;
+    const uint64_t slots_used = cheader_of(ht)->slots_used_;
+    int checks_return;
+    while (n && growth->cursor_ < slots_used) {
+        const uint64_t ix = growth->cursor_ + 1;
+        const HashTableEntry et = entry_by_index(ht, ix);
+        if (!entry_empty(et) && !growth_deleted(growth, ix)) {
+            checks_return = copy_entry(growth->next_, et, err);
+            if (checks_return < 0) return checks_return;
+            --growth->remaining_;
+            --n;
+        }
+        growth->cursor_ = ix;
+    }
+    /* whatever follows the cursor was deleted */
+    if (growth->remaining_ && growth->cursor_ < slots_used) return 1;
+    HashTable* next = growth->next_;
+    free(growth->deleted_);
+    free(growth);
+    ht->growth_ = NULL;
+    return replace_table(ht, next, err);
+}
+
+static
+int finish_growth(HashTable* ht, char** err) {
+    return copy_entries(ht, ht->growth_->remaining_, err);
+}
+
+/* Only used when dht_free cannot finish a growth: the changes made since it
+ * started are lost. */
+static
+void abandon_growth(HashTable* ht) {
+    HashTableGrowth* growth = ht->growth_;
+    if (!growth) return;
+    dht_delete_file(growth->next_->fname_);
+    dht_free(growth->next_);
+    free(growth->deleted_);
+    free(growth);
+    ht->growth_ = NULL;
+}
+
+/* The new table has the format (and so the hash function) of the old one, so
+ * the key is hashed only once for both */
+static
+void* growing_lookup(const HashTable* ht, const char* key, size_t len, uint64_t hash) {
+    void* data = lookup_hashed(ht->growth_->next_, key, len, hash);
+    if (!data) {
+        const uint64_t ix = pending_index(ht, key, len, hash);
+        data = ix ? entry_by_index(ht, ix).ht_data : NULL;
+    }
+    if (data && ht->sketch_) sample_access(ht->sketch_, hash);
+    return data;
+}
+
+static
+int growing_insert(HashTable* ht, const char* key, size_t len, const void* data, char** err) {
+    int checks_return;
+    if ((checks_return = copy_entries(ht, growth_quota(ht), err)) != 1) return checks_return;
+    if (!ht->growth_) return insert_key(ht, key, len, data, err);
+    const uint64_t hash = hash_of(ht, key, len);
+    if (pending_index(ht, key, len, hash)) return 0;
+    return insert_hashed(ht->growth_->next_, key, len, &hash, data, err);
+}
+
+static
+int growing_delete(HashTable* ht, const char* key, size_t len, char** err) {
+    int checks_return;
+    if ((checks_return = copy_entries(ht, growth_quota(ht), err)) != 1) return checks_return;
+    if (!ht->growth_) return delete_key(ht, key, len, err);
+    HashTableGrowth* growth = ht->growth_;
+    const uint64_t ix = pending_index(ht, key, len, hash_of(ht, key, len));
+    if (!ix) return delete_key(growth->next_, key, len, err);
+    growth->deleted_[ix / 8] |= 1 << (ix % 8);
+    --growth->remaining_;
+    return 1;
+}
+
+int dht_set_growth_step(HashTable* ht, size_t step, char** err) {
+    int checks_return;
+    if ((checks_return = check_ht(ht, err)) != 1) {
+        return checks_return;
+    }
+    ht->growth_step_ = step;
+    if (!step) return dht_finish_growth(ht, err);
+    return 1;
+}
+
+int dht_finish_growth(HashTable* ht, char** err) {
+    int checks_return;
+    if ((checks_return = check_ht(ht, err)) != 1) {
+        return checks_return;
+    }
+    if (!ht->growth_) return 1;
+    return finish_growth(ht, err);
+}
+
+/* Orders in which rewrite_table can copy entries */
+enum {
+    STORE_ORDER,
+    INDEX_ORDER,
+    ACCESS_ORDER,
+};
+
+typedef struct AccessCount {
+    uint32_t count;
+    uint64_t ix;
+} AccessCount;
+
+/* Most counted first, then in store order */
+static
+int compare_access_counts(const void* a, const void* b) {
+    const AccessCount* x = (const AccessCount*)a;
+    const AccessCount* y = (const AccessCount*)b;
+    if (x->count != y->count) return x->count > y->count ? -1 : 1;
+    return x->ix < y->ix ? -1 : (x->ix > y->ix);
+}
+
+/* The store indices of the entries of ht, sorted by their lookup counts
+ * (see compare_access_counts). Sets *n to their number. */
+static
+AccessCount* entries_by_access(const HashTable* ht, size_t* n) {
+    const uint64_t slots_used = cheader_of(ht)->slots_used_;
+    AccessCount* entries = (AccessCount*)malloc((dht_size(ht) + 1) * sizeof(AccessCount));
+    uint64_t ix;
+    *n = 0;
+    if (!entries) return NULL;
+    for (ix = 1; ix <= slots_used; ++ix) {
+        const HashTableEntry et = entry_by_index(ht, ix);
+        if (entry_empty(et)) continue;
+        entries[*n].count = access_estimate(ht->sketch_, entry_hash(et));
+        entries[*n].ix = ix;
+        ++*n;
+    }
+    qsort(entries, *n, sizeof(AccessCount), compare_access_counts);
+    return entries;
+}
+
+/* Copies the entries of ht to a new table with room for cap entries and
+ * arena_size bytes of key arena, which then replaces it. The entries are
+ * copied in store order, in the order of their hash table slots (starting
+ * after an empty one so that no probe sequence is split, so that every entry
+ * is stored next to the ones it shares slots with) or in the order of
+ * entries_by_access. */
+static
+int rewrite_table(HashTable* ht, size_t cap, size_t arena_size, int order, char** err) {
+    const uint64_t cursize = cheader_of(ht)->cursize_;
+    const uint64_t slots_used = cheader_of(ht)->slots_used_;
+    int checks_return = 1;
+    AccessCount* entries = NULL;
+    size_t n = 0;
+    if (order == ACCESS_ORDER) {
+        entries = entries_by_access(ht, &n);
+        if (!entries) {
+            if (err) { *err = strdup("dht_relayout_by_access: could not allocate memory."); }
+            return -ENOMEM;
+        }
+    }
+    HashTable* temp_ht = create_resized_table(ht, &cap, arena_size, err);
+    if (!temp_ht) {
+        free(entries);
+        return -ENOMEM;
+    }
+    if (order == ACCESS_ORDER) {
+        size_t i;
+        for (i = 0; i < n && checks_return == 1; ++i) {
+            checks_return = copy_entry(temp_ht, entry_by_index(ht, entries[i].ix), err);
+        }
+        free(entries);
+    } else if (order == INDEX_ORDER) {
+        uint64_t start = 0;
+        uint64_t i;
+        while (start < cursize && get_table_at(ht, start)) ++start;
+        if (start == cursize) start = 0;
+        for (i = 0; i < cursize && checks_return == 1; ++i) {
+            const uint64_t ix = get_table_at(ht, (start + i) % cursize);
+            if (ix) checks_return = copy_entry(temp_ht, entry_by_index(ht, ix), err);
+        }
+    } else {
+        uint64_t ix;
+        for (ix = 1; ix <= slots_used && checks_return == 1; ++ix) {
+            const HashTableEntry et = entry_by_index(ht, ix);
+            if (!entry_empty(et)) checks_return = copy_entry(temp_ht, et, err);
+        }
+    }
+    if (checks_return != 1) {
+        dht_delete_file(temp_ht->fname_);
+        dht_free(temp_ht);
+        return checks_return < 0 ? checks_return : -EIO;
+    }
+    return replace_table(ht, temp_ht, err);
+}
+
+/* Bytes of key arena used by the keys that were not deleted */
+static
+size_t live_arena_bytes(const HashTable* ht) {
+    const uint64_t slots_used = cheader_of(ht)->slots_used_;
+    size_t total = 0;
+    uint64_t ix;
+    if (!(ht->format_ & DHT_OPT_KEY_ARENA)) return 0;
+    for (ix = 1; ix <= slots_used; ++ix) {
+        const HashTableEntry et = entry_by_index(ht, ix);
+        if (entry_empty(et)) continue;
+        const size_t len = get_key_length(et);
+        if (in_arena(et, len)) total += len;
+    }
+    return total;
+}
+
+int dht_shrink_to_fit(HashTable* ht, char** err) {
+    int checks_return;
+    if ((checks_return = check_ht(ht, err)) != 1 ||
+        (checks_return = check_ht_writable(ht, err)) != 1) {
+        return checks_return;
+    }
+    if (ht->growth_ && (checks_return = finish_growth(ht, err)) != 1) {
+        return checks_return;
+    }
+    const size_t size = dht_size(ht);
+    const size_t arena_size = live_arena_bytes(ht);
+    /* the dirty entries of DHT_OPT_INLINE tables are their empty slots */
+    if (slots_for_capacity(ht->format_, max_load(ht), size) >= cheader_of(ht)->cursize_
+            && (is_inline(ht) || !cheader_of(ht)->dirty_slots_)
+            && arena_size == arena_bytes_used(ht)) {
+        return 1;
+    }
+    if (ht->growth_step_) return start_growth(ht, size, arena_size, err);
+    return rewrite_table(ht, size, arena_size, STORE_ORDER, err);
+}
+
+int dht_relayout(HashTable* ht, char** err) {
+    int checks_return;
+    if ((checks_return = check_ht(ht, err)) != 1 ||
+        (checks_return = check_ht_writable(ht, err)) != 1) {
+        return checks_return;
+    }
+    if (ht->growth_ && (checks_return = finish_growth(ht, err)) != 1) {
+        return checks_return;
+    }
+    if (is_inline(ht)) return 1;
+    return rewrite_table(ht, cheader_of(ht)->capacity_, live_arena_bytes(ht), INDEX_ORDER, err);
+}
+
+int dht_sample_accesses(HashTable* ht, unsigned int rate, char** err) {
+    int checks_return;
+    if ((checks_return = check_ht(ht, err)) != 1) {
+        return checks_return;
+    }
+    if (!rate) {
+        if (ht->sketch_) {
+            free(ht->sketch_->counters_);
+            free(ht->sketch_);
+            ht->sketch_ = NULL;
+        }
+        return 1;
+    }
+    if (!ht->sketch_) {
+        unsigned int bits = SKETCH_MIN_BITS;
+        while (bits < SKETCH_MAX_BITS && ((size_t)1 << bits) < dht_capacity(ht)) ++bits;
+        HashTableSketch* sketch = (HashTableSketch*)malloc(sizeof(HashTableSketch));
+        uint32_t* counters = (uint32_t*)calloc((size_t)SKETCH_ROWS << bits, sizeof(uint32_t));
+        if (!sketch || !counters) {
+            if (err) { *err = strdup("dht_sample_accesses: could not allocate memory."); }
+            free(sketch);
+            free(counters);
+            return -ENOMEM;
+        }
+        sketch->shift_ = 64 - bits;
+        sketch->counters_ = counters;
+        ht->sketch_ = sketch;
+    }
+    ht->sketch_->rate_ = rate;
+    ht->sketch_->countdown_ = rate;
+    return 1;
+}
+
+int dht_relayout_by_access(HashTable* ht, char** err) {
+    int checks_return;
+    if ((checks_return = check_ht(ht, err)) != 1 ||
+        (checks_return = check_ht_writable(ht, err)) != 1) {
+        return checks_return;
+    }
+    if (!ht->sketch_) {
+        if (err) { *err = strdup("Lookups are not being counted (see dht_sample_accesses)."); }
+        return -EINVAL;
+    }
+    if (ht->growth_ && (checks_return = finish_growth(ht, err)) != 1) {
+        return checks_return;
+    }
+    if (!is_inline(ht)) {
+        checks_return = rewrite_table(ht, cheader_of(ht)->capacity_, live_arena_bytes(ht), ACCESS_ORDER, err);
+    }
+    if (checks_return == 1) {
+        const size_t counters = (size_t)SKETCH_ROWS << (64 - ht->sketch_->shift_);
+        size_t i;
+        for (i = 0; i < counters; ++i) ht->sketch_->counters_[i] /= 2;
+    }
+    return checks_return;
+}
+
+int dht_set_rebuild_threads(HashTable* ht, unsigned int threads, char** err) {
+    int checks_return;
+    if ((checks_return = check_ht(ht, err)) != 1) {
+        return checks_return;
+    }
+    ht->rebuild_threads_ = threads;
+    return 1;
+}
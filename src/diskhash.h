@@ -8,28 +8,203 @@ extern "C" {
 #endif
 
 
+/** Table format options (bit flags for HashTableOpts.flags)
+ *
+ * These are fixed when the table is created and stored on disk. Tables
+ * created with any of them set use the version 1.2 file format, which older
+ * versions of diskhash cannot read.
+ *
+ * DHT_OPT_CONTROL_BYTES: keep an array of 1-byte tags (7 bits of the hash and
+ * an empty marker) in front of the hash table. Probing scans the tags a group
+ * of slots at a time (with SSE2/AVX2 when available) and only touches the
+ * store table for slots whose tag matches, so most collisions and misses
+ * never leave the tag array.
+ *
+ * DHT_OPT_ROBIN_HOOD: insert with Robin Hood displacement (an entry far from
+ * its home slot takes the place of one closer to its own) and delete by
+ * shifting the following entries back. This bounds probe lengths, lets
+ * lookups for absent keys stop early, and allows the table to be filled up to
+ * 85% (instead of 50%) before it is grown.
+ *
+ * DHT_OPT_FINGERPRINTS: store 32 bits of the hash next to each slot of the
+ * hash table (doubling its size). Slots whose fingerprint differs from the
+ * key's are skipped without reading the store table, so lookups for absent
+ * keys are resolved within the hash table itself.
+ *
+ * DHT_OPT_FASTRANGE: map hashes to slots with a multiplication instead of a
+ * 64-bit division (which is the single most expensive step of a lookup that
+ * hits in cache). The hash is mixed first so this spreads keys as well as the
+ * default.
+ *
+ * DHT_OPT_WYHASH: hash keys with wyhash, which reads 8 bytes at a time,
+ * instead of the byte-at-a-time djb2 of older tables.
+ *
+ * DHT_OPT_CRC32C_HASH: hash keys with CRC32C, computed with the crc32
+ * instruction when diskhash is built for a CPU that has it (SSE4.2, ARMv8
+ * CRC) and with a lookup table otherwise. It is the fastest option on such
+ * CPUs, but only has 32 bits of entropy. At most one of the two hash options
+ * can be given.
+ *
+ * DHT_OPT_KEY_LENGTHS: store the length of each key with it. Keys are then
+ * compared by length and memcmp(), and keys inserted with dht_insert_n may
+ * contain NUL bytes.
+ *
+ * DHT_OPT_KEY_ARENA: keep keys longer than 16 bytes in an append-only arena
+ * at the end of the file, so that each store entry only reserves 16 bytes for
+ * its key, whatever key_maxlen is. Shorter keys stay in the entry; for longer
+ * ones, the entry has their first 8 bytes and their position in the arena.
+ * Space used by deleted keys is recovered when the table is grown. Requires
+ * DHT_OPT_KEY_LENGTHS.
+ *
+ * DHT_OPT_FIXED_KEYS: all keys are binary strings of exactly key_maxlen bytes
+ * (at least 8), such as hash digests. They are stored without a terminator,
+ * compared with a fixed-size memcmp(), and their first 8 bytes are used as
+ * their hash, so they must already be uniformly distributed. The functions
+ * that take NUL-terminated keys read key_maxlen bytes instead. Cannot be
+ * combined with a hash function option, DHT_OPT_KEY_LENGTHS or
+ * DHT_OPT_KEY_ARENA.
+ *
+ * DHT_OPT_CUCKOO: use bucketized cuckoo hashing instead of linear probing.
+ * The hash table is split into buckets of 8 slots and every key is in one of
+ * two buckets chosen by its hash, so a lookup reads at most two buckets (one
+ * cache line each with DHT_OPT_FINGERPRINTS, which is recommended, while the
+ * table has fewer than 2^32 slots) however full the table is. Inserting into
+ * two full buckets moves other entries to their alternative bucket. Tables
+ * are filled up to 90% before they are grown. Cannot be combined with
+ * DHT_OPT_CONTROL_BYTES or DHT_OPT_ROBIN_HOOD.
+ *
+ * DHT_OPT_COLUMNAR: split the store table into three arrays: the keys, the
+ * data, and the per-entry bookkeeping (probe offset and key length). Key
+ * comparisons then only bring keys into the cache, and walking over the data
+ * (e.g., with dht_indexed_lookup) reads it contiguously.
+ *
+ * DHT_OPT_HUGE_PAGES: back the table with 2 MB pages, so that random lookups
+ * in large tables do not miss the TLB on almost every access. The hash table
+ * and store table start on 2 MB boundaries in the file, the file is mapped at
+ * a 2 MB aligned address with madvise(MADV_HUGEPAGE), and dht_load_to_memory
+ * takes its memory from the hugetlbfs pool (MAP_HUGETLB), or transparent huge
+ * pages if the pool is empty. Whether the kernel actually provides huge pages
+ * for file mappings depends on the file system and system settings; use
+ * dht_huge_page_bytes to check.
+ *
+ * DHT_OPT_STORED_HASHES: store the full 64-bit hash of each key with it (8
+ * more bytes per entry). Growing the table then places the entries without
+ * reading (or hashing) their keys again, and probes skip entries whose hash
+ * differs before comparing keys.
+ *
+ * DHT_OPT_INLINE: keep each entry (key, data and bookkeeping) in its hash
+ * table slot, with no separate index. A probe then reads the entry itself
+ * instead of going from the index to the store table, so a lookup of a small
+ * entry costs a single cache miss. Every slot takes the space of a whole
+ * entry and tables are grown at their maximum load (max_load_percent, 50% by
+ * default), so this suits small keys and data. dht_slots_used is then the
+ * number of slots, dht_dirty_slots the number of empty ones, and
+ * dht_indexed_lookup follows slot order. Cannot be combined with
+ * DHT_OPT_CONTROL_BYTES, DHT_OPT_ROBIN_HOOD, DHT_OPT_FINGERPRINTS,
+ * DHT_OPT_CUCKOO, DHT_OPT_KEY_ARENA or DHT_OPT_COLUMNAR.
+ *
+ * DHT_OPT_COMPACT: use as few bytes for the hash table slots as the capacity
+ * allows (from 2 bytes, up to 5 or 6 bytes above 2^32 entries, instead of 4
+ * or 8 bytes) and keep the probe offset of each entry in a single byte after
+ * its key (instead of 4 or 8 bytes of its own). Offsets of 255 or more are
+ * then recomputed from the hash of the key when needed, which is rare.
+ * Cannot be combined with DHT_OPT_FINGERPRINTS.
+ */
+enum {
+    DHT_OPT_CONTROL_BYTES = 1,
+    DHT_OPT_ROBIN_HOOD = 2,
+    DHT_OPT_FINGERPRINTS = 4,
+    DHT_OPT_FASTRANGE = 8,
+    DHT_OPT_WYHASH = 16,
+    DHT_OPT_CRC32C_HASH = 32,
+    DHT_OPT_KEY_LENGTHS = 64,
+    DHT_OPT_KEY_ARENA = 128,
+    DHT_OPT_FIXED_KEYS = 256,
+    DHT_OPT_CUCKOO = 512,
+    DHT_OPT_COLUMNAR = 1024,
+    DHT_OPT_HUGE_PAGES = 2048,
+    DHT_OPT_STORED_HASHES = 4096,
+    DHT_OPT_INLINE = 8192,
+    DHT_OPT_COMPACT = 16384,
+};
+
 /**
  * key_maxlen is the maximum key length not including the terminator NUL, i.e.,
  * diskhash will check that for every key you insert `strlen(key) <
- * opts.key_maxlen`.
+ * opts.key_maxlen` (with DHT_OPT_FIXED_KEYS, it is the length of every key).
  *
  * Internally, space is allocated on 8-Byte aligned boundaries, so numbers such
  * as 7, 15, 23, 31, ... (i.e., multiples of 8 minus 1 for NUL) are good
  * choices for key_maxlen.
  *
  * object_datalen is the number of Bytes that your data elements occupy.
+ *
+ * flags is a combination of the DHT_OPT_* values above (0 for the default
+ * format).
+ *
+ * The last three fields set how the table is sized (0 for the defaults):
+ *
+ * initial_capacity is the number of entries that the new table has room for
+ * before it first grows (by default, 3), so that tables whose final size is
+ * known can be loaded without growing. dht_open fails if it is more than the
+ * largest table can hold.
+ *
+ * max_load_percent is how full (in percent of its slots, from 10 to 95) the
+ * hash table gets before it is grown: lower values make probe sequences
+ * shorter and higher ones save space. It defaults to 50 (85 with
+ * DHT_OPT_ROBIN_HOOD and 90 with DHT_OPT_CUCKOO).
+ *
+ * growth_percent is the capacity of the grown table, in percent of that of
+ * the full one (from 101 to 1000; e.g., 400 to grow 4 times larger). By
+ * default, and at least, the number of slots goes up to the next of a fixed
+ * series of primes, each about 1.7 times the one before.
+ *
+ * max_load_percent and growth_percent are stored in the table (which then
+ * uses the version 1.2 file format) and apply whenever it grows, while
+ * initial_capacity is only used when the table is created.
+ *
+ * Always start from `dht_zero_opts()` so that fields you do not care about
+ * are zero.
  */
 typedef struct HashTableOpts {
     size_t key_maxlen;
     size_t object_datalen;
+    unsigned int flags;
+    size_t initial_capacity;
+    unsigned int max_load_percent;
+    unsigned int growth_percent;
 } HashTableOpts;
 
+/* Offsets of the table regions within HashTable.data_ (internal use) */
+typedef struct HashTableLayout {
+    size_t tags_;
+    size_t index_;
+    size_t store_;
+    size_t values_;
+    size_t meta_;
+    size_t dirty_;
+    size_t arena_;
+    size_t total_;
+} HashTableLayout;
+
+/* State of an incremental growth (internal use, see dht_set_growth_step) */
+struct HashTableGrowth;
+
+/* Lookup counts (internal use, see dht_sample_accesses) */
+struct HashTableSketch;
+
 typedef struct HashTable {
     dht_file_t fd_;
     const char* fname_;
     void* data_;
     size_t datasize_;
     int flags_;
+    unsigned int format_;
+    HashTableLayout layout_;
+    size_t growth_step_;
+    struct HashTableGrowth* growth_;
+    unsigned int rebuild_threads_;
+    struct HashTableSketch* sketch_;
 } HashTable;
 
 
@@ -48,7 +223,7 @@ HashTableOpts dht_zero_opts(void);
  *
  * Read-write:
  *
- *      HashTableOpts opts;
+ *      HashTableOpts opts = dht_zero_opts();
  *      opts.key_maxlen = 15;
  *      opts.object_datalen = 8;
  *      char* err;
@@ -64,7 +239,8 @@ HashTableOpts dht_zero_opts(void);
  * taken from the table on disk. If you do pass values > 0, they are checked
  * against the values on disk and it is an error if there is a mismatch
  * (passing zero to one of the option fields and not the other is supported:
- * only the non-zero field is checked).
+ * only the non-zero field is checked). The same holds for `flags`,
+ * `max_load_percent` and `growth_percent`; `initial_capacity` is ignored.
  *
  * The last argument is an error output argument. If it is set to a non-NULL
  * value, then the memory must be released with free(). Passing NULL is valid
@@ -95,12 +271,35 @@ int dht_load_to_memory(HashTable*, char**);
  *
  * If the object is not found, returns NULL.
  *
- * Thread safety: multiple concurrent reads are perfectly safe. No guarantees
- * are given whenever writing is performed. Similarly, if you write to the
- * output of this function (the ht_data field), no guarantees are given.
+ * Thread safety: multiple concurrent reads are perfectly safe, except while
+ * lookups are counted (see dht_sample_accesses). No guarantees are given
+ * whenever writing is performed. Similarly, if you write to the output of
+ * this function (the ht_data field), no guarantees are given.
  */
 void* dht_lookup(const HashTable*, const char* key);
 
+/** Lookup a value by key, given as `len` bytes (not NUL-terminated)
+ *
+ * Same as dht_lookup, but the key length does not need to be computed.
+ * Unless the table was created with DHT_OPT_KEY_LENGTHS, keys containing NUL
+ * bytes are never found.
+ */
+void* dht_lookup_n(const HashTable*, const char* key, size_t len);
+
+/** Lookup many keys at once
+ *
+ * Sets out[i] to dht_lookup(ht, keys[i]) for every i < n, but is faster than
+ * calling dht_lookup in a loop when the table does not fit in the CPU caches:
+ * the memory that the lookups will read is prefetched for several keys at a
+ * time, so that their cache misses overlap.
+ *
+ * Returns the number of keys found (non-NULL entries of out).
+ *
+ * Thread safety: as dht_lookup (in particular, not safe to call concurrently
+ * while lookups are counted, see dht_sample_accesses).
+ */
+size_t dht_lookup_batch(const HashTable*, const char* const* keys, size_t n, void** out);
+
 /** Insert a value.
  *
  * The hashtable must be opened in read write mode.
@@ -132,6 +331,13 @@ void* dht_lookup(const HashTable*, const char* key);
  */
 int dht_insert(HashTable*, const char* key, const void* data, char** err);
 
+/** Insert a value with a key given as `len` bytes (not NUL-terminated)
+ *
+ * Same as dht_insert. It is an error (-EINVAL) to insert a key that contains
+ * NUL bytes unless the table was created with DHT_OPT_KEY_LENGTHS.
+ */
+int dht_insert_n(HashTable*, const char* key, size_t len, const void* data, char** err);
+
 /** Update a value.
  *
  * The hashtable must be opened in read write mode.
@@ -159,6 +365,9 @@ int dht_update(HashTable* ht, const char* key, const void* data, char** err);
  * If the given key is not present in the table, then no action is performed
  * and 0 is returned.
  *
+ * The data of the other keys is not moved (except in DHT_OPT_INLINE tables),
+ * so pointers to it returned by dht_lookup stay valid.
+ *
  * Returns 1 if the value was deleted.
  *         0 if the key is not found in the table.
  *         -EINVAL : invalid arguments. Check the *err field for details.
@@ -174,6 +383,12 @@ int dht_update(HashTable* ht, const char* key, const void* data, char** err);
  */
 int dht_delete(HashTable* ht, const char* key, char** err);
 
+/** Delete a value by key, given as `len` bytes (not NUL-terminated)
+ *
+ * Same as dht_delete (see dht_insert_n regarding NUL bytes).
+ */
+int dht_delete_n(HashTable* ht, const char* key, size_t len, char** err);
+
 /** Preallocate memory for the table.
  *
  * Calling this function if the number of elements is known apriori can improve
@@ -189,14 +404,154 @@ int dht_delete(HashTable* ht, const char* key, char** err);
  * This function can be used to query the current capacity by passing the value
  * 1 as the desired capacity.
  *
+ * Tables normally grow within their own file: the file is extended, the
+ * entries are moved to their new offsets (keeping their indices) and only the
+ * hash table is rebuilt. Cuckoo tables, DHT_OPT_INLINE tables, version 1.0
+ * tables and tables whose capacity crosses 2^32 are instead copied to a new
+ * file that replaces the old one (this also drops deleted entries).
+ *
  * The last argument is an error output argument. If it is set to a non-NULL
  * value, then the memory must be released with free(). Passing NULL is valid
  * (and no error message will be produced).
  */
 size_t dht_reserve(HashTable*, size_t capacity, char** err);
 
+/** Shrink the table to fit its entries
+ *
+ * Copies the entries to a new file with the smallest capacity that holds
+ * them, with no deleted entries (see dht_dirty_slots) and only the keys still
+ * in use in the key arena, and replaces the table file with it. Entries keep
+ * their relative order in the store table, but not their indices (see
+ * dht_indexed_lookup). Does nothing if the table is already as small as it
+ * can be.
+ *
+ * If an incremental growth step is set (see dht_set_growth_step), the
+ * entries are copied to the new table incrementally, as when growing.
+ *
+ * Returns 1 on success.
+ *         -EACCES : the table is read-only.
+ *         -ENOMEM : the new table could not be created or written.
+ *         -EIO : the new table file could not replace the old one.
+ *
+ * The last argument is an error output argument (see dht_insert).
+ */
+int dht_shrink_to_fit(HashTable*, char** err);
+
+/** Store the entries in hash table order
+ *
+ * Entries are normally stored in the order in which they were inserted, so a
+ * lookup reads the hash table and a store entry that is anywhere else in the
+ * file. This copies the table to a new file in which the entries are stored
+ * in the order of their hash table slots (until more entries are inserted),
+ * so that entries whose slots are close are close in the store table too:
+ * lookups for neighbouring keys share pages, and readahead brings in useful
+ * entries. This matters most when the table does not fit in memory. Deleted
+ * entries are dropped, as by dht_shrink_to_fit, but the capacity does not
+ * change. Entries of DHT_OPT_INLINE tables are always in slot order, so this
+ * does nothing for them.
+ *
+ * Returns 1 on success (or an error code, as dht_shrink_to_fit).
+ *
+ * The last argument is an error output argument (see dht_insert).
+ */
+int dht_relayout(HashTable*, char** err);
+
+/** Count lookups
+ *
+ * Starts counting (in memory) how often each key is found: one successful
+ * lookup in `rate` is counted in a count-min sketch of 4 rows of 32-bit
+ * counters, with about as many counters per row as the table has capacity.
+ * The counts are estimates (they can be too high, never too low) and are
+ * used by dht_relayout_by_access. A rate of 0 stops counting and drops the
+ * counts. Calling this function again with another rate keeps the counts.
+ *
+ * While counting, lookups write to the sketch, so the table must not be
+ * looked up from several threads at once. The counts are not saved to the
+ * file.
+ *
+ * Returns 1 on success.
+ *         -ENOMEM : the sketch could not be allocated.
+ *
+ * The last argument is an error output argument (see dht_insert).
+ */
+int dht_sample_accesses(HashTable*, unsigned int rate, char** err);
+
+/** Store the most looked up entries first
+ *
+ * Like dht_relayout, but the entries are stored in decreasing order of their
+ * lookup counts (see dht_sample_accesses), so that the entries that are
+ * looked up most often are packed together at the start of the store table
+ * and need fewer pages to be kept in memory. Entries that were not counted
+ * keep their order, after the others. The counts are then halved, so that
+ * they follow changes in which keys are popular. Entries of DHT_OPT_INLINE
+ * tables stay in their slots, so for them only the counts change.
+ *
+ * Returns 1 on success.
+ *         -EINVAL : lookups are not being counted.
+ * Other errors are those of dht_shrink_to_fit.
+ *
+ * The last argument is an error output argument (see dht_insert).
+ */
+int dht_relayout_by_access(HashTable*, char** err);
+
+/** Use several threads to rebuild the hash table
+ *
+ * When a table grows in place (see dht_reserve), its keys are hashed and
+ * placed again by this many threads: each one takes a range of the store
+ * table to hash and then a range of the hash table to fill. Probes that run
+ * past the end of a range are finished by a single thread afterwards.
+ *
+ * 0 means one thread per online CPU. The default is 1. Tables with fewer than
+ * 65536 entries (and systems without POSIX threads) always use a single
+ * thread. The setting is not saved to the file.
+ *
+ * Returns 1 on success.
+ *
+ * The last argument is an error output argument (see dht_insert).
+ */
+int dht_set_rebuild_threads(HashTable*, unsigned int threads, char** err);
+
+/** Grow the table incrementally
+ *
+ * By default, an insertion that finds the table full calls dht_reserve, which
+ * copies every entry to a larger table before returning. After calling this
+ * function with a non-zero step, that insertion instead starts building the
+ * larger table next to the current one and returns; every insertion or
+ * deletion after it then copies (at least) step more entries until all have
+ * been copied, at which point the larger table replaces the old one. The step
+ * is raised automatically when needed to finish before the new table fills.
+ *
+ * Lookups check both tables and never copy entries. Until the growth
+ * finishes, changes are written to a temporary file next to the table file;
+ * dht_free (as well as dht_reserve, dht_advise and dht_indexed_lookup)
+ * finishes a pending growth first. See also dht_finish_growth.
+ *
+ * A step of 0 restores the default behaviour (finishing any pending growth).
+ * The step is not saved to the file.
+ *
+ * Returns 1 on success or a negative error code (see dht_finish_growth).
+ *
+ * The last argument is an error output argument (see dht_insert).
+ */
+int dht_set_growth_step(HashTable*, size_t step, char** err);
+
+/** Finish a pending incremental growth now
+ *
+ * Copies all remaining entries to the new table and replaces the table file
+ * with it. Does nothing if no growth is pending.
+ *
+ * Returns 1 on success.
+ *         -ENOMEM : the new table could not be written.
+ *         -EIO : the new table file could not replace the old one.
+ *
+ * The last argument is an error output argument (see dht_insert).
+ */
+int dht_finish_growth(HashTable*, char** err);
+
 /**
  * Return the number of elements
+ *
+ * During an incremental growth, this counts the elements of both tables.
  */
 size_t dht_size(const HashTable*);
 
@@ -211,15 +566,74 @@ size_t dht_size(const HashTable*);
 /** Number of dirty slots.
  *
  * Returns the number of dirty slots (soft-deleted slots that were not filled
- * again).
+ * again). During an incremental growth, this and dht_capacity refer to the
+ * new table.
  */
 size_t dht_dirty_slots (const HashTable* ht);
 
+/** Regions of a table file (bit flags for dht_advise)
+ *
+ * DHT_REGION_INDEX: the hash table (with its control bytes or fingerprints),
+ * which every lookup probes.
+ * DHT_REGION_STORE: the store table (keys and values).
+ * DHT_REGION_DIRTY: the list of deleted store entries.
+ * DHT_REGION_ARENA: the key arena (DHT_OPT_KEY_ARENA tables).
+ */
+enum {
+    DHT_REGION_INDEX = 1,
+    DHT_REGION_STORE = 2,
+    DHT_REGION_DIRTY = 4,
+    DHT_REGION_ARENA = 8,
+    DHT_REGION_ALL = 15,
+};
+
+/** Access pattern advice (for dht_advise) */
+enum {
+    DHT_ADVICE_NORMAL = 0,
+    DHT_ADVICE_RANDOM = 1,
+    DHT_ADVICE_SEQUENTIAL = 2,
+    DHT_ADVICE_WILLNEED = 3,
+    DHT_ADVICE_COLD = 4,
+    DHT_ADVICE_PAGEOUT = 5,
+};
+
+/** Tell the OS how some regions of the table will be accessed.
+ *
+ * regions is a combination of DHT_REGION_* values and advice is one of
+ *
+ * DHT_ADVICE_NORMAL: the default (undoes earlier advice).
+ * DHT_ADVICE_RANDOM: point lookups; disables readahead.
+ * DHT_ADVICE_SEQUENTIAL: scans; reads ahead aggressively.
+ * DHT_ADVICE_WILLNEED: start reading the region in now (e.g., to warm up the
+ * index before serving lookups).
+ * DHT_ADVICE_COLD: the region will not be needed soon; its pages are the first
+ * to be reclaimed under memory pressure.
+ * DHT_ADVICE_PAGEOUT: reclaim the region's pages now.
+ *
+ * This uses madvise() on the mapping and posix_fadvise() on the file. On
+ * systems that have neither, it does nothing.
+ *
+ * Returns 1 if the advice was applied.
+ *         -EINVAL : unknown region or advice.
+ *         -ENOTSUP : the advice is not supported on this system.
+ *         other negative errno values: madvise() or posix_fadvise() failed.
+ *
+ * The last argument is an error output argument (see dht_insert).
+ */
+int dht_advise(HashTable* ht, int regions, int advice, char** err);
+
+/** Number of bytes of the table's memory that are backed by huge pages.
+ *
+ * Only Linux reports this (it is read from /proc/self/smaps); elsewhere, 0 is
+ * returned.
+ */
+size_t dht_huge_page_bytes (const HashTable* ht);
+
 /** Number of used slots.
  *
  * Returns the number of slots that have already been touched. The number is
  * equal the number of dirty_slots + the number of valid elements (table's
- * size).
+ * size). During an incremental growth, it refers to the new table.
  */
 size_t dht_slots_used (const HashTable* ht);
 
@@ -234,6 +648,10 @@ size_t dht_slots_used (const HashTable* ht);
  * The current sequence number N is equal to dht_size(), so the accessible
  * range is [0,N).
  *
+ * For tables created with DHT_OPT_KEY_LENGTHS, the whole key (which may
+ * contain NUL bytes) is copied to *key, followed by a NUL. For tables created
+ * with DHT_OPT_FIXED_KEYS, exactly key_maxlen bytes are copied.
+ *
  * Returns 1 if the key/value was accessed.
  *         -EINVAL : The index is out-of-range.
  *         -EFAULT : The informed index doesn't contain any data.
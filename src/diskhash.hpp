@@ -4,6 +4,7 @@
 #include "diskhash.h"
 #include "os_wrappers.h"
 
+#include <algorithm>
 #include <cinttypes>
 #include <cassert>
 #include <stdexcept>
@@ -38,7 +39,7 @@ private:
         } else {
             flags = O_RDWR;
         }
-        HashTableOpts opts;
+        HashTableOpts opts = dht_zero_opts();
         opts.key_maxlen = keysize;
         opts.object_datalen = sizeof(T);
         ht_ = dht_open(fname, opts, flags, &err);
@@ -82,17 +83,55 @@ public:
      */
     bool is_member(const char* key) const { return const_cast<DiskHash<T>*>(this)->lookup(key); }
 
+    /**
+     * Check if key (of length len) is a member
+     */
+    bool is_member(const char* key, size_t len) const { return const_cast<DiskHash<T>*>(this)->lookup(key, len); }
+
     /**
      * Return a pointer to the element (if present, otherwise nullptr).
      *
      * Note that if the diskhash was not opened in read-write mode, then
      * the memory will not be writeable.
+     *
+     * Concurrent lookups are safe, except while lookups are counted (see
+     * dht_sample_accesses).
      */
     T* lookup(const char* key) {
         if (!ht_) return nullptr;
         return static_cast<T*>(dht_lookup(ht_, key));
     }
 
+    /**
+     * Same as lookup(key), for a key of length len (see dht_lookup_n)
+     */
+    T* lookup(const char* key, size_t len) {
+        if (!ht_) return nullptr;
+        return static_cast<T*>(dht_lookup_n(ht_, key, len));
+    }
+
+    /**
+     * Lookup n keys at once: out[i] is set to lookup(keys[i]) (see
+     * dht_lookup_batch).
+     *
+     * Returns the number of keys found. As for lookup(), concurrent calls are
+     * not safe while lookups are counted (see dht_sample_accesses).
+     */
+    size_t lookup_many(const char* const* keys, size_t n, T** out) {
+        if (!ht_) {
+            std::fill(out, out + n, nullptr);
+            return 0;
+        }
+        void* found[64];
+        size_t nr_found = 0;
+        for (size_t start = 0; start < n; start += 64) {
+            const size_t chunk = std::min<size_t>(n - start, 64);
+            nr_found += dht_lookup_batch(ht_, keys + start, chunk, found);
+            for (size_t i = 0; i != chunk; ++i) out[start + i] = static_cast<T*>(found[i]);
+        }
+        return nr_found;
+    }
+
     /**
      * Delete an element.
      *
@@ -106,21 +145,17 @@ public:
         if (!ht_) return false;
         char* err = nullptr;
         const int ret_delete = dht_delete(ht_, key, &err);
-        if (ret_delete == 1) {
-            std::free(err);
-            return true;
-        }
-        if (ret_delete == 0) {
-            std::free(err);
-            return false;
-        }
-        auto error = std::string(err);
-        if (ret_delete == -EINVAL) {
-            std::free(err);
-            throw std::invalid_argument(error);
-        }
-        std::free(err);
-        throw std::runtime_error(error);
+        return removal_result(ret_delete, err);
+    }
+
+    /**
+     * Same as remove(key), for a key of length len (see dht_delete_n)
+     */
+    bool remove(const char* key, size_t len) {
+        if (!ht_) return false;
+        char* err = nullptr;
+        const int ret_delete = dht_delete_n(ht_, key, len, &err);
+        return removal_result(ret_delete, err);
     }
 
     /**
@@ -139,6 +174,19 @@ public:
         throw std::runtime_error(error);
     }
 
+    /**
+     * Same as insert(key, val), for a key of length len (see dht_insert_n)
+     */
+    bool insert(const char* key, size_t len, const T& val) {
+        char* err = nullptr;
+        const int icode = dht_insert_n(ht_, key, len, &val, &err);
+        if (icode <= 0) {
+            std::free(err);
+            return false;
+        }
+        return true;
+    }
+
     /**
      * Insert an element
      *
@@ -196,6 +244,123 @@ public:
         throw std::runtime_error(error);
      }
 
+    /**
+     * Incremental growth.
+     *
+     * Once the table is full, every insertion or deletion copies (at least)
+     * step entries to a larger table instead of one insertion copying them
+     * all (see dht_set_growth_step). A step of 0 restores the default.
+     */
+     void set_growth_step(size_t step) {
+        char* err = nullptr;
+        if (dht_set_growth_step(ht_, step, &err) == 1) {
+            return;
+        }
+        throw_growth_error(err);
+     }
+
+    /**
+     * Finishes a pending incremental growth (see dht_finish_growth).
+     */
+     void finish_growth() {
+        char* err = nullptr;
+        if (dht_finish_growth(ht_, &err) == 1) {
+            return;
+        }
+        throw_growth_error(err);
+     }
+
+    /**
+     * Shrinks the table to the smallest capacity that holds its entries,
+     * dropping deleted ones (see dht_shrink_to_fit).
+     */
+     void shrink_to_fit() {
+        char* err = nullptr;
+        if (dht_shrink_to_fit(ht_, &err) == 1) {
+            return;
+        }
+        if (!err) { throw std::bad_alloc(); }
+        std::string error = "Error shrinking table: " + std::string(err);
+        std::free(err);
+        throw std::runtime_error(error);
+     }
+
+    /**
+     * Stores the entries in the order of their hash table slots, for
+     * locality of lookups (see dht_relayout).
+     */
+     void relayout() {
+        char* err = nullptr;
+        if (dht_relayout(ht_, &err) == 1) {
+            return;
+        }
+        if (!err) { throw std::bad_alloc(); }
+        std::string error = "Error reordering table entries: " + std::string(err);
+        std::free(err);
+        throw std::runtime_error(error);
+     }
+
+    /**
+     * Counts one lookup in every rate (0 stops counting; see
+     * dht_sample_accesses).
+     */
+     void sample_accesses(unsigned int rate) {
+        char* err = nullptr;
+        if (dht_sample_accesses(ht_, rate, &err) == 1) {
+            return;
+        }
+        if (!err) { throw std::bad_alloc(); }
+        std::string error = "Error counting lookups: " + std::string(err);
+        std::free(err);
+        throw std::runtime_error(error);
+     }
+
+    /**
+     * Stores the most looked up entries first (see dht_relayout_by_access).
+     */
+     void relayout_by_access() {
+        char* err = nullptr;
+        if (dht_relayout_by_access(ht_, &err) == 1) {
+            return;
+        }
+        if (!err) { throw std::bad_alloc(); }
+        std::string error = "Error reordering table entries: " + std::string(err);
+        std::free(err);
+        throw std::runtime_error(error);
+     }
+
+    /**
+     * Number of threads used to rebuild the index when the table grows
+     * (0 for one per CPU; see dht_set_rebuild_threads).
+     */
+     void set_rebuild_threads(unsigned int threads) {
+        char* err = nullptr;
+        if (dht_set_rebuild_threads(ht_, threads, &err) == 1) {
+            return;
+        }
+        if (!err) { throw std::bad_alloc(); }
+        std::string error = "Error setting rebuild threads: " + std::string(err);
+        std::free(err);
+        throw std::runtime_error(error);
+     }
+
+    /**
+     * Access pattern advice.
+     *
+     * Tells the OS how the given regions (DHT_REGION_* values) of the table
+     * will be used (one of the DHT_ADVICE_* values). See dht_advise.
+     */
+     void advise(int regions, int advice) {
+        char* err = nullptr;
+        if (dht_advise(ht_, regions, advice, &err) == 1) {
+            return;
+        }
+        if (!err) { throw std::bad_alloc(); }
+        std::string error = "Error applying access pattern advice: " + std::string(err);
+        std::free(err);
+        throw std::runtime_error(error);
+     }
+
     /**
      * Returns the table's size.
      */
@@ -233,14 +398,42 @@ public:
     struct iterator;
 
     iterator begin() const {
+        // iteration walks the store table, which only holds all entries once growth is finished
+        const_cast<DiskHash<T>*>(this)->finish_growth();
         return iterator(0, *this);
     }
 
     iterator end() const {
+        const_cast<DiskHash<T>*>(this)->finish_growth();
         return iterator(used_slots(), *this);
     }
 
 private:
+    void throw_growth_error(char* err) {
+        if (!err) { throw std::bad_alloc(); }
+        std::string error = "Error growing table: " + std::string(err);
+        std::free(err);
+        throw std::runtime_error(error);
+    }
+
+    bool removal_result(const int ret_delete, char* err) {
+        if (ret_delete == 1) {
+            std::free(err);
+            return true;
+        }
+        if (ret_delete == 0) {
+            std::free(err);
+            return false;
+        }
+        auto error = std::string(err);
+        if (ret_delete == -EINVAL) {
+            std::free(err);
+            throw std::invalid_argument(error);
+        }
+        std::free(err);
+        throw std::runtime_error(error);
+    }
+
     /**
      * Returns the number of used slots.
      */
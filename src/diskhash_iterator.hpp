@@ -5,6 +5,7 @@
 
 #include <cstring>
 #include <iterator>
+#include <limits>
 #include <utility>
 #include <algorithm>
 #include <memory>
@@ -0,0 +1,178 @@
+/* Lookup-heavy microbenchmark
+ *
+ * Usage: diskhashbench [nr_keys [nr_lookups [key_length]]]
+ *
+ * For each table format, inserts nr_keys keys and then times nr_lookups
+ * lookups (half for keys that are present, half for keys that are not), first
+ * one at a time with dht_lookup and then BATCH_SIZE at a time with
+ * dht_lookup_batch. The best of BENCH_ROUNDS rounds is reported.
+ *
+ * Keys are decimal numbers, zero-padded to key_length characters (default 16,
+ * at most MAX_KEY_LENGTH).
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "diskhash.h"
+
+static const char* BENCH_FILE = "diskhashbench.dht";
+static const int BENCH_ROUNDS = 5;
+
+/* Small enough that the probe keys stay in L1/L2 and do not dominate */
+static const size_t MAX_PROBE_KEYS = 2048;
+
+/* Number of keys passed to each dht_lookup_batch call */
+#define BATCH_SIZE 256
+
+#define MAX_KEY_LENGTH 127
+static int key_length = 16;
+
+typedef struct BenchFormat {
+    const char* name;
+    unsigned int flags;
+} BenchFormat;
+
+static const BenchFormat formats[] = {
+    { "default", 0 },
+    { "fastrange", DHT_OPT_FASTRANGE },
+    { "control-bytes", DHT_OPT_CONTROL_BYTES },
+    { "control-bytes+fastrange", DHT_OPT_CONTROL_BYTES | DHT_OPT_FASTRANGE },
+    { "robin-hood+fingerprints", DHT_OPT_ROBIN_HOOD | DHT_OPT_FINGERPRINTS },
+    { "robin-hood+fingerprints+fastrange", DHT_OPT_ROBIN_HOOD | DHT_OPT_FINGERPRINTS | DHT_OPT_FASTRANGE },
+    { "wyhash+fastrange", DHT_OPT_WYHASH | DHT_OPT_FASTRANGE },
+    { "crc32c+fastrange", DHT_OPT_CRC32C_HASH | DHT_OPT_FASTRANGE },
+    { "control-bytes+wyhash+fastrange", DHT_OPT_CONTROL_BYTES | DHT_OPT_WYHASH | DHT_OPT_FASTRANGE },
+    { "key-arena+wyhash+fastrange", DHT_OPT_KEY_ARENA | DHT_OPT_KEY_LENGTHS | DHT_OPT_WYHASH | DHT_OPT_FASTRANGE },
+    { "cuckoo+fingerprints+fastrange", DHT_OPT_CUCKOO | DHT_OPT_FINGERPRINTS | DHT_OPT_FASTRANGE },
+    { "columnar+fastrange", DHT_OPT_COLUMNAR | DHT_OPT_FASTRANGE },
+    { "stored-hashes+fastrange", DHT_OPT_STORED_HASHES | DHT_OPT_FASTRANGE },
+    { "inline+fastrange", DHT_OPT_INLINE | DHT_OPT_FASTRANGE },
+    { "compact+fastrange", DHT_OPT_COMPACT | DHT_OPT_FASTRANGE },
+};
+
+static
+void make_key(char* buffer, size_t i) {
+    sprintf(buffer, "%0*zu", key_length, i);
+}
+
+static
+double elapsed_ns(clock_t start, clock_t end) {
+    return (double)(end - start) * 1e9 / CLOCKS_PER_SEC;
+}
+
+static
+int run(const BenchFormat* format, size_t nr_keys, size_t nr_lookups) {
+    HashTableOpts opts = dht_zero_opts();
+    opts.key_maxlen = MAX_KEY_LENGTH + 1;
+    opts.object_datalen = sizeof(uint64_t);
+    opts.flags = format->flags;
+    char* err = NULL;
+    char key[MAX_KEY_LENGTH + 1];
+    size_t i;
+
+    remove(BENCH_FILE);
+    HashTable* ht = dht_open(BENCH_FILE, opts, O_RDWR|O_CREAT, &err);
+    if (!ht) {
+        fprintf(stderr, "Failed opening hash table: %s.\n", err);
+        free(err);
+        return 1;
+    }
+    if (!dht_reserve(ht, nr_keys, &err)) {
+        fprintf(stderr, "Failed reserving space: %s.\n", err);
+        free(err);
+        dht_free(ht);
+        return 1;
+    }
+    clock_t start = clock();
+    for (i = 0; i < nr_keys; ++i) {
+        uint64_t value = i;
+        make_key(key, i);
+        dht_insert(ht, key, &value, NULL);
+    }
+    const double insert_ns = elapsed_ns(start, clock());
+
+    /* keys are generated before timing so that only the lookups are measured */
+    const size_t nr_distinct = nr_keys < MAX_PROBE_KEYS ? nr_keys : MAX_PROBE_KEYS;
+    char (*keys)[MAX_KEY_LENGTH + 1] = malloc(2 * nr_distinct * sizeof(*keys));
+    const char** key_ptrs = malloc(2 * nr_distinct * sizeof(*key_ptrs));
+    if (!keys || !key_ptrs) {
+        free(keys);
+        free(key_ptrs);
+        dht_free(ht);
+        return 1;
+    }
+    for (i = 0; i < nr_distinct; ++i) {
+        make_key(keys[2 * i], (size_t)rand() % nr_keys);
+        make_key(keys[2 * i + 1], nr_keys + (size_t)rand() % nr_keys);
+    }
+    for (i = 0; i < 2 * nr_distinct; ++i) key_ptrs[i] = keys[i];
+    size_t found = 0;
+    double lookup_ns = 0.;
+    int round;
+    for (round = 0; round < BENCH_ROUNDS; ++round) {
+        found = 0;
+        start = clock();
+        for (i = 0; i < nr_lookups; ++i) {
+            found += dht_lookup(ht, keys[i % (2 * nr_distinct)]) != NULL;
+        }
+        const double round_ns = elapsed_ns(start, clock());
+        if (round == 0 || round_ns < lookup_ns) lookup_ns = round_ns;
+    }
+
+    void* out[BATCH_SIZE];
+    size_t batch_found = 0;
+    double batch_ns = 0.;
+    for (round = 0; round < BENCH_ROUNDS; ++round) {
+        size_t next = 0;
+        batch_found = 0;
+        start = clock();
+        for (i = 0; i < nr_lookups; ) {
+            size_t n = nr_lookups - i;
+            if (n > BATCH_SIZE) n = BATCH_SIZE;
+            if (n > 2 * nr_distinct - next) n = 2 * nr_distinct - next;
+            batch_found += dht_lookup_batch(ht, key_ptrs + next, n, out);
+            i += n;
+            next += n;
+            if (next == 2 * nr_distinct) next = 0;
+        }
+        const double round_ns = elapsed_ns(start, clock());
+        if (round == 0 || round_ns < batch_ns) batch_ns = round_ns;
+    }
+    if (batch_found != found) {
+        fprintf(stderr, "Batched lookups found %zu keys instead of %zu.\n", batch_found, found);
+        free(keys);
+        free(key_ptrs);
+        dht_free(ht);
+        return 1;
+    }
+
+    printf("%-36s insert: %7.1f ns/op    lookup: %7.1f ns/op    batch: %7.1f ns/op    (%zu found)\n",
+            format->name,
+            insert_ns / nr_keys,
+            lookup_ns / nr_lookups,
+            batch_ns / nr_lookups,
+            found);
+    free(keys);
+    free(key_ptrs);
+    dht_free(ht);
+    remove(BENCH_FILE);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    const size_t nr_keys = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+    const size_t nr_lookups = argc > 2 ? strtoul(argv[2], NULL, 10) : 10 * nr_keys;
+    size_t i;
+    if (argc > 3) key_length = atoi(argv[3]);
+    if (!nr_keys || key_length < 1 || key_length > MAX_KEY_LENGTH) {
+        fprintf(stderr, "Usage: %s [nr_keys [nr_lookups [key_length]]]\n", argv[0]);
+        return 1;
+    }
+    for (i = 0; i < sizeof(formats)/sizeof(formats[0]); ++i) {
+        if (run(&formats[i], nr_keys, nr_lookups)) return 1;
+    }
+    return 0;
+}
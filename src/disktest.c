@@ -26,7 +26,7 @@ data_t dht_lookup_data_or(HashTable* ht, const char* k, data_t def) {
     return def;
 }
 int main() {
-    HashTableOpts opts;
+    HashTableOpts opts = dht_zero_opts();
     opts.key_maxlen = 15;
     opts.object_datalen = sizeof(data_t);
     char* err;
@@ -1,3 +1,6 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE /* mremap */
+#endif
 #ifdef _WIN32
 #include <Windows.h>
 #include <handleapi.h>
@@ -12,8 +15,14 @@
 #include <sys/mman.h>
 #endif
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
 
 #include "os_wrappers.h"
+#include "diskhash.h"
 
 int dht_read_file (dht_file_t file_descriptor, void *buffer, size_t size)
 {
@@ -254,3 +263,238 @@ bool dht_memory_unmap_file(void* data, size_t size)
 #endif
     return success;
 }
+
+/* Resizes a mapping made with dht_memory_map_file to new_size bytes (the file
+ * must already have been resized). With mremap() (Linux), the pages that are
+ * already mapped stay mapped; elsewhere, the file is mapped again. Either way,
+ * the mapping may move. */
+bool dht_memory_remap_file(dht_file_t file_descriptor, void** data_buffer, size_t old_size, size_t new_size, int protections)
+{
+#ifdef MREMAP_MAYMOVE
+    void* data = mremap(*data_buffer, old_size, new_size, MREMAP_MAYMOVE);
+    if (data != MAP_FAILED)
+    {
+        *data_buffer = data;
+        return true;
+    }
+#endif
+    dht_memory_unmap_file(*data_buffer, old_size);
+    return dht_memory_map_file(file_descriptor, data_buffer, new_size, protections);
+}
+
+#ifndef _WIN32
+static size_t dht_huge_page_round_up(size_t size)
+{
+    return (size + DHT_HUGE_PAGE_SIZE - 1) & ~(DHT_HUGE_PAGE_SIZE - 1);
+}
+
+/* Reserves (without backing) an address range of `size` bytes that starts on
+ * a huge page boundary */
+static void* dht_reserve_huge_aligned(size_t size)
+{
+    const size_t padded_size = size + DHT_HUGE_PAGE_SIZE;
+    char* base = mmap(NULL, padded_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED)
+    {
+        return NULL;
+    }
+    char* aligned = (char*)(((uintptr_t)base + DHT_HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(DHT_HUGE_PAGE_SIZE - 1));
+    if (aligned != base)
+    {
+        munmap(base, aligned - base);
+    }
+    munmap(aligned + size, (base + padded_size) - (aligned + size));
+    return aligned;
+}
+#endif
+
+/* Same as dht_memory_map_file, but the mapping starts on a huge page boundary
+ * (so that huge pages line up with the file offsets) and the kernel is asked
+ * to back it with huge pages. Whether it does depends on the file system and
+ * on the system configuration (see dht_memory_huge_page_bytes). */
+bool dht_memory_map_file_huge(dht_file_t file_descriptor, void** data_buffer, size_t data_size, int protections)
+{
+#ifdef _WIN32
+    return dht_memory_map_file(file_descriptor, data_buffer, data_size, protections);
+#else
+    void* address = dht_reserve_huge_aligned(data_size);
+    if (!address)
+    {
+        return dht_memory_map_file(file_descriptor, data_buffer, data_size, protections);
+    }
+    *data_buffer = mmap(address,
+                     data_size,
+                     protections,
+                     MAP_SHARED | MAP_FIXED,
+                     file_descriptor,
+                     0);
+    if (*data_buffer == MAP_FAILED)
+    {
+        munmap(address, data_size);
+        return false;
+    }
+#ifdef MADV_HUGEPAGE
+    madvise(*data_buffer, data_size, MADV_HUGEPAGE);
+#endif
+    return true;
+#endif
+}
+
+/* Allocates memory backed by huge pages: from the hugetlbfs pool if it has
+ * room, otherwise as transparent huge pages. Must be released with
+ * dht_huge_free. */
+void* dht_huge_alloc(size_t size)
+{
+#ifdef _WIN32
+    return malloc(size);
+#else
+    const size_t rounded_size = dht_huge_page_round_up(size);
+    void* data = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    data = mmap(NULL, rounded_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+    if (data != MAP_FAILED)
+    {
+        return data;
+    }
+    data = dht_reserve_huge_aligned(rounded_size);
+    if (!data)
+    {
+        return NULL;
+    }
+    if (mprotect(data, rounded_size, PROT_READ | PROT_WRITE) != 0)
+    {
+        munmap(data, rounded_size);
+        return NULL;
+    }
+#ifdef MADV_HUGEPAGE
+    madvise(data, rounded_size, MADV_HUGEPAGE);
+#endif
+    return data;
+#endif
+}
+
+void dht_huge_free(void* data, size_t size)
+{
+#ifdef _WIN32
+    free(data);
+#else
+    if (data)
+    {
+        munmap(data, dht_huge_page_round_up(size));
+    }
+#endif
+}
+
+/* Number of bytes of [data, data + size) that are currently backed by huge
+ * pages (always 0 where the OS does not report it) */
+size_t dht_memory_huge_page_bytes(const void* data, size_t size)
+{
+    size_t total = 0;
+#ifdef __linux__
+    static const char* huge_fields[] = {
+        "AnonHugePages:", "ShmemPmdMapped:", "FilePmdMapped:",
+        "Shared_Hugetlb:", "Private_Hugetlb:", NULL
+    };
+    const uintptr_t begin = (uintptr_t)data;
+    const uintptr_t end = begin + size;
+    bool in_range = false;
+    char line[256];
+    FILE* smaps = fopen("/proc/self/smaps", "r");
+    if (!smaps)
+    {
+        return 0;
+    }
+    while (fgets(line, sizeof(line), smaps))
+    {
+        unsigned long long vma_begin, vma_end, kb;
+        int i;
+        if (sscanf(line, "%llx-%llx ", &vma_begin, &vma_end) == 2 && strchr(line, '-') < strchr(line, ' '))
+        {
+            in_range = vma_begin < end && vma_end > begin;
+            continue;
+        }
+        if (!in_range)
+        {
+            continue;
+        }
+        for (i = 0; huge_fields[i]; ++i)
+        {
+            const size_t field_length = strlen(huge_fields[i]);
+            if (!strncmp(line, huge_fields[i], field_length) && sscanf(line + field_length, "%llu", &kb) == 1)
+            {
+                total += (size_t)kb * 1024;
+            }
+        }
+    }
+    fclose(smaps);
+#else
+    (void)data;
+    (void)size;
+#endif
+    return total;
+}
+
+/* Passes the advice on to madvise() for the pages overlapping [data, data +
+ * size). Fails with errno set to ENOTSUP if the system has no equivalent. */
+bool dht_memory_advise(void* data, size_t size, int advice)
+{
+#ifdef _WIN32
+    (void)data;
+    (void)size;
+    (void)advice;
+    return true;
+#else
+    int madvice;
+    switch (advice)
+    {
+        case DHT_ADVICE_NORMAL: madvice = MADV_NORMAL; break;
+        case DHT_ADVICE_RANDOM: madvice = MADV_RANDOM; break;
+        case DHT_ADVICE_SEQUENTIAL: madvice = MADV_SEQUENTIAL; break;
+        case DHT_ADVICE_WILLNEED: madvice = MADV_WILLNEED; break;
+#ifdef MADV_COLD
+        case DHT_ADVICE_COLD: madvice = MADV_COLD; break;
+#endif
+#ifdef MADV_PAGEOUT
+        case DHT_ADVICE_PAGEOUT: madvice = MADV_PAGEOUT; break;
+#endif
+        default:
+            errno = ENOTSUP;
+            return false;
+    }
+    const uintptr_t page_mask = (uintptr_t)sysconf(_SC_PAGESIZE) - 1;
+    const uintptr_t start = (uintptr_t)data & ~page_mask;
+    return madvise((void*)start, size + ((uintptr_t)data - start), madvice) == 0;
+#endif
+}
+
+/* Page cache advice for a range of the file (only the advice values that
+ * posix_fadvise() knows about; the others succeed without doing anything) */
+bool dht_file_advise(dht_file_t file_descriptor, size_t offset, size_t size, int advice)
+{
+#if defined(_WIN32) || defined(__APPLE__)
+    (void)file_descriptor;
+    (void)offset;
+    (void)size;
+    (void)advice;
+    return true;
+#else
+    int fadvice;
+    switch (advice)
+    {
+        case DHT_ADVICE_NORMAL: fadvice = POSIX_FADV_NORMAL; break;
+        case DHT_ADVICE_RANDOM: fadvice = POSIX_FADV_RANDOM; break;
+        case DHT_ADVICE_SEQUENTIAL: fadvice = POSIX_FADV_SEQUENTIAL; break;
+        case DHT_ADVICE_WILLNEED: fadvice = POSIX_FADV_WILLNEED; break;
+        default:
+            return true;
+    }
+    const int error = posix_fadvise(file_descriptor, (off_t)offset, (off_t)size, fadvice);
+    if (error)
+    {
+        errno = error;
+        return false;
+    }
+    return true;
+#endif
+}
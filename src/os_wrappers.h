@@ -46,6 +46,19 @@ bool dht_truncate_file(dht_file_t file_descriptor, size_t file_size);
 bool dht_file_sync(dht_file_t file_descriptor);
 bool dht_memory_map_file(dht_file_t file_descriptor, void** data_buffer, size_t data_size, int protections);
 bool dht_memory_unmap_file(void* data, size_t size);
+bool dht_memory_remap_file(dht_file_t file_descriptor, void** data_buffer, size_t old_size, size_t new_size, int protections);
+
+/* Huge page support (falls back to regular pages where unavailable) */
+#define DHT_HUGE_PAGE_SIZE ((size_t)2 << 20)
+bool dht_memory_map_file_huge(dht_file_t file_descriptor, void** data_buffer, size_t data_size, int protections);
+void* dht_huge_alloc(size_t size);
+void dht_huge_free(void* data, size_t size);
+size_t dht_memory_huge_page_bytes(const void* data, size_t size);
+
+/* Access pattern advice (advice is one of the DHT_ADVICE_* values of
+ * diskhash.h, see dht_advise) */
+bool dht_memory_advise(void* data, size_t size, int advice);
+bool dht_file_advise(dht_file_t file_descriptor, size_t offset, size_t size, int advice);
 
 #ifdef __cplusplus
 } /* extern "C" */
@@ -12,6 +12,7 @@
 #include <cstring>
 #include <cstdint>
 #include <utility>
+#include <vector>
 
 void cpp_wrapper_slow_test ();
 void cpp_wrapper_inserting_repeated_key_returns_false ();
@@ -41,6 +42,14 @@ void cpp_wrappper_iterator_different_than_operator_works ();
 void cpp_wrappper_iterator_equals_to_operator_works ();
 void cpp_wrappper_iterator_increment_operator_works ();
 void cpp_wrappper_iterator_move_constructor_works ();
+void cpp_wrapper_key_length_overloads_work ();
+void cpp_wrapper_advise_works ();
+void cpp_wrapper_lookup_many_works ();
+void cpp_wrapper_incremental_growth_works ();
+void cpp_wrapper_parallel_rebuild_works ();
+void cpp_wrapper_shrink_to_fit_works ();
+void cpp_wrapper_relayout_works ();
+void cpp_wrapper_relayout_by_access_works ();
 
 int main (int argc, char ** argv)
 {
@@ -128,6 +137,30 @@ int main (int argc, char ** argv)
 	std::cout << "cpp_wrappper_iterator_move_constructor_works ():" << std::endl;
 	cpp_wrappper_iterator_move_constructor_works ();
 
+	std::cout << "cpp_wrapper_key_length_overloads_work ():" << std::endl;
+	cpp_wrapper_key_length_overloads_work ();
+
+	std::cout << "cpp_wrapper_advise_works ():" << std::endl;
+	cpp_wrapper_advise_works ();
+
+	std::cout << "cpp_wrapper_lookup_many_works ():" << std::endl;
+	cpp_wrapper_lookup_many_works ();
+
+	std::cout << "cpp_wrapper_incremental_growth_works ():" << std::endl;
+	cpp_wrapper_incremental_growth_works ();
+
+	std::cout << "cpp_wrapper_parallel_rebuild_works ():" << std::endl;
+	cpp_wrapper_parallel_rebuild_works ();
+
+	std::cout << "cpp_wrapper_shrink_to_fit_works ():" << std::endl;
+	cpp_wrapper_shrink_to_fit_works ();
+
+	std::cout << "cpp_wrapper_relayout_works ():" << std::endl;
+	cpp_wrapper_relayout_works ();
+
+	std::cout << "cpp_wrapper_relayout_by_access_works ():" << std::endl;
+	cpp_wrapper_relayout_by_access_works ();
+
 	delete_temp_db_path (get_temp_path ());
 	return 0;
 }
@@ -557,3 +590,155 @@ void cpp_wrappper_iterator_move_constructor_works ()
 	for (; another_it != ht->end(); ++another_it, ++counter);
 	assert ((number_of_elements - 1) == counter);
 }
+
+void cpp_wrapper_key_length_overloads_work ()
+{
+	auto key_maxlen = static_cast<int> (std::to_string (std::numeric_limits<std::uint64_t>::max ()).size ());
+	auto ht (get_shared_ptr_to_dht_db<uint64_t> (key_maxlen));
+
+	std::string key (random_string (key_maxlen - 1));
+	assert (ht->insert (key.data (), 4, 12));
+	assert (!ht->insert (key.data (), 4, 34));
+	assert (ht->is_member (key.substr (0, 4).c_str ()));
+	assert (ht->is_member (key.data (), 4));
+	assert (!ht->is_member (key.data (), 5));
+	assert (*ht->lookup (key.data (), 4) == 12);
+	assert (ht->remove (key.data (), 4));
+	assert (!ht->remove (key.data (), 4));
+	assert (ht->size () == 0);
+}
+
+void cpp_wrapper_advise_works ()
+{
+	auto ht (get_shared_ptr_to_dht_db<uint64_t> (16));
+	assert (ht->insert ("key", 12));
+	ht->advise (DHT_REGION_INDEX, DHT_ADVICE_WILLNEED);
+	ht->advise (DHT_REGION_STORE | DHT_REGION_DIRTY, DHT_ADVICE_RANDOM);
+	ht->advise (DHT_REGION_ALL, DHT_ADVICE_NORMAL);
+	assert (*ht->lookup ("key") == 12);
+
+	bool thrown = false;
+	try {
+		ht->advise (DHT_REGION_ALL, 1000);
+	} catch (std::runtime_error&) {
+		thrown = true;
+	}
+	assert (thrown);
+}
+
+void cpp_wrapper_lookup_many_works ()
+{
+	auto ht (get_shared_ptr_to_dht_db<uint64_t> (16));
+	std::vector<std::string> keys;
+	for (uint64_t i = 0; i < 200; ++i) {
+		keys.push_back ("key-" + std::to_string (i));
+		if (i % 2) assert (ht->insert (keys.back ().c_str (), i));
+	}
+	std::vector<const char *> key_ptrs;
+	for (auto & key : keys) key_ptrs.push_back (key.c_str ());
+	std::vector<uint64_t *> values (keys.size ());
+
+	assert (ht->lookup_many (key_ptrs.data (), key_ptrs.size (), values.data ()) == 100);
+	for (size_t i = 0; i < keys.size (); ++i) {
+		if (i % 2) {
+			assert (values[i] && *values[i] == i);
+		} else {
+			assert (!values[i]);
+		}
+	}
+}
+
+void cpp_wrapper_incremental_growth_works ()
+{
+	auto ht (get_shared_ptr_to_dht_db<uint64_t> (16));
+	ht->set_growth_step (4);
+	for (uint64_t i = 0; i < 1000; ++i) {
+		assert (ht->insert (("key-" + std::to_string (i)).c_str (), i));
+		assert (ht->size () == i + 1);
+	}
+	for (uint64_t i = 0; i < 1000; ++i) {
+		assert (*ht->lookup (("key-" + std::to_string (i)).c_str ()) == i);
+	}
+	// iterating finishes any pending growth, so that every entry is visited
+	auto counter (0u);
+	for (auto it = ht->begin (); it != ht->end (); ++it, ++counter);
+	assert (counter == 1000);
+	ht->finish_growth ();
+	ht->set_growth_step (0);
+	assert (ht->size () == 1000);
+}
+
+void cpp_wrapper_parallel_rebuild_works ()
+{
+	auto ht (get_shared_ptr_to_dht_db<uint64_t> (16));
+	ht->set_rebuild_threads (3);
+	for (uint64_t i = 0; i < 70000; ++i) {
+		assert (ht->insert (("key-" + std::to_string (i)).c_str (), i));
+	}
+	ht->reserve (200000);
+	assert (ht->capacity () >= 200000);
+	for (uint64_t i = 0; i < 70000; ++i) {
+		assert (*ht->lookup (("key-" + std::to_string (i)).c_str ()) == i);
+	}
+	assert (!ht->is_member ("key-70000"));
+}
+
+void cpp_wrapper_shrink_to_fit_works ()
+{
+	auto ht (get_shared_ptr_to_dht_db<uint64_t> (16));
+	for (uint64_t i = 0; i < 1000; ++i) {
+		assert (ht->insert (("key-" + std::to_string (i)).c_str (), i));
+	}
+	for (uint64_t i = 100; i < 1000; ++i) {
+		assert (ht->remove (("key-" + std::to_string (i)).c_str ()));
+	}
+	const auto capacity (ht->capacity ());
+	ht->shrink_to_fit ();
+	assert (ht->capacity () < capacity);
+	assert (ht->dirty_slots () == 0);
+	assert (ht->size () == 100);
+	for (uint64_t i = 0; i < 100; ++i) {
+		assert (*ht->lookup (("key-" + std::to_string (i)).c_str ()) == i);
+	}
+}
+
+void cpp_wrapper_relayout_works ()
+{
+	auto ht (get_shared_ptr_to_dht_db<uint64_t> (16));
+	for (uint64_t i = 0; i < 1000; ++i) {
+		assert (ht->insert (("key-" + std::to_string (i)).c_str (), i));
+	}
+	const auto capacity (ht->capacity ());
+	ht->relayout ();
+	assert (ht->capacity () == capacity);
+	assert (ht->size () == 1000);
+	for (uint64_t i = 0; i < 1000; ++i) {
+		assert (*ht->lookup (("key-" + std::to_string (i)).c_str ()) == i);
+	}
+}
+
+void cpp_wrapper_relayout_by_access_works ()
+{
+	auto ht (get_shared_ptr_to_dht_db<uint64_t> (16));
+	for (uint64_t i = 0; i < 1000; ++i) {
+		assert (ht->insert (("key-" + std::to_string (i)).c_str (), i));
+	}
+	bool thrown = false;
+	try {
+		ht->relayout_by_access ();
+	} catch (std::runtime_error &) {
+		thrown = true;
+	}
+	assert (thrown);
+	ht->sample_accesses (1);
+	for (int round = 0; round < 5; ++round) {
+		assert (*ht->lookup ("key-999") == 999);
+	}
+	ht->relayout_by_access ();
+	auto first (ht->begin ());
+	assert (first->second == 999);
+	for (uint64_t i = 0; i < 1000; ++i) {
+		assert (*ht->lookup (("key-" + std::to_string (i)).c_str ()) == i);
+	}
+	ht->sample_accesses (0);
+}
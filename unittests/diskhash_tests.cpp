@@ -3,6 +3,7 @@
 #include <helper_functions.hpp>
 #include <memory.h>
 #include <os_wrappers.h>
+#include <vector>
 
 void diskhash_creates_db_file_successfully ();
 void diskhash_requires_o_creat_to_create_new_db ();
@@ -52,6 +53,59 @@ void diskhash_deletes_more_than_one_collision_correctly ();
 void diskhash_deletes_collision_with_filled_slot_correctly ();
 void diskhash_reserve_is_not_affected_by_deleted_entries ();
 void diskhash_deletes_first_slot_no_collision_correctly ();
+void diskhash_control_bytes_insert_lookup_delete_works ();
+void diskhash_control_bytes_flags_mismatch_returns_error ();
+void diskhash_robin_hood_insert_lookup_delete_works ();
+void diskhash_robin_hood_with_control_bytes_works ();
+void diskhash_robin_hood_has_higher_max_load ();
+void diskhash_fingerprints_insert_lookup_delete_works ();
+void diskhash_fingerprints_with_robin_hood_works ();
+void diskhash_fastrange_insert_lookup_delete_works ();
+void diskhash_fastrange_with_all_options_works ();
+void diskhash_wyhash_insert_lookup_delete_works ();
+void diskhash_crc32c_hash_insert_lookup_delete_works ();
+void diskhash_hash_functions_work_for_all_key_lengths ();
+void diskhash_two_hash_functions_returns_error ();
+void diskhash_key_lengths_insert_lookup_delete_works ();
+void diskhash_key_lengths_binary_keys_work ();
+void diskhash_n_functions_work_without_key_lengths ();
+void diskhash_key_arena_insert_lookup_delete_works ();
+void diskhash_key_arena_long_keys_work ();
+void diskhash_key_arena_requires_key_lengths_returns_error ();
+void diskhash_fixed_keys_insert_lookup_delete_works ();
+void diskhash_fixed_keys_invalid_options_return_error ();
+void diskhash_cuckoo_insert_lookup_delete_works ();
+void diskhash_cuckoo_reaches_max_load_without_growing ();
+void diskhash_cuckoo_with_robin_hood_returns_error ();
+void diskhash_columnar_insert_lookup_delete_works ();
+void diskhash_columnar_indexed_lookup_works ();
+void diskhash_huge_pages_insert_lookup_delete_works ();
+void diskhash_huge_pages_load_to_memory_works ();
+void diskhash_advise_works ();
+void diskhash_advise_invalid_arguments_return_error ();
+void diskhash_lookup_batch_matches_lookup ();
+void diskhash_incremental_growth_works ();
+void diskhash_finish_growth_works ();
+void diskhash_reserve_grows_in_place ();
+void diskhash_grow_in_place_clears_moved_regions ();
+void diskhash_parallel_rebuild_works ();
+void diskhash_stored_hashes_insert_lookup_delete_works ();
+void diskhash_shrink_to_fit_works ();
+void diskhash_shrink_to_fit_incrementally_works ();
+void diskhash_relayout_works ();
+void diskhash_relayout_by_access_packs_hot_entries ();
+void diskhash_relayout_by_access_requires_sampling ();
+void diskhash_inline_insert_lookup_delete_works ();
+void diskhash_inline_iterates_slots ();
+void diskhash_inline_with_robin_hood_returns_error ();
+void diskhash_compact_insert_lookup_delete_works ();
+void diskhash_compact_handles_long_probe_sequences ();
+void diskhash_compact_with_fingerprints_returns_error ();
+void diskhash_delete_keeps_store_entries_in_place ();
+void diskhash_initial_capacity_avoids_growth ();
+void diskhash_sizing_options_are_stored ();
+void diskhash_invalid_sizing_options_return_error ();
+void diskhash_too_large_initial_capacity_returns_error ();
 
 #ifdef __cplusplus
 using namespace std;
@@ -66,6 +120,66 @@ typedef struct dictionary {
 	bool (*check_entry)(struct dictionary* dict, const char *k, int v);
 	void (*append_entry)(struct dictionary* dict, const char* key, int value);
 } dumb_dictionary_t;
+// Inserts n keys, deletes every other one and checks lookups before and
+// after reopening the table read-only.
+void check_table_roundtrip (HashTableOpts opts, int n)
+{
+	const char * db_path = strdup (get_temp_db_path ().c_str ());
+	char * err = NULL;
+	char key[32];
+	HashTable * ht = dht_open (db_path, opts, O_RDWR | O_CREAT, &err);
+	assert (ht);
+
+	for (int i = 0; i < n; ++i) {
+		snprintf (key, sizeof (key), "key-%d", i);
+		assert (dht_insert (ht, key, &i, &err) == 1);
+		assert (dht_insert (ht, key, &i, &err) == 0);
+	}
+	assert ((int)dht_size (ht) == n);
+	for (int i = 0; i < n; ++i) {
+		snprintf (key, sizeof (key), "key-%d", i);
+		int * read_val = (int *)dht_lookup (ht, key);
+		assert (read_val && *read_val == i);
+	}
+	assert (dht_lookup (ht, "missing") == NULL);
+	for (int i = 0; i < n; i += 2) {
+		snprintf (key, sizeof (key), "key-%d", i);
+		assert (dht_delete (ht, key, &err) == 1);
+	}
+	dht_free (ht);
+
+	ht = dht_open (db_path, dht_zero_opts (), O_RDONLY, &err);
+	assert (ht);
+	assert ((int)dht_size (ht) == n / 2);
+	for (int i = 0; i < n; ++i) {
+		snprintf (key, sizeof (key), "key-%d", i);
+		int * read_val = (int *)dht_lookup (ht, key);
+		if (i % 2) {
+			assert (read_val && *read_val == i);
+		} else {
+			assert (read_val == NULL);
+		}
+	}
+
+	free ((char *)db_path);
+	dht_free (ht);
+}
+
+// Inserts keys (numbered from *next_key on) until the table grows and returns
+// its capacity before growing.
+size_t fill_until_growth (HashTable * ht, int * next_key)
+{
+	char * err = NULL;
+	char key[16];
+	const size_t capacity = dht_capacity (ht);
+	while (dht_capacity (ht) == capacity) {
+		snprintf (key, sizeof (key), "key-%d", *next_key);
+		assert (dht_insert (ht, key, next_key, &err) == 1);
+		++*next_key;
+	}
+	return capacity;
+}
+
 bool check_entry_impl(struct dictionary* dict, const char* key, int value) {
 	for(int i = 0; i < dict->size; i++) {
 		if(!strcmp(dict->entries[i].key,key)) {
@@ -226,13 +340,171 @@ int main (int argc, char ** argv)
 	printf ("diskhash_deletes_first_slot_no_collision_correctly ():\n");
 	diskhash_deletes_first_slot_no_collision_correctly ();
 
+	printf ("diskhash_control_bytes_insert_lookup_delete_works ():\n");
+	diskhash_control_bytes_insert_lookup_delete_works ();
+
+	printf ("diskhash_control_bytes_flags_mismatch_returns_error ():\n");
+	diskhash_control_bytes_flags_mismatch_returns_error ();
+
+	printf ("diskhash_robin_hood_insert_lookup_delete_works ():\n");
+	diskhash_robin_hood_insert_lookup_delete_works ();
+
+	printf ("diskhash_robin_hood_with_control_bytes_works ():\n");
+	diskhash_robin_hood_with_control_bytes_works ();
+
+	printf ("diskhash_robin_hood_has_higher_max_load ():\n");
+	diskhash_robin_hood_has_higher_max_load ();
+
+	printf ("diskhash_fingerprints_insert_lookup_delete_works ():\n");
+	diskhash_fingerprints_insert_lookup_delete_works ();
+
+	printf ("diskhash_fingerprints_with_robin_hood_works ():\n");
+	diskhash_fingerprints_with_robin_hood_works ();
+
+	printf ("diskhash_fastrange_insert_lookup_delete_works ():\n");
+	diskhash_fastrange_insert_lookup_delete_works ();
+
+	printf ("diskhash_fastrange_with_all_options_works ():\n");
+	diskhash_fastrange_with_all_options_works ();
+
+	printf ("diskhash_wyhash_insert_lookup_delete_works ():\n");
+	diskhash_wyhash_insert_lookup_delete_works ();
+
+	printf ("diskhash_crc32c_hash_insert_lookup_delete_works ():\n");
+	diskhash_crc32c_hash_insert_lookup_delete_works ();
+
+	printf ("diskhash_hash_functions_work_for_all_key_lengths ():\n");
+	diskhash_hash_functions_work_for_all_key_lengths ();
+
+	printf ("diskhash_two_hash_functions_returns_error ():\n");
+	diskhash_two_hash_functions_returns_error ();
+
+	printf ("diskhash_key_lengths_insert_lookup_delete_works ():\n");
+	diskhash_key_lengths_insert_lookup_delete_works ();
+
+	printf ("diskhash_key_lengths_binary_keys_work ():\n");
+	diskhash_key_lengths_binary_keys_work ();
+
+	printf ("diskhash_n_functions_work_without_key_lengths ():\n");
+	diskhash_n_functions_work_without_key_lengths ();
+
+	printf ("diskhash_key_arena_insert_lookup_delete_works ():\n");
+	diskhash_key_arena_insert_lookup_delete_works ();
+
+	printf ("diskhash_key_arena_long_keys_work ():\n");
+	diskhash_key_arena_long_keys_work ();
+
+	printf ("diskhash_key_arena_requires_key_lengths_returns_error ():\n");
+	diskhash_key_arena_requires_key_lengths_returns_error ();
+
+	printf ("diskhash_fixed_keys_insert_lookup_delete_works ():\n");
+	diskhash_fixed_keys_insert_lookup_delete_works ();
+
+	printf ("diskhash_fixed_keys_invalid_options_return_error ():\n");
+	diskhash_fixed_keys_invalid_options_return_error ();
+
+	printf ("diskhash_cuckoo_insert_lookup_delete_works ():\n");
+	diskhash_cuckoo_insert_lookup_delete_works ();
+
+	printf ("diskhash_cuckoo_reaches_max_load_without_growing ():\n");
+	diskhash_cuckoo_reaches_max_load_without_growing ();
+
+	printf ("diskhash_cuckoo_with_robin_hood_returns_error ():\n");
+	diskhash_cuckoo_with_robin_hood_returns_error ();
+
+	printf ("diskhash_columnar_insert_lookup_delete_works ():\n");
+	diskhash_columnar_insert_lookup_delete_works ();
+
+	printf ("diskhash_columnar_indexed_lookup_works ():\n");
+	diskhash_columnar_indexed_lookup_works ();
+
+	printf ("diskhash_huge_pages_insert_lookup_delete_works ():\n");
+	diskhash_huge_pages_insert_lookup_delete_works ();
+
+	printf ("diskhash_huge_pages_load_to_memory_works ():\n");
+	diskhash_huge_pages_load_to_memory_works ();
+
+	printf ("diskhash_advise_works ():\n");
+	diskhash_advise_works ();
+
+	printf ("diskhash_advise_invalid_arguments_return_error ():\n");
+	diskhash_advise_invalid_arguments_return_error ();
+
+	printf ("diskhash_lookup_batch_matches_lookup ():\n");
+	diskhash_lookup_batch_matches_lookup ();
+
+	printf ("diskhash_incremental_growth_works ():\n");
+	diskhash_incremental_growth_works ();
+
+	printf ("diskhash_finish_growth_works ():\n");
+	diskhash_finish_growth_works ();
+
+	printf ("diskhash_reserve_grows_in_place ():\n");
+	diskhash_reserve_grows_in_place ();
+
+	printf ("diskhash_grow_in_place_clears_moved_regions ():\n");
+	diskhash_grow_in_place_clears_moved_regions ();
+
+	printf ("diskhash_parallel_rebuild_works ():\n");
+	diskhash_parallel_rebuild_works ();
+
+	printf ("diskhash_stored_hashes_insert_lookup_delete_works ():\n");
+	diskhash_stored_hashes_insert_lookup_delete_works ();
+
+	printf ("diskhash_shrink_to_fit_works ():\n");
+	diskhash_shrink_to_fit_works ();
+
+	printf ("diskhash_shrink_to_fit_incrementally_works ():\n");
+	diskhash_shrink_to_fit_incrementally_works ();
+
+	printf ("diskhash_relayout_works ():\n");
+	diskhash_relayout_works ();
+
+	printf ("diskhash_relayout_by_access_packs_hot_entries ():\n");
+	diskhash_relayout_by_access_packs_hot_entries ();
+
+	printf ("diskhash_relayout_by_access_requires_sampling ():\n");
+	diskhash_relayout_by_access_requires_sampling ();
+
+	printf ("diskhash_inline_insert_lookup_delete_works ():\n");
+	diskhash_inline_insert_lookup_delete_works ();
+
+	printf ("diskhash_inline_iterates_slots ():\n");
+	diskhash_inline_iterates_slots ();
+
+	printf ("diskhash_inline_with_robin_hood_returns_error ():\n");
+	diskhash_inline_with_robin_hood_returns_error ();
+
+	printf ("diskhash_compact_insert_lookup_delete_works ():\n");
+	diskhash_compact_insert_lookup_delete_works ();
+
+	printf ("diskhash_compact_handles_long_probe_sequences ():\n");
+	diskhash_compact_handles_long_probe_sequences ();
+
+	printf ("diskhash_compact_with_fingerprints_returns_error ():\n");
+	diskhash_compact_with_fingerprints_returns_error ();
+
+	printf ("diskhash_delete_keeps_store_entries_in_place ():\n");
+	diskhash_delete_keeps_store_entries_in_place ();
+
+	printf ("diskhash_initial_capacity_avoids_growth ():\n");
+	diskhash_initial_capacity_avoids_growth ();
+
+	printf ("diskhash_sizing_options_are_stored ():\n");
+	diskhash_sizing_options_are_stored ();
+
+	printf ("diskhash_invalid_sizing_options_return_error ():\n");
+	diskhash_invalid_sizing_options_return_error ();
+	printf ("diskhash_too_large_initial_capacity_returns_error ():\n");
+	diskhash_too_large_initial_capacity_returns_error ();
+
 	return 0;
 }
 
 void diskhash_creates_db_file_successfully ()
 {
 	const char * db_path = strdup (get_temp_db_path ().c_str ());
-	HashTableOpts opts;
+	HashTableOpts opts = dht_zero_opts ();
 	opts.key_maxlen = 6;
 	opts.object_datalen = sizeof (int);
 	int flags = O_RDWR | O_CREAT;
@@ -247,7 +519,7 @@ void diskhash_creates_db_file_successfully ()
 void diskhash_requires_o_creat_to_create_new_db ()
 {
 	const char * db_path = strdup (get_temp_db_path ().c_str ());
-	HashTableOpts opts;
+	HashTableOpts opts = dht_zero_opts ();
 	opts.key_maxlen = 6;
 	opts.object_datalen = sizeof (int);
 	int flags = O_RDWR;
@@ -264,7 +536,7 @@ void diskhash_db_saved_correctly ()
 {
 	const char * db_path = strdup (get_temp_db_path ().c_str ());
 	const char * key = "my_key";
-	HashTableOpts opts;
+	HashTableOpts opts = dht_zero_opts ();
 	opts.key_maxlen = strlen (key) + 1;
 	opts.object_datalen = sizeof (int);
 	int flags = O_RDWR | O_CREAT;
@@ -287,7 +559,7 @@ void diskhash_db_saved_correctly_after_update ()
 {
 	const char * db_path = strdup (get_temp_db_path ().c_str ());
 	const char * key = "my_key";
-	HashTableOpts opts;
+	HashTableOpts opts = dht_zero_opts ();
 	opts.key_maxlen = strlen (key) + 1;
 	opts.object_datalen = sizeof (int);
 	int flags = O_RDWR | O_CREAT;
@@ -325,7 +597,7 @@ void diskhash_update_nullptr_key_returns_error ()
 {
 	const char * db_path = strdup (get_temp_db_path ().c_str ());
 	const char * key = "my_key";
-	HashTableOpts opts;
+	HashTableOpts opts = dht_zero_opts ();
 	opts.key_maxlen = strlen (key) + 1;
 	opts.object_datalen = sizeof (int);
 	int flags = O_RDWR | O_CREAT;
@@ -346,7 +618,7 @@ void diskhash_update_nullptr_data_returns_error ()
 {
 	const char * db_path = strdup (get_temp_db_path ().c_str ());
 	const char * key = "my_key";
-	HashTableOpts opts;
+	HashTableOpts opts = dht_zero_opts ();
 	opts.key_maxlen = strlen (key) + 1;
 	opts.object_datalen = sizeof (int);
 	int flags = O_RDWR | O_CREAT;
@@ -366,7 +638,7 @@ void diskhash_update_readonly_returns_error ()
 {
 	const char * db_path = strdup (get_temp_db_path ().c_str ());
 	const char * key = "my_key";
-	HashTableOpts opts;
+	HashTableOpts opts = dht_zero_opts ();
 	opts.key_maxlen = strlen (key) + 1;
 	opts.object_datalen = sizeof (int);
 	int flags = O_RDWR | O_CREAT;
@@ -390,7 +662,7 @@ void diskhash_update_too_long_key_returns_error ()
 {
 	const char * db_path = strdup (get_temp_db_path ().c_str ());
 	const char * key = "my_key";
-	HashTableOpts opts;
+	HashTableOpts opts = dht_zero_opts ();
 	opts.key_maxlen = strlen (key);
 	opts.object_datalen = sizeof (int);
 	int flags = O_RDWR | O_CREAT;
@@ -425,7 +697,7 @@ void diskhash_insert_nullptr_key_returns_error ()
 {
 	const char * db_path = strdup (get_temp_db_path ().c_str ());
 	const char * key = "my_key";
-	HashTableOpts opts;
+	HashTableOpts opts = dht_zero_opts ();
 	opts.key_maxlen = strlen (key) + 1;
 	opts.object_datalen = sizeof (int);
 	int flags = O_RDWR | O_CREAT;
@@ -446,7 +718,7 @@ void diskhash_insert_nullptr_data_returns_error ()
 {
 	const char * db_path = strdup (get_temp_db_path ().c_str ());
 	const char * key = "my_key";
-	HashTableOpts opts;
+	HashTableOpts opts = dht_zero_opts ();
 	opts.key_maxlen = strlen (key) + 1;
 	opts.object_datalen = sizeof (int);
 	int flags = O_RDWR | O_CREAT;
@@ -466,7 +738,7 @@ void diskhash_insert_readonly_returns_error ()
 {
 	const char * db_path = strdup (get_temp_db_path ().c_str ());
 	const char * key = "my_key";
-	HashTableOpts opts;
+	HashTableOpts opts = dht_zero_opts ();
 	opts.key_maxlen = strlen (key) + 1;
 	opts.object_datalen = sizeof (int);
 	int flags = O_RDWR | O_CREAT;
@@ -490,7 +762,7 @@ void diskhash_insert_too_long_key_returns_error ()
 {
 	const char * db_path = strdup (get_temp_db_path ().c_str ());
 	const char * key = "my_key";
-	HashTableOpts opts;
+	HashTableOpts opts = dht_zero_opts ();
 	opts.key_maxlen = strlen (key);
 	opts.object_datalen = sizeof (int);
 	int flags = O_RDWR | O_CREAT;
@@ -523,7 +795,7 @@ void diskhash_delete_nullptr_key_returns_error ()
 {
 	const char * db_path = strdup (get_temp_db_path ().c_str ());
 	const char * key = "my_key";
-	HashTableOpts opts;
+	HashTableOpts opts = dht_zero_opts ();
 	opts.key_maxlen = strlen (key) + 1;
 	opts.object_datalen = sizeof (int);
 	int flags = O_RDWR | O_CREAT;
@@ -543,7 +815,7 @@ void diskhash_delete_readonly_returns_error ()
 {
 	const char * db_path = strdup (get_temp_db_path ().c_str ());
 	const char * key = "my_key";
-	HashTableOpts opts;
+	HashTableOpts opts = dht_zero_opts ();
 	opts.key_maxlen = strlen (key) + 1;
 	opts.object_datalen = sizeof (int);
 	int flags = O_RDWR | O_CREAT;
@@ -566,7 +838,7 @@ void diskhash_delete_too_long_key_returns_error ()
 {
 	const char * db_path = strdup (get_temp_db_path ().c_str ());
 	const char * key = "my_key";
-	HashTableOpts opts;
+	HashTableOpts opts = dht_zero_opts ();
 	opts.key_maxlen = strlen (key);
 	opts.object_datalen = sizeof (int);
 	int flags = O_RDWR | O_CREAT;
@@ -586,7 +858,7 @@ void diskhash_key_maxlen_equals_to_key_size_returns_error ()
 {
 	const char * db_path = strdup (get_temp_db_path ().c_str ());
 	const char * key = "my_key";
-	HashTableOpts opts;
+	HashTableOpts opts = dht_zero_opts ();
 	opts.key_maxlen = strlen (key);
 	opts.object_datalen = sizeof (int);
 	int flags = O_RDWR | O_CREAT;
@@ -607,7 +879,7 @@ void diskhash_inserts_successfully ()
 {
 	const char * db_path = strdup (get_temp_db_path ().c_str ());
 	const char * key = "my_key";
-	HashTableOpts opts;
+	HashTableOpts opts = dht_zero_opts ();
 	opts.key_maxlen = strlen (key) + 1;
 	opts.object_datalen = sizeof (int);
 	int flags = O_RDWR | O_CREAT;
@@ -626,7 +898,7 @@ void diskhash_inserts_empty_string_works ()
 {
 	const char * db_path = strdup (get_temp_db_path ().c_str ());
 	const char * key = "my_key";
-	HashTableOpts opts;
+	HashTableOpts opts = dht_zero_opts ();
 	opts.key_maxlen = strlen (key) + 1;
 	opts.object_datalen = sizeof (int);
 	int flags = O_RDWR | O_CREAT;
@@ -648,7 +920,7 @@ void diskhash_delete_empty_string_works ()
 {
 	const char * db_path = strdup (get_temp_db_path ().c_str ());
 	const char * key = "my_key";
-	HashTableOpts opts;
+	HashTableOpts opts = dht_zero_opts ();
 	opts.key_maxlen = strlen (key) + 1;
 	opts.object_datalen = sizeof (int);
 	int flags = O_RDWR | O_CREAT;
@@ -673,7 +945,7 @@ void diskhash_update_empty_string_works ()
 {
 	const char * db_path = strdup (get_temp_db_path ().c_str ());
 	const char * key = "my_key";
-	HashTableOpts opts;
+	HashTableOpts opts = dht_zero_opts ();
 	opts.key_maxlen = strlen (key) + 1;
 	opts.object_datalen = sizeof (int);
 	int flags = O_RDWR | O_CREAT;
@@ -703,7 +975,7 @@ void diskhash_inserts_increasing_capacity_works ()
 
 	const char * db_path = strdup (get_temp_db_path ().c_str ());
 	const char * key = "my_key";
-	HashTableOpts opts;
+	HashTableOpts opts = dht_zero_opts ();
 	opts.key_maxlen = strlen (key) + 1;
 	opts.object_datalen = sizeof (int);
 	int flags = O_RDWR | O_CREAT;
@@ -751,7 +1023,7 @@ void diskhash_updates_successfully ()
 {
 	const char * db_path = strdup (get_temp_db_path ().c_str ());
 	const char * key = "my_key";
-	HashTableOpts opts;
+	HashTableOpts opts = dht_zero_opts ();
 	opts.key_maxlen = strlen (key) + 1;
 	opts.object_datalen = sizeof (int);
 	int flags = O_RDWR | O_CREAT;
@@ -773,7 +1045,7 @@ void diskhash_lookup_retrieves_inserted_value ()
 {
 	const char * db_path = strdup (get_temp_db_path ().c_str ());
 	const char * key = "my_key";
-	HashTableOpts opts;
+	HashTableOpts opts = dht_zero_opts ();
 	opts.key_maxlen = strlen (key) + 1;
 	opts.object_datalen = sizeof (int);
 	int flags = O_RDWR | O_CREAT;
@@ -793,7 +1065,7 @@ void diskhash_lookup_retrieves_null_for_inexistent_key ()
 {
 	const char * db_path = strdup (get_temp_db_path ().c_str ());
 	const char * key = "my_key";
-	HashTableOpts opts;
+	HashTableOpts opts = dht_zero_opts ();
 	opts.key_maxlen = strlen (key) + 1;
 	opts.object_datalen = sizeof (int);
 	int flags = O_RDWR | O_CREAT;
@@ -811,7 +1083,7 @@ void diskhash_check_capacity ()
 {
 	const char * db_path = strdup (get_temp_db_path ().c_str ());
 	const char * key = "my_key";
-	HashTableOpts opts;
+	HashTableOpts opts = dht_zero_opts ();
 	opts.key_maxlen = strlen (key) + 1;
 	opts.object_datalen = sizeof (int);
 	int flags = O_RDWR | O_CREAT;
@@ -829,7 +1101,7 @@ void diskhash_reserves_capacity_equal_or_more_than_requested ()
 {
 	const char * db_path = strdup (get_temp_db_path ().c_str ());
 	const char * key = "my_key";
-	HashTableOpts opts;
+	HashTableOpts opts = dht_zero_opts ();
 	opts.key_maxlen = strlen (key) + 1;
 	opts.object_datalen = sizeof (int);
 	int flags = O_RDWR | O_CREAT;
@@ -847,7 +1119,7 @@ void diskhash_returns_correct_size ()
 {
 	const char * db_path = strdup (get_temp_db_path ().c_str ());
 	const char * key = "my_key";
-	HashTableOpts opts;
+	HashTableOpts opts = dht_zero_opts ();
 	opts.key_maxlen = strlen (key) + 1;
 	opts.object_datalen = sizeof (int);
 	int flags = O_RDWR | O_CREAT;
@@ -871,7 +1143,7 @@ void diskhash_returns_correct_capacity_after_insert ()
 
 	const char * db_path = strdup (get_temp_db_path ().c_str ());
 	const char * key = "my_key";
-	HashTableOpts opts;
+	HashTableOpts opts = dht_zero_opts ();
 	opts.key_maxlen = strlen (key) + 1;
 	opts.object_datalen = sizeof (int);
 	int flags = O_RDWR | O_CREAT;
@@ -898,7 +1170,7 @@ void diskhash_returns_correct_capacity_after_reserve ()
 
 	const char * db_path = strdup (get_temp_db_path ().c_str ());
 	const char * key = "my_key";
-	HashTableOpts opts;
+	HashTableOpts opts = dht_zero_opts ();
 	opts.key_maxlen = strlen (key) + 1;
 	opts.object_datalen = sizeof (int);
 	int flags = O_RDWR | O_CREAT;
@@ -917,7 +1189,7 @@ void diskhash_reserve_does_not_allocate_less_than_equal_to_same_capacity ()
 {
 	const char * db_path = strdup (get_temp_db_path ().c_str ());
 	const char * key = "my_key";
-	HashTableOpts opts;
+	HashTableOpts opts = dht_zero_opts ();
 	opts.key_maxlen = strlen (key) + 1;
 	opts.object_datalen = sizeof (int);
 	int flags = O_RDWR | O_CREAT;
@@ -936,7 +1208,7 @@ void diskhash_load_to_memory_issues_error_for_writable_databases ()
 {
 	const char * db_path = strdup (get_temp_db_path ().c_str ());
 	const char * key = "my_key";
-	HashTableOpts opts;
+	HashTableOpts opts = dht_zero_opts ();
 	opts.key_maxlen = strlen (key) + 1;
 	opts.object_datalen = sizeof (int);
 	int flags = O_RDWR | O_CREAT;
@@ -954,7 +1226,7 @@ void diskhash_load_to_memory_loads_on_readonly_db ()
 {
 	char * db_path = strdup (get_temp_db_path ().c_str ());
 	const char * key = "my_key";
-	HashTableOpts opts;
+	HashTableOpts opts = dht_zero_opts ();
 	opts.key_maxlen = strlen (key) + 1;
 	opts.object_datalen = sizeof (int);
 	int flags = O_RDWR | O_CREAT;
@@ -974,7 +1246,7 @@ void diskhash_load_to_memory_works ()
 {
 	const char * db_path = strdup (get_temp_db_path ().c_str ());
 	const char * key = "my_key";
-	HashTableOpts opts;
+	HashTableOpts opts = dht_zero_opts ();
 	opts.key_maxlen = strlen (key) + 1;
 	opts.object_datalen = sizeof (int);
 	int flags = O_RDWR | O_CREAT;
@@ -999,7 +1271,7 @@ void diskhash_write_error_on_memory_loaded_db ()
 {
 	const char * db_path = strdup (get_temp_db_path ().c_str ());
 	const char * key = "my_key";
-	HashTableOpts opts;
+	HashTableOpts opts = dht_zero_opts ();
 	opts.key_maxlen = strlen (key) + 1;
 	opts.object_datalen = sizeof (int);
 	int flags = O_RDWR | O_CREAT;
@@ -1026,7 +1298,7 @@ void diskhash_check_cursor_points_correctly_regardless_position ()
 
 	const char * db_path = strdup (get_temp_db_path ().c_str ());
 	const char * key = "my_key";
-	HashTableOpts opts;
+	HashTableOpts opts = dht_zero_opts ();
 	opts.key_maxlen = strlen (key) + 1;
 	opts.object_datalen = sizeof (int);
 	int flags = O_RDWR | O_CREAT;
@@ -1064,7 +1336,7 @@ void diskhash_check_cursor_points_correctly_regardless_position_after_a_delete (
 
 	const char * db_path = strdup (get_temp_db_path ().c_str ());
 	const char * key = "my_key";
-	HashTableOpts opts;
+	HashTableOpts opts = dht_zero_opts ();
 	opts.key_maxlen = strlen (key) + 1;
 	opts.object_datalen = sizeof (int);
 	int flags = O_RDWR | O_CREAT;
@@ -1098,7 +1370,7 @@ void diskhash_deletes_correctly ()
 {
 	const char * db_path = strdup (get_temp_db_path ().c_str ());
 	const char * key = "my_biggest_key";
-	HashTableOpts opts;
+	HashTableOpts opts = dht_zero_opts ();
 	opts.key_maxlen = strlen (key) + 1;
 	opts.object_datalen = sizeof (int);
 	int flags = O_RDWR | O_CREAT;
@@ -1152,7 +1424,7 @@ void diskhath_deleting_in_the_last_ht_position ()
 
 	const char * db_path = strdup (get_temp_db_path ().c_str ());
 	const char * key = strdup("y5FHUaBpZINhgvEmf8A");
-	HashTableOpts opts;
+	HashTableOpts opts = dht_zero_opts ();
 	opts.key_maxlen = strlen (key) + 1;
 	opts.object_datalen = sizeof (int);
 	int flags = O_RDWR | O_CREAT;
@@ -1181,7 +1453,7 @@ void diskhash_deletes_three_entries_correctly ()
 
 	const char * db_path = strdup (get_temp_db_path ().c_str ());
 	const char * key = "my_biggest_key";
-	HashTableOpts opts;
+	HashTableOpts opts = dht_zero_opts ();
 	opts.key_maxlen = strlen (key) + 1;
 	opts.object_datalen = sizeof (int);
 	int flags = O_RDWR | O_CREAT;
@@ -1238,7 +1510,7 @@ void diskhash_deletes_a_collision_correctly ()
 
 	const char * db_path = strdup (get_temp_db_path ().c_str ());
 	const char * key = "my_biggest_key";
-	HashTableOpts opts;
+	HashTableOpts opts = dht_zero_opts ();
 	opts.key_maxlen = strlen (key) + 1;
 	opts.object_datalen = sizeof (int);
 	int flags = O_RDWR | O_CREAT;
@@ -1299,7 +1571,7 @@ void diskhash_deletes_more_than_one_collision_correctly ()
 
 	const char * db_path = strdup (get_temp_db_path ().c_str ());
 	const char * key = "my_biggest_key";
-	HashTableOpts opts;
+	HashTableOpts opts = dht_zero_opts ();
 	opts.key_maxlen = strlen (key) + 1;
 	opts.object_datalen = sizeof (int);
 	int flags = O_RDWR | O_CREAT;
@@ -1359,7 +1631,7 @@ void diskhash_deletes_collision_with_filled_slot_correctly ()
 
 	const char * db_path = strdup (get_temp_db_path ().c_str ());
 	const char * key = "my_biggest_key";
-	HashTableOpts opts;
+	HashTableOpts opts = dht_zero_opts ();
 	opts.key_maxlen = strlen (key) + 1;
 	opts.object_datalen = sizeof (int);
 	int flags = O_RDWR | O_CREAT;
@@ -1420,7 +1692,7 @@ void diskhash_deletes_first_slot_no_collision_correctly ()
 
 	const char * db_path = strdup (get_temp_db_path ().c_str ());
 	const char * key = "my_biggest_key";
-	HashTableOpts opts;
+	HashTableOpts opts = dht_zero_opts ();
 	opts.key_maxlen = strlen (key) + 1;
 	opts.object_datalen = sizeof (int);
 	int flags = O_RDWR | O_CREAT;
@@ -1484,7 +1756,7 @@ void diskhash_reserve_is_not_affected_by_deleted_entries ()
 {
 	const char * db_path = strdup (get_temp_db_path ().c_str ());
 	const char * key = "my_biggest_key";
-	HashTableOpts opts;
+	HashTableOpts opts = dht_zero_opts ();
 	opts.key_maxlen = strlen (key) + 1;
 	opts.object_datalen = sizeof (int);
 	int flags = O_RDWR | O_CREAT;
@@ -1509,7 +1781,7 @@ void diskhash_check_cursor_points_correctly ()
 {
 	const char * db_path = strdup (get_temp_db_path ().c_str ());
 	const char * key = "my_key";
-	HashTableOpts opts;
+	HashTableOpts opts = dht_zero_opts ();
 	opts.key_maxlen = strlen (key) + 1;
 	opts.object_datalen = sizeof (int);
 	int flags = O_RDWR | O_CREAT;
@@ -1538,3 +1810,1610 @@ void diskhash_check_cursor_points_correctly ()
 	free ((char *)db_path);
 	dht_free (ht);
 }
+
+void diskhash_control_bytes_insert_lookup_delete_works ()
+{
+	HashTableOpts opts = dht_zero_opts ();
+	opts.key_maxlen = 15;
+	opts.object_datalen = sizeof (int);
+	opts.flags = DHT_OPT_CONTROL_BYTES;
+	check_table_roundtrip (opts, 5000);
+}
+
+void diskhash_control_bytes_flags_mismatch_returns_error ()
+{
+	const char * db_path = strdup (get_temp_db_path ().c_str ());
+	HashTableOpts opts = dht_zero_opts ();
+	opts.key_maxlen = 15;
+	opts.object_datalen = sizeof (int);
+	char * err = NULL;
+	HashTable * ht = dht_open (db_path, opts, O_RDWR | O_CREAT, &err);
+	assert (ht);
+	dht_free (ht);
+
+	opts.flags = DHT_OPT_CONTROL_BYTES;
+	ht = dht_open (db_path, opts, O_RDWR, &err);
+	assert (!ht);
+	assert (!strcmp ("Options mismatch (diskhash table on disk was not created with the same options used to open it).", err));
+
+	free ((char *)err);
+	free ((char *)db_path);
+}
+
+void diskhash_robin_hood_insert_lookup_delete_works ()
+{
+	HashTableOpts opts = dht_zero_opts ();
+	opts.key_maxlen = 15;
+	opts.object_datalen = sizeof (int);
+	opts.flags = DHT_OPT_ROBIN_HOOD;
+	check_table_roundtrip (opts, 5000);
+}
+
+void diskhash_robin_hood_with_control_bytes_works ()
+{
+	HashTableOpts opts = dht_zero_opts ();
+	opts.key_maxlen = 15;
+	opts.object_datalen = sizeof (int);
+	opts.flags = DHT_OPT_ROBIN_HOOD | DHT_OPT_CONTROL_BYTES;
+	check_table_roundtrip (opts, 5000);
+}
+
+void diskhash_robin_hood_has_higher_max_load ()
+{
+	const char * db_path = strdup (get_temp_db_path ().c_str ());
+	HashTableOpts opts = dht_zero_opts ();
+	opts.key_maxlen = 15;
+	opts.object_datalen = sizeof (int);
+	opts.flags = DHT_OPT_ROBIN_HOOD;
+	char * err = NULL;
+	HashTable * ht = dht_open (db_path, opts, O_RDWR | O_CREAT, &err);
+
+	// 85% of the initial 7 slots
+	assert (dht_capacity (ht) == 5);
+	size_t capacity = dht_reserve (ht, 1000, &err);
+	assert (capacity >= 1000);
+
+	free ((char *)db_path);
+	dht_free (ht);
+}
+
+void diskhash_fingerprints_insert_lookup_delete_works ()
+{
+	HashTableOpts opts = dht_zero_opts ();
+	opts.key_maxlen = 15;
+	opts.object_datalen = sizeof (int);
+	opts.flags = DHT_OPT_FINGERPRINTS;
+	check_table_roundtrip (opts, 5000);
+}
+
+void diskhash_fingerprints_with_robin_hood_works ()
+{
+	HashTableOpts opts = dht_zero_opts ();
+	opts.key_maxlen = 15;
+	opts.object_datalen = sizeof (int);
+	opts.flags = DHT_OPT_FINGERPRINTS | DHT_OPT_ROBIN_HOOD;
+	check_table_roundtrip (opts, 5000);
+}
+
+void diskhash_fastrange_insert_lookup_delete_works ()
+{
+	HashTableOpts opts = dht_zero_opts ();
+	opts.key_maxlen = 15;
+	opts.object_datalen = sizeof (int);
+	opts.flags = DHT_OPT_FASTRANGE;
+	check_table_roundtrip (opts, 5000);
+}
+
+void diskhash_fastrange_with_all_options_works ()
+{
+	HashTableOpts opts = dht_zero_opts ();
+	opts.key_maxlen = 15;
+	opts.object_datalen = sizeof (int);
+	opts.flags = DHT_OPT_FASTRANGE | DHT_OPT_CONTROL_BYTES | DHT_OPT_ROBIN_HOOD | DHT_OPT_FINGERPRINTS;
+	check_table_roundtrip (opts, 5000);
+}
+
+void diskhash_wyhash_insert_lookup_delete_works ()
+{
+	HashTableOpts opts = dht_zero_opts ();
+	opts.key_maxlen = 15;
+	opts.object_datalen = sizeof (int);
+	opts.flags = DHT_OPT_WYHASH;
+	check_table_roundtrip (opts, 5000);
+}
+
+void diskhash_crc32c_hash_insert_lookup_delete_works ()
+{
+	HashTableOpts opts = dht_zero_opts ();
+	opts.key_maxlen = 15;
+	opts.object_datalen = sizeof (int);
+	opts.flags = DHT_OPT_CRC32C_HASH | DHT_OPT_CONTROL_BYTES;
+	check_table_roundtrip (opts, 5000);
+}
+
+void diskhash_hash_functions_work_for_all_key_lengths ()
+{
+	const unsigned int hash_flags[] = { DHT_OPT_WYHASH, DHT_OPT_CRC32C_HASH };
+	for (unsigned int flags : hash_flags) {
+		const char * db_path = strdup (get_temp_db_path ().c_str ());
+		HashTableOpts opts = dht_zero_opts ();
+		opts.key_maxlen = 127;
+		opts.object_datalen = sizeof (int);
+		opts.flags = flags;
+		char * err = NULL;
+		HashTable * ht = dht_open (db_path, opts, O_RDWR | O_CREAT, &err);
+		assert (ht);
+
+		// keys of the same length only differ in one byte
+		char key[128];
+		int n = 0;
+		for (int len = 1; len < 120; ++len) {
+			for (int pos = 0; pos < len; ++pos) {
+				memset (key, 'a', len);
+				key[len] = '\0';
+				key[pos] = 'b';
+				assert (dht_insert (ht, key, &n, &err) == 1);
+				++n;
+			}
+		}
+		assert ((int)dht_size (ht) == n);
+		n = 0;
+		for (int len = 1; len < 120; ++len) {
+			memset (key, 'a', len);
+			key[len] = '\0';
+			assert (dht_lookup (ht, key) == NULL);
+			for (int pos = 0; pos < len; ++pos) {
+				key[pos] = 'b';
+				int * read_val = (int *)dht_lookup (ht, key);
+				assert (read_val && *read_val == n);
+				key[pos] = 'a';
+				++n;
+			}
+		}
+
+		free ((char *)db_path);
+		dht_free (ht);
+	}
+}
+
+void diskhash_two_hash_functions_returns_error ()
+{
+	const char * db_path = strdup (get_temp_db_path ().c_str ());
+	HashTableOpts opts = dht_zero_opts ();
+	opts.key_maxlen = 15;
+	opts.object_datalen = sizeof (int);
+	opts.flags = DHT_OPT_WYHASH | DHT_OPT_CRC32C_HASH;
+	char * err = NULL;
+	HashTable * ht = dht_open (db_path, opts, O_RDWR | O_CREAT, &err);
+	assert (!ht);
+	assert (!strcmp ("At most one hash function can be selected.", err));
+
+	free ((char *)err);
+	free ((char *)db_path);
+}
+
+void diskhash_key_lengths_insert_lookup_delete_works ()
+{
+	HashTableOpts opts = dht_zero_opts ();
+	opts.key_maxlen = 15;
+	opts.object_datalen = sizeof (int);
+	opts.flags = DHT_OPT_KEY_LENGTHS | DHT_OPT_WYHASH;
+	check_table_roundtrip (opts, 5000);
+}
+
+void diskhash_key_lengths_binary_keys_work ()
+{
+	const char * db_path = strdup (get_temp_db_path ().c_str ());
+	HashTableOpts opts = dht_zero_opts ();
+	opts.key_maxlen = 15;
+	opts.object_datalen = sizeof (int);
+	opts.flags = DHT_OPT_KEY_LENGTHS;
+	char * err = NULL;
+	HashTable * ht = dht_open (db_path, opts, O_RDWR | O_CREAT, &err);
+	assert (ht);
+
+	// all different keys, only distinguished by their length or what comes
+	// after a NUL byte
+	const char keys[] = "a\0b\0c";
+	const size_t lengths[] = { 1, 2, 3, 4, 5 };
+	for (int i = 0; i < 5; ++i) {
+		assert (dht_insert_n (ht, keys, lengths[i], &i, &err) == 1);
+		assert (dht_insert_n (ht, keys, lengths[i], &i, &err) == 0);
+	}
+	assert (dht_insert_n (ht, "a\0c", 3, &lengths, &err) == 1);
+	assert (dht_size (ht) == 6);
+	// grows the table, which rehashes all the keys
+	dht_reserve (ht, 100, &err);
+	for (int i = 0; i < 5; ++i) {
+		int * read_val = (int *)dht_lookup_n (ht, keys, lengths[i]);
+		assert (read_val && *read_val == i);
+	}
+	assert (dht_lookup_n (ht, "a\0d", 3) == NULL);
+	assert (*(int *)dht_lookup (ht, "a") == 0);
+	assert (dht_delete_n (ht, keys, 3, &err) == 1);
+	assert (dht_lookup_n (ht, keys, 3) == NULL);
+	assert (dht_lookup_n (ht, keys, 2) != NULL);
+	assert (dht_lookup_n (ht, "a\0c", 3) != NULL);
+
+	free ((char *)db_path);
+	dht_free (ht);
+}
+
+void diskhash_n_functions_work_without_key_lengths ()
+{
+	const char * db_path = strdup (get_temp_db_path ().c_str ());
+	HashTableOpts opts = dht_zero_opts ();
+	opts.key_maxlen = 15;
+	opts.object_datalen = sizeof (int);
+	char * err = NULL;
+	HashTable * ht = dht_open (db_path, opts, O_RDWR | O_CREAT, &err);
+	assert (ht);
+
+	int value = 7;
+	assert (dht_insert_n (ht, "hello world", 5, &value, &err) == 1);
+	assert (dht_lookup (ht, "hello") != NULL);
+	assert (dht_lookup_n (ht, "hello!", 5) != NULL);
+	assert (dht_lookup_n (ht, "hello!", 6) == NULL);
+	assert (dht_lookup_n (ht, "hell", 4) == NULL);
+	assert (dht_lookup_n (ht, "hello\0", 6) == NULL);
+	assert (dht_lookup_n (ht, "a very long key indeed", 22) == NULL);
+
+	assert (dht_insert_n (ht, "a\0b", 3, &value, &err) == -EINVAL);
+	assert (!strcmp ("Key contains NUL bytes (only tables created with DHT_OPT_KEY_LENGTHS can store them).", err));
+	free (err);
+	err = NULL;
+
+	assert (dht_delete_n (ht, "hello world", 5, &err) == 1);
+	assert (dht_size (ht) == 0);
+
+	free ((char *)db_path);
+	dht_free (ht);
+}
+
+void diskhash_key_arena_insert_lookup_delete_works ()
+{
+	HashTableOpts opts = dht_zero_opts ();
+	opts.key_maxlen = 15;
+	opts.object_datalen = sizeof (int);
+	opts.flags = DHT_OPT_KEY_ARENA | DHT_OPT_KEY_LENGTHS;
+	check_table_roundtrip (opts, 5000);
+}
+
+void diskhash_key_arena_long_keys_work ()
+{
+	const char * db_path = strdup (get_temp_db_path ().c_str ());
+	HashTableOpts opts = dht_zero_opts ();
+	opts.key_maxlen = 1024;
+	opts.object_datalen = sizeof (int);
+	opts.flags = DHT_OPT_KEY_ARENA | DHT_OPT_KEY_LENGTHS;
+	char * err = NULL;
+	HashTable * ht = dht_open (db_path, opts, O_RDWR | O_CREAT, &err);
+	assert (ht);
+
+	// keys share a long prefix, so that they differ only after the part
+	// kept in the store table; some are short enough to be stored inline
+	const int nr_keys = 2000;
+	std::vector<std::string> keys;
+	for (int i = 0; i < nr_keys; ++i) {
+		std::string key (i % 3 == 0 ? 4 : 24 + (i % 7) * 30, 'k');
+		key += std::to_string (i);
+		keys.push_back (key);
+		assert (dht_insert_n (ht, key.data (), key.size (), &i, &err) == 1);
+	}
+	for (int i = 0; i < nr_keys; ++i) {
+		assert (dht_insert_n (ht, keys[i].data (), keys[i].size (), &i, &err) == 0);
+	}
+	for (int i = 0; i < nr_keys; i += 2) {
+		assert (dht_delete_n (ht, keys[i].data (), keys[i].size (), &err) == 1);
+	}
+	// rebuilding the table drops the deleted keys from the arena
+	dht_reserve (ht, 4 * nr_keys, &err);
+	dht_free (ht);
+
+	ht = dht_open (db_path, dht_zero_opts (), O_RDWR, &err);
+	assert (ht);
+	assert (dht_size (ht) == nr_keys / 2);
+	for (int i = 0; i < nr_keys; ++i) {
+		int * read_val = (int *)dht_lookup_n (ht, keys[i].data (), keys[i].size ());
+		if (i % 2) {
+			assert (read_val && *read_val == i);
+		} else {
+			assert (!read_val);
+		}
+	}
+	std::string other = keys[1];
+	other[other.size () - 1] = 'x';
+	assert (dht_lookup_n (ht, other.data (), other.size ()) == NULL);
+
+	free ((char *)db_path);
+	dht_free (ht);
+}
+
+void diskhash_key_arena_requires_key_lengths_returns_error ()
+{
+	const char * db_path = strdup (get_temp_db_path ().c_str ());
+	HashTableOpts opts = dht_zero_opts ();
+	opts.key_maxlen = 15;
+	opts.object_datalen = sizeof (int);
+	opts.flags = DHT_OPT_KEY_ARENA;
+	char * err = NULL;
+	HashTable * ht = dht_open (db_path, opts, O_RDWR | O_CREAT, &err);
+	assert (!ht);
+	assert (!strcmp ("DHT_OPT_KEY_ARENA requires DHT_OPT_KEY_LENGTHS.", err));
+
+	free ((char *)err);
+	free ((char *)db_path);
+}
+
+void diskhash_fixed_keys_insert_lookup_delete_works ()
+{
+	const unsigned int extra_flags[] = {
+		0,
+		DHT_OPT_CONTROL_BYTES | DHT_OPT_FASTRANGE,
+		DHT_OPT_ROBIN_HOOD | DHT_OPT_FINGERPRINTS,
+	};
+	for (unsigned int flags : extra_flags) {
+		const char * db_path = strdup (get_temp_db_path ().c_str ());
+		HashTableOpts opts = dht_zero_opts ();
+		opts.key_maxlen = 32;
+		opts.object_datalen = sizeof (int);
+		opts.flags = DHT_OPT_FIXED_KEYS | flags;
+		char * err = NULL;
+		HashTable * ht = dht_open (db_path, opts, O_RDWR | O_CREAT, &err);
+		assert (ht);
+
+		// random 32-byte "digests", with NUL bytes here and there
+		const int nr_keys = 3000;
+		std::mt19937_64 rng (flags);
+		std::vector<std::string> keys;
+		for (int i = 0; i < nr_keys; ++i) {
+			std::string key (32, '\0');
+			for (int j = 0; j < 32; j += 8) {
+				const uint64_t r = rng ();
+				memcpy (&key[j], &r, sizeof (r));
+			}
+			key[i % 32] = '\0';
+			keys.push_back (key);
+			assert (dht_insert_n (ht, key.data (), key.size (), &i, &err) == 1);
+			assert (dht_insert (ht, key.data (), &i, &err) == 0);
+		}
+		assert (dht_size (ht) == nr_keys);
+
+		assert (dht_insert_n (ht, keys[0].data (), 31, &nr_keys, &err) == -EINVAL);
+		assert (!strcmp ("Key is too short.", err));
+		free (err);
+		err = NULL;
+		assert (dht_lookup_n (ht, keys[0].data (), 31) == NULL);
+
+		for (int i = 0; i < nr_keys; i += 2) {
+			assert (dht_delete (ht, keys[i].data (), &err) == 1);
+		}
+		dht_free (ht);
+
+		ht = dht_open (db_path, dht_zero_opts (), O_RDWR, &err);
+		assert (ht);
+		assert (dht_size (ht) == nr_keys / 2);
+		for (int i = 0; i < nr_keys; ++i) {
+			int * read_val = (int *)dht_lookup_n (ht, keys[i].data (), keys[i].size ());
+			if (i % 2) {
+				assert (read_val && *read_val == i);
+			} else {
+				assert (!read_val);
+			}
+		}
+		// store entries are in insertion order (none were reused)
+		char key_buffer[32];
+		char * key_ptr = key_buffer;
+		int value;
+		assert (dht_indexed_lookup (ht, 1, &key_ptr, &value, &err) == 1);
+		assert (value == 1 && !memcmp (key_buffer, keys[1].data (), 32));
+
+		free ((char *)db_path);
+		dht_free (ht);
+	}
+}
+
+void diskhash_fixed_keys_invalid_options_return_error ()
+{
+	const unsigned int invalid_flags[] = {
+		DHT_OPT_FIXED_KEYS | DHT_OPT_WYHASH,
+		DHT_OPT_FIXED_KEYS | DHT_OPT_KEY_LENGTHS,
+		DHT_OPT_FIXED_KEYS,
+	};
+	const char * messages[] = {
+		"DHT_OPT_FIXED_KEYS tables do not hash their keys (no hash function can be selected).",
+		"DHT_OPT_FIXED_KEYS cannot be combined with DHT_OPT_KEY_LENGTHS or DHT_OPT_KEY_ARENA.",
+		"DHT_OPT_FIXED_KEYS requires keys of at least 8 bytes.",
+	};
+	for (int i = 0; i < 3; ++i) {
+		const char * db_path = strdup (get_temp_db_path ().c_str ());
+		HashTableOpts opts = dht_zero_opts ();
+		opts.key_maxlen = (i == 2) ? 4 : 32;
+		opts.object_datalen = sizeof (int);
+		opts.flags = invalid_flags[i];
+		char * err = NULL;
+		HashTable * ht = dht_open (db_path, opts, O_RDWR | O_CREAT, &err);
+		assert (!ht);
+		assert (!strcmp (messages[i], err));
+
+		free ((char *)err);
+		free ((char *)db_path);
+	}
+}
+
+void diskhash_cuckoo_insert_lookup_delete_works ()
+{
+	const unsigned int flags[] = {
+		DHT_OPT_CUCKOO,
+		DHT_OPT_CUCKOO | DHT_OPT_FINGERPRINTS,
+		DHT_OPT_CUCKOO | DHT_OPT_FINGERPRINTS | DHT_OPT_FASTRANGE | DHT_OPT_WYHASH,
+	};
+	for (unsigned int f : flags) {
+		HashTableOpts opts = dht_zero_opts ();
+		opts.key_maxlen = 15;
+		opts.object_datalen = sizeof (int);
+		opts.flags = f;
+		check_table_roundtrip (opts, 5000);
+	}
+}
+
+void diskhash_cuckoo_reaches_max_load_without_growing ()
+{
+	const char * db_path = strdup (get_temp_db_path ().c_str ());
+	HashTableOpts opts = dht_zero_opts ();
+	opts.key_maxlen = 15;
+	opts.object_datalen = sizeof (int);
+	opts.flags = DHT_OPT_CUCKOO | DHT_OPT_FINGERPRINTS;
+	char * err = NULL;
+	char key[32];
+	HashTable * ht = dht_open (db_path, opts, O_RDWR | O_CREAT, &err);
+	assert (ht);
+
+	// 90% of the initial 7 buckets of 8 slots
+	assert (dht_capacity (ht) == 50);
+	const size_t capacity = dht_reserve (ht, 20000, &err);
+	assert (capacity >= 20000);
+	// filling the table up to its capacity moves entries between buckets,
+	// but does not need to grow it
+	for (int i = 0; i < (int)capacity; ++i) {
+		snprintf (key, sizeof (key), "key-%d", i);
+		assert (dht_insert (ht, key, &i, &err) == 1);
+	}
+	assert (dht_capacity (ht) == capacity);
+	for (int i = 0; i < (int)capacity; ++i) {
+		snprintf (key, sizeof (key), "key-%d", i);
+		int * read_val = (int *)dht_lookup (ht, key);
+		assert (read_val && *read_val == i);
+	}
+
+	free ((char *)db_path);
+	dht_free (ht);
+}
+
+void diskhash_cuckoo_with_robin_hood_returns_error ()
+{
+	const char * db_path = strdup (get_temp_db_path ().c_str ());
+	HashTableOpts opts = dht_zero_opts ();
+	opts.key_maxlen = 15;
+	opts.object_datalen = sizeof (int);
+	opts.flags = DHT_OPT_CUCKOO | DHT_OPT_ROBIN_HOOD;
+	char * err = NULL;
+	HashTable * ht = dht_open (db_path, opts, O_RDWR | O_CREAT, &err);
+	assert (!ht);
+	assert (!strcmp ("DHT_OPT_CUCKOO cannot be combined with DHT_OPT_CONTROL_BYTES or DHT_OPT_ROBIN_HOOD.", err));
+
+	free ((char *)err);
+	free ((char *)db_path);
+}
+
+void diskhash_columnar_insert_lookup_delete_works ()
+{
+	const unsigned int flags[] = {
+		DHT_OPT_COLUMNAR,
+		DHT_OPT_COLUMNAR | DHT_OPT_KEY_LENGTHS | DHT_OPT_KEY_ARENA,
+		DHT_OPT_COLUMNAR | DHT_OPT_CUCKOO | DHT_OPT_FINGERPRINTS,
+		DHT_OPT_COLUMNAR | DHT_OPT_ROBIN_HOOD | DHT_OPT_CONTROL_BYTES,
+	};
+	for (unsigned int f : flags) {
+		HashTableOpts opts = dht_zero_opts ();
+		opts.key_maxlen = 15;
+		opts.object_datalen = 3;
+		opts.flags = f;
+		check_table_roundtrip (opts, 5000);
+	}
+}
+
+void diskhash_columnar_indexed_lookup_works ()
+{
+	const char * db_path = strdup (get_temp_db_path ().c_str ());
+	HashTableOpts opts = dht_zero_opts ();
+	opts.key_maxlen = 15;
+	opts.object_datalen = sizeof (int);
+	opts.flags = DHT_OPT_COLUMNAR | DHT_OPT_KEY_LENGTHS;
+	char * err = NULL;
+	char key[16];
+	HashTable * ht = dht_open (db_path, opts, O_RDWR | O_CREAT, &err);
+	assert (ht);
+
+	for (int i = 0; i < 100; ++i) {
+		snprintf (key, sizeof (key), "key-%d", i);
+		assert (dht_insert (ht, key, &i, &err) == 1);
+	}
+	// entries are stored in insertion order, across all three columns
+	char buffer[16];
+	char * key_ptr = buffer;
+	for (int i = 0; i < 100; ++i) {
+		int value;
+		snprintf (key, sizeof (key), "key-%d", i);
+		assert (dht_indexed_lookup (ht, i, &key_ptr, &value, &err) == 1);
+		assert (value == i && !strcmp (buffer, key));
+	}
+
+	free ((char *)db_path);
+	dht_free (ht);
+}
+
+void diskhash_huge_pages_insert_lookup_delete_works ()
+{
+	HashTableOpts opts = dht_zero_opts ();
+	opts.key_maxlen = 15;
+	opts.object_datalen = sizeof (int);
+	opts.flags = DHT_OPT_HUGE_PAGES | DHT_OPT_KEY_LENGTHS | DHT_OPT_KEY_ARENA;
+	check_table_roundtrip (opts, 5000);
+}
+
+void diskhash_huge_pages_load_to_memory_works ()
+{
+	const char * db_path = strdup (get_temp_db_path ().c_str ());
+	HashTableOpts opts = dht_zero_opts ();
+	opts.key_maxlen = 15;
+	opts.object_datalen = sizeof (int);
+	opts.flags = DHT_OPT_HUGE_PAGES;
+	char * err = NULL;
+	char key[16];
+	HashTable * ht = dht_open (db_path, opts, O_RDWR | O_CREAT, &err);
+	assert (ht);
+	for (int i = 0; i < 1000; ++i) {
+		snprintf (key, sizeof (key), "key-%d", i);
+		assert (dht_insert (ht, key, &i, &err) == 1);
+	}
+	// whether huge pages were obtained depends on the system
+	assert (dht_huge_page_bytes (ht) <= ht->datasize_);
+	dht_free (ht);
+
+	ht = dht_open (db_path, dht_zero_opts (), O_RDONLY, &err);
+	assert (ht);
+	assert (dht_load_to_memory (ht, &err) == 0);
+	for (int i = 0; i < 1000; ++i) {
+		snprintf (key, sizeof (key), "key-%d", i);
+		int * read_val = (int *)dht_lookup (ht, key);
+		assert (read_val && *read_val == i);
+	}
+	assert (dht_huge_page_bytes (ht) <= ht->datasize_ + 2 * 1024 * 1024);
+
+	free ((char *)db_path);
+	dht_free (ht);
+}
+
+void diskhash_advise_works ()
+{
+	const char * db_path = strdup (get_temp_db_path ().c_str ());
+	HashTableOpts opts = dht_zero_opts ();
+	opts.key_maxlen = 63;
+	opts.object_datalen = sizeof (int);
+	opts.flags = DHT_OPT_CONTROL_BYTES | DHT_OPT_KEY_LENGTHS | DHT_OPT_KEY_ARENA;
+	char * err = NULL;
+	char key[64];
+	HashTable * ht = dht_open (db_path, opts, O_RDWR | O_CREAT, &err);
+	assert (ht);
+	for (int i = 0; i < 1000; ++i) {
+		snprintf (key, sizeof (key), "a key long enough to go to the arena %d", i);
+		assert (dht_insert (ht, key, &i, &err) == 1);
+	}
+	const int advice[] = {
+		DHT_ADVICE_RANDOM,
+		DHT_ADVICE_SEQUENTIAL,
+		DHT_ADVICE_WILLNEED,
+		DHT_ADVICE_COLD,
+		DHT_ADVICE_PAGEOUT,
+		DHT_ADVICE_NORMAL,
+	};
+	for (int a : advice) {
+		const int r = dht_advise (ht, DHT_REGION_ALL, a, &err);
+		if (r == -ENOTSUP) {
+			// COLD and PAGEOUT are Linux only
+			free (err);
+			err = NULL;
+			continue;
+		}
+		assert (r == 1);
+	}
+	assert (dht_advise (ht, DHT_REGION_INDEX, DHT_ADVICE_WILLNEED, &err) == 1);
+	assert (dht_advise (ht, DHT_REGION_STORE | DHT_REGION_ARENA, DHT_ADVICE_COLD, NULL) <= 1);
+	// the contents are not affected
+	for (int i = 0; i < 1000; ++i) {
+		snprintf (key, sizeof (key), "a key long enough to go to the arena %d", i);
+		int * read_val = (int *)dht_lookup (ht, key);
+		assert (read_val && *read_val == i);
+	}
+	dht_free (ht);
+
+	ht = dht_open (db_path, dht_zero_opts (), O_RDONLY, &err);
+	assert (ht);
+	assert (dht_load_to_memory (ht, &err) == 0);
+	assert (dht_advise (ht, DHT_REGION_INDEX, DHT_ADVICE_RANDOM, &err) == 1);
+
+	free ((char *)db_path);
+	dht_free (ht);
+}
+
+void diskhash_advise_invalid_arguments_return_error ()
+{
+	const char * db_path = strdup (get_temp_db_path ().c_str ());
+	HashTableOpts opts = dht_zero_opts ();
+	opts.key_maxlen = 15;
+	opts.object_datalen = sizeof (int);
+	char * err = NULL;
+	HashTable * ht = dht_open (db_path, opts, O_RDWR | O_CREAT, &err);
+	assert (ht);
+
+	assert (dht_advise (ht, 16, DHT_ADVICE_RANDOM, &err) == -EINVAL);
+	assert (!strcmp ("Unknown table region.", err));
+	free (err);
+	err = NULL;
+	assert (dht_advise (ht, DHT_REGION_INDEX, 42, &err) == -EINVAL);
+	assert (!strcmp ("Unknown access pattern advice.", err));
+	free (err);
+
+	free ((char *)db_path);
+	dht_free (ht);
+}
+
+void diskhash_lookup_batch_matches_lookup ()
+{
+	const unsigned int flags[] = {
+		0,
+		DHT_OPT_FASTRANGE,
+		DHT_OPT_CONTROL_BYTES,
+		DHT_OPT_CONTROL_BYTES | DHT_OPT_FINGERPRINTS,
+		DHT_OPT_ROBIN_HOOD,
+		DHT_OPT_ROBIN_HOOD | DHT_OPT_FINGERPRINTS,
+		DHT_OPT_CUCKOO,
+		DHT_OPT_CUCKOO | DHT_OPT_FINGERPRINTS,
+		DHT_OPT_COLUMNAR | DHT_OPT_KEY_LENGTHS | DHT_OPT_KEY_ARENA,
+		DHT_OPT_WYHASH,
+		DHT_OPT_CRC32C_HASH,
+	};
+	const int n = 3000;
+	for (unsigned int f : flags) {
+		const char * db_path = strdup (get_temp_db_path ().c_str ());
+		HashTableOpts opts = dht_zero_opts ();
+		opts.key_maxlen = 20;
+		opts.object_datalen = sizeof (int);
+		opts.flags = f;
+		char * err = NULL;
+		char key[32];
+		HashTable * ht = dht_open (db_path, opts, O_RDWR | O_CREAT, &err);
+		assert (ht);
+		for (int i = 0; i < n; ++i) {
+			snprintf (key, sizeof (key), "key-%d", i);
+			assert (dht_insert (ht, key, &i, &err) == 1);
+		}
+		// every third key is missing, and the last one is too long for the table
+		std::vector<std::string> keys;
+		for (int i = 0; i < n; ++i) {
+			snprintf (key, sizeof (key), (i % 3) ? "key-%d" : "other-%d-padded", i);
+			keys.push_back (key);
+		}
+		keys.push_back ("a key that is much too long");
+		std::vector<const char *> key_ptrs;
+		for (const std::string & k : keys) key_ptrs.push_back (k.c_str ());
+		std::vector<void *> out (keys.size (), (void *)&err);
+
+		const size_t found = dht_lookup_batch (ht, key_ptrs.data (), key_ptrs.size (), out.data ());
+		assert (found == (size_t)(n - (n + 2) / 3));
+		for (size_t i = 0; i < keys.size (); ++i) {
+			assert (out[i] == dht_lookup (ht, key_ptrs[i]));
+			if (out[i]) assert (*(int *)out[i] == (int)i);
+		}
+		assert (dht_lookup_batch (ht, key_ptrs.data (), 0, out.data ()) == 0);
+
+		free ((char *)db_path);
+		dht_free (ht);
+	}
+}
+
+void diskhash_incremental_growth_works ()
+{
+	const unsigned int flags[] = {
+		0,
+		DHT_OPT_CONTROL_BYTES,
+		DHT_OPT_ROBIN_HOOD,
+		DHT_OPT_ROBIN_HOOD | DHT_OPT_FINGERPRINTS,
+		DHT_OPT_CUCKOO | DHT_OPT_FINGERPRINTS,
+		DHT_OPT_COLUMNAR | DHT_OPT_KEY_LENGTHS | DHT_OPT_KEY_ARENA,
+	};
+	const int n = 4000;
+	for (unsigned int f : flags) {
+		const char * db_path = strdup (get_temp_db_path ().c_str ());
+		HashTableOpts opts = dht_zero_opts ();
+		opts.key_maxlen = 20;
+		opts.object_datalen = sizeof (int);
+		opts.flags = f;
+		char * err = NULL;
+		char key[32];
+		HashTable * ht = dht_open (db_path, opts, O_RDWR | O_CREAT, &err);
+		assert (ht);
+		assert (dht_set_growth_step (ht, 2, &err) == 1);
+		std::vector<bool> deleted (n, false);
+		int size = 0;
+		bool grew = false;
+		for (int i = 0; i < n; ++i) {
+			snprintf (key, sizeof (key), "key-%d", i);
+			assert (dht_insert (ht, key, &i, &err) == 1);
+			assert (dht_insert (ht, key, &i, &err) == 0);
+			++size;
+			grew = grew || ht->growth_;
+			// deletes reach keys on both sides of the growth
+			if (i % 5 == 4 && !deleted[i / 3]) {
+				snprintf (key, sizeof (key), "key-%d", i / 3);
+				assert (dht_delete (ht, key, &err) == 1);
+				assert (dht_delete (ht, key, &err) == 0);
+				free (err);
+				err = NULL;
+				deleted[i / 3] = true;
+				--size;
+			}
+			assert ((int)dht_size (ht) == size);
+			for (int j : { i, i / 2, i / 3 }) {
+				snprintf (key, sizeof (key), "key-%d", j);
+				int * read_val = (int *)dht_lookup (ht, key);
+				if (deleted[j]) {
+					assert (read_val == NULL);
+				} else {
+					assert (read_val && *read_val == j);
+				}
+			}
+		}
+		assert (grew);
+		for (int i = 0; i < n; ++i) {
+			snprintf (key, sizeof (key), "key-%d", i);
+			int * read_val = (int *)dht_lookup (ht, key);
+			assert (deleted[i] ? read_val == NULL : (read_val && *read_val == i));
+		}
+		dht_free (ht);
+
+		ht = dht_open (db_path, dht_zero_opts (), O_RDONLY, &err);
+		assert (ht);
+		assert ((int)dht_size (ht) == size);
+		for (int i = 0; i < n; ++i) {
+			snprintf (key, sizeof (key), "key-%d", i);
+			int * read_val = (int *)dht_lookup (ht, key);
+			assert (deleted[i] ? read_val == NULL : (read_val && *read_val == i));
+		}
+
+		free ((char *)db_path);
+		dht_free (ht);
+	}
+}
+
+void diskhash_finish_growth_works ()
+{
+	const char * db_path = strdup (get_temp_db_path ().c_str ());
+	HashTableOpts opts = dht_zero_opts ();
+	opts.key_maxlen = 20;
+	opts.object_datalen = sizeof (int);
+	char * err = NULL;
+	char key[32];
+	HashTable * ht = dht_open (db_path, opts, O_RDWR | O_CREAT, &err);
+	assert (ht);
+	assert (dht_finish_growth (ht, &err) == 1);
+	assert (dht_set_growth_step (ht, 1, &err) == 1);
+	int i = 0;
+	for (int round = 0; round < 2; ++round) {
+		while (!ht->growth_) {
+			snprintf (key, sizeof (key), "key-%d", i);
+			assert (dht_insert (ht, key, &i, &err) == 1);
+			++i;
+		}
+		const size_t capacity = dht_capacity (ht);
+		assert ((int)dht_size (ht) == i);
+		if (round == 0) {
+			assert (dht_finish_growth (ht, &err) == 1);
+		} else {
+			// turning incremental growth off finishes the pending one
+			assert (dht_set_growth_step (ht, 0, &err) == 1);
+		}
+		assert (!ht->growth_);
+		assert (dht_capacity (ht) == capacity);
+		assert ((int)dht_size (ht) == i);
+		assert ((int)dht_slots_used (ht) == i);
+	}
+	for (int j = 0; j < i; ++j) {
+		snprintf (key, sizeof (key), "key-%d", j);
+		int * read_val = (int *)dht_lookup (ht, key);
+		assert (read_val && *read_val == j);
+	}
+
+	free ((char *)db_path);
+	dht_free (ht);
+}
+
+void diskhash_reserve_grows_in_place ()
+{
+	const unsigned int flags[] = {
+		0,
+		DHT_OPT_CONTROL_BYTES | DHT_OPT_FINGERPRINTS,
+		DHT_OPT_ROBIN_HOOD,
+		DHT_OPT_ROBIN_HOOD | DHT_OPT_FINGERPRINTS | DHT_OPT_FASTRANGE,
+		DHT_OPT_COLUMNAR | DHT_OPT_KEY_LENGTHS | DHT_OPT_KEY_ARENA,
+		DHT_OPT_CUCKOO,
+	};
+	const int n = 600;
+	for (unsigned int f : flags) {
+		const char * db_path = strdup (get_temp_db_path ().c_str ());
+		HashTableOpts opts = dht_zero_opts ();
+		opts.key_maxlen = 40;
+		opts.object_datalen = sizeof (int);
+		opts.flags = f;
+		char * err = NULL;
+		char key[64];
+		HashTable * ht = dht_open (db_path, opts, O_RDWR | O_CREAT, &err);
+		assert (ht);
+		for (int i = 0; i < n; ++i) {
+			snprintf (key, sizeof (key), (i % 4) ? "key-%d" : "a-long-key-that-goes-to-the-arena-%d", i);
+			assert (dht_insert (ht, key, &i, &err) == 1);
+		}
+		for (int i = 0; i < n; i += 3) {
+			snprintf (key, sizeof (key), (i % 4) ? "key-%d" : "a-long-key-that-goes-to-the-arena-%d", i);
+			assert (dht_delete (ht, key, &err) == 1);
+		}
+		const size_t dirty_slots = dht_dirty_slots (ht);
+		const size_t slots_used = dht_slots_used (ht);
+		assert (dht_reserve (ht, 10 * n, &err) >= (size_t)(10 * n));
+		assert (dht_capacity (ht) >= (size_t)(10 * n));
+		// in place, store entries stay where they are; cuckoo tables are rebuilt
+		if (f & DHT_OPT_CUCKOO) {
+			assert (dht_dirty_slots (ht) == 0);
+		} else {
+			assert (dht_dirty_slots (ht) == dirty_slots);
+			assert (dht_slots_used (ht) == slots_used);
+		}
+		for (int i = n; i < 2 * n; ++i) {
+			snprintf (key, sizeof (key), (i % 4) ? "key-%d" : "a-long-key-that-goes-to-the-arena-%d", i);
+			assert (dht_insert (ht, key, &i, &err) == 1);
+		}
+		dht_free (ht);
+
+		ht = dht_open (db_path, dht_zero_opts (), O_RDONLY, &err);
+		assert (ht);
+		assert ((int)dht_size (ht) == 2 * n - (n + 2) / 3);
+		for (int i = 0; i < 2 * n; ++i) {
+			snprintf (key, sizeof (key), (i % 4) ? "key-%d" : "a-long-key-that-goes-to-the-arena-%d", i);
+			int * read_val = (int *)dht_lookup (ht, key);
+			if (i < n && i % 3 == 0) {
+				assert (read_val == NULL);
+			} else {
+				assert (read_val && *read_val == i);
+			}
+		}
+
+		free ((char *)db_path);
+		dht_free (ht);
+	}
+}
+
+void diskhash_grow_in_place_clears_moved_regions ()
+{
+	const char * db_path = strdup (get_temp_db_path ().c_str ());
+	HashTableOpts opts = dht_zero_opts ();
+	opts.key_maxlen = 63;
+	opts.object_datalen = 3;
+	opts.flags = DHT_OPT_COLUMNAR | DHT_OPT_KEY_LENGTHS | DHT_OPT_KEY_ARENA;
+	char * err = NULL;
+	char key[64];
+	const char value[3] = { 1, 2, 3 };
+	const int n = 500;
+	HashTable * ht = dht_open (db_path, opts, O_RDWR | O_CREAT, &err);
+	assert (ht);
+	// the table grows in place several times, and the values of new entries
+	// are then where the key arena was, which must not show through their
+	// padding (values are padded to 8 bytes)
+	for (int i = 0; i < n; ++i) {
+		snprintf (key, sizeof (key), "a-long-key-that-goes-to-the-arena-%d", i);
+		assert (dht_insert (ht, key, value, &err) == 1);
+	}
+	for (int i = 0; i < n; ++i) {
+		snprintf (key, sizeof (key), "a-long-key-that-goes-to-the-arena-%d", i);
+		const char * read_val = (const char *)dht_lookup (ht, key);
+		assert (read_val && !memcmp (read_val, value, 3));
+		for (int j = 3; j < 8; ++j) assert (read_val[j] == 0);
+	}
+
+	free ((char *)db_path);
+	dht_free (ht);
+}
+
+void diskhash_parallel_rebuild_works ()
+{
+	const unsigned int flags[] = {
+		0,
+		DHT_OPT_CONTROL_BYTES | DHT_OPT_FASTRANGE,
+		DHT_OPT_ROBIN_HOOD,
+		DHT_OPT_ROBIN_HOOD | DHT_OPT_FINGERPRINTS | DHT_OPT_FASTRANGE,
+		DHT_OPT_COLUMNAR | DHT_OPT_KEY_LENGTHS | DHT_OPT_KEY_ARENA,
+	};
+	// large enough to be rebuilt in parallel
+	const int n = 80000;
+	for (unsigned int f : flags) {
+		const char * db_path = strdup (get_temp_db_path ().c_str ());
+		HashTableOpts opts = dht_zero_opts ();
+		opts.key_maxlen = 40;
+		opts.object_datalen = sizeof (int);
+		opts.flags = f;
+		char * err = NULL;
+		char key[64];
+		HashTable * ht = dht_open (db_path, opts, O_RDWR | O_CREAT, &err);
+		assert (ht);
+		assert (dht_set_rebuild_threads (ht, 4, &err) == 1);
+		for (int i = 0; i < n; ++i) {
+			snprintf (key, sizeof (key), (i % 4) ? "key-%d" : "a-long-key-for-the-arena-%d", i);
+			assert (dht_insert (ht, key, &i, &err) == 1);
+		}
+		for (int i = 0; i < n; i += 3) {
+			snprintf (key, sizeof (key), (i % 4) ? "key-%d" : "a-long-key-for-the-arena-%d", i);
+			assert (dht_delete (ht, key, &err) == 1);
+		}
+		const size_t slots_used = dht_slots_used (ht);
+		assert (dht_reserve (ht, 3 * n, &err) >= (size_t)(3 * n));
+		assert (dht_slots_used (ht) == slots_used);
+		assert (dht_set_rebuild_threads (ht, 0, &err) == 1);
+		for (int i = n; i < 2 * n; ++i) {
+			snprintf (key, sizeof (key), (i % 4) ? "key-%d" : "a-long-key-for-the-arena-%d", i);
+			assert (dht_insert (ht, key, &i, &err) == 1);
+		}
+		for (int i = 1; i < 2 * n; i += 5) {
+			snprintf (key, sizeof (key), (i % 4) ? "key-%d" : "a-long-key-for-the-arena-%d", i);
+			if (i < n && i % 3 == 0) continue;
+			assert (dht_delete (ht, key, &err) == 1);
+		}
+		dht_free (ht);
+
+		ht = dht_open (db_path, dht_zero_opts (), O_RDONLY, &err);
+		assert (ht);
+		int expected = 0;
+		for (int i = 0; i < 3 * n; ++i) {
+			snprintf (key, sizeof (key), (i % 4) ? "key-%d" : "a-long-key-for-the-arena-%d", i);
+			int * read_val = (int *)dht_lookup (ht, key);
+			if (i >= 2 * n || (i < n && i % 3 == 0) || i % 5 == 1) {
+				assert (read_val == NULL);
+			} else {
+				assert (read_val && *read_val == i);
+				++expected;
+			}
+		}
+		assert ((int)dht_size (ht) == expected);
+
+		free ((char *)db_path);
+		dht_free (ht);
+	}
+}
+
+void diskhash_stored_hashes_insert_lookup_delete_works ()
+{
+	const unsigned int flags[] = {
+		DHT_OPT_STORED_HASHES,
+		DHT_OPT_STORED_HASHES | DHT_OPT_CONTROL_BYTES | DHT_OPT_FINGERPRINTS,
+		DHT_OPT_STORED_HASHES | DHT_OPT_ROBIN_HOOD | DHT_OPT_FASTRANGE,
+		DHT_OPT_STORED_HASHES | DHT_OPT_CUCKOO | DHT_OPT_FINGERPRINTS,
+		DHT_OPT_STORED_HASHES | DHT_OPT_COLUMNAR | DHT_OPT_KEY_LENGTHS | DHT_OPT_KEY_ARENA,
+		DHT_OPT_STORED_HASHES | DHT_OPT_WYHASH | DHT_OPT_FASTRANGE,
+	};
+	for (unsigned int f : flags) {
+		HashTableOpts opts = dht_zero_opts ();
+		opts.key_maxlen = 15;
+		opts.object_datalen = 3;
+		opts.flags = f;
+		check_table_roundtrip (opts, 5000);
+	}
+}
+
+size_t table_file_size (const char * db_path)
+{
+	size_t size = 0;
+	dht_file_t fd = dht_open_file (db_path, O_RDONLY, false);
+	assert (fd);
+	assert (dht_file_size (fd, &size));
+	dht_close_file (fd);
+	return size;
+}
+
+void diskhash_shrink_to_fit_works ()
+{
+	const unsigned int flags[] = {
+		0,
+		DHT_OPT_CONTROL_BYTES | DHT_OPT_FINGERPRINTS,
+		DHT_OPT_ROBIN_HOOD,
+		DHT_OPT_CUCKOO | DHT_OPT_FINGERPRINTS,
+		DHT_OPT_COLUMNAR | DHT_OPT_KEY_LENGTHS | DHT_OPT_KEY_ARENA,
+	};
+	const int n = 5000;
+	for (unsigned int f : flags) {
+		const char * db_path = strdup (get_temp_db_path ().c_str ());
+		HashTableOpts opts = dht_zero_opts ();
+		opts.key_maxlen = 40;
+		opts.object_datalen = sizeof (int);
+		opts.flags = f;
+		char * err = NULL;
+		char key[64];
+		HashTable * ht = dht_open (db_path, opts, O_RDWR | O_CREAT, &err);
+		assert (ht);
+		for (int i = 0; i < n; ++i) {
+			snprintf (key, sizeof (key), (i % 4) ? "key-%d" : "a-long-key-that-goes-to-the-arena-%d", i);
+			assert (dht_insert (ht, key, &i, &err) == 1);
+		}
+		for (int i = 0; i < n; ++i) {
+			if (i % 10 == 0) continue;
+			snprintf (key, sizeof (key), (i % 4) ? "key-%d" : "a-long-key-that-goes-to-the-arena-%d", i);
+			assert (dht_delete (ht, key, &err) == 1);
+		}
+		const size_t capacity = dht_capacity (ht);
+		const size_t file_size = table_file_size (db_path);
+		assert (dht_shrink_to_fit (ht, &err) == 1);
+		assert (dht_size (ht) == (size_t)(n / 10));
+		assert (dht_capacity (ht) >= dht_size (ht) && dht_capacity (ht) < capacity / 4);
+		assert (dht_dirty_slots (ht) == 0);
+		assert (dht_slots_used (ht) == dht_size (ht));
+		assert (table_file_size (db_path) < file_size / 4);
+		// nothing left to reclaim
+		assert (dht_shrink_to_fit (ht, &err) == 1);
+		dht_free (ht);
+
+		ht = dht_open (db_path, dht_zero_opts (), O_RDWR, &err);
+		assert (ht);
+		for (int i = 0; i < n; ++i) {
+			snprintf (key, sizeof (key), (i % 4) ? "key-%d" : "a-long-key-that-goes-to-the-arena-%d", i);
+			int * read_val = (int *)dht_lookup (ht, key);
+			if (i % 10) {
+				assert (read_val == NULL);
+			} else {
+				assert (read_val && *read_val == i);
+			}
+		}
+		// the table grows again as usual
+		for (int i = 0; i < n; ++i) {
+			if (i % 10 == 0) continue;
+			snprintf (key, sizeof (key), (i % 4) ? "key-%d" : "a-long-key-that-goes-to-the-arena-%d", i);
+			assert (dht_insert (ht, key, &i, &err) == 1);
+		}
+		assert (dht_size (ht) == (size_t)n);
+
+		free ((char *)db_path);
+		dht_free (ht);
+	}
+}
+
+void diskhash_shrink_to_fit_incrementally_works ()
+{
+	const char * db_path = strdup (get_temp_db_path ().c_str ());
+	HashTableOpts opts = dht_zero_opts ();
+	opts.key_maxlen = 15;
+	opts.object_datalen = sizeof (int);
+	char * err = NULL;
+	char key[16];
+	HashTable * ht = dht_open (db_path, opts, O_RDWR | O_CREAT, &err);
+	assert (ht);
+	for (int i = 0; i < 2000; ++i) {
+		snprintf (key, sizeof (key), "key-%d", i);
+		assert (dht_insert (ht, key, &i, &err) == 1);
+	}
+	for (int i = 0; i < 1800; ++i) {
+		snprintf (key, sizeof (key), "key-%d", i);
+		assert (dht_delete (ht, key, &err) == 1);
+	}
+	const size_t capacity = dht_capacity (ht);
+	assert (dht_set_growth_step (ht, 8, &err) == 1);
+	assert (dht_shrink_to_fit (ht, &err) == 1);
+	assert (dht_capacity (ht) < capacity);
+	// the entries move over as the table is modified
+	for (int i = 0; i < 100; ++i) {
+		snprintf (key, sizeof (key), "new-%d", i);
+		assert (dht_insert (ht, key, &i, &err) == 1);
+		assert (dht_size (ht) == (size_t)(201 + i));
+		for (int j = 1800; j < 2000; ++j) {
+			snprintf (key, sizeof (key), "key-%d", j);
+			int * read_val = (int *)dht_lookup (ht, key);
+			assert (read_val && *read_val == j);
+		}
+	}
+	assert (dht_finish_growth (ht, &err) == 1);
+	assert (dht_size (ht) == 300);
+	assert (dht_dirty_slots (ht) == 0);
+
+	free ((char *)db_path);
+	dht_free (ht);
+}
+
+void diskhash_relayout_works ()
+{
+	const unsigned int flags[] = {
+		0,
+		DHT_OPT_CONTROL_BYTES | DHT_OPT_FASTRANGE,
+		DHT_OPT_ROBIN_HOOD | DHT_OPT_FINGERPRINTS,
+		DHT_OPT_CUCKOO | DHT_OPT_FINGERPRINTS,
+		DHT_OPT_COLUMNAR | DHT_OPT_KEY_LENGTHS | DHT_OPT_KEY_ARENA | DHT_OPT_STORED_HASHES,
+	};
+	const int n = 3000;
+	for (unsigned int f : flags) {
+		const char * db_path = strdup (get_temp_db_path ().c_str ());
+		HashTableOpts opts = dht_zero_opts ();
+		opts.key_maxlen = 40;
+		opts.object_datalen = sizeof (int);
+		opts.flags = f;
+		char * err = NULL;
+		char key[64];
+		HashTable * ht = dht_open (db_path, opts, O_RDWR | O_CREAT, &err);
+		assert (ht);
+		for (int i = 0; i < n; ++i) {
+			snprintf (key, sizeof (key), (i % 4) ? "key-%d" : "a-long-key-that-goes-to-the-arena-%d", i);
+			assert (dht_insert (ht, key, &i, &err) == 1);
+		}
+		for (int i = 0; i < n; i += 3) {
+			snprintf (key, sizeof (key), (i % 4) ? "key-%d" : "a-long-key-that-goes-to-the-arena-%d", i);
+			assert (dht_delete (ht, key, &err) == 1);
+		}
+		const size_t capacity = dht_capacity (ht);
+		assert (dht_relayout (ht, &err) == 1);
+		assert (dht_capacity (ht) == capacity);
+		assert (dht_dirty_slots (ht) == 0);
+		assert (dht_slots_used (ht) == dht_size (ht));
+		for (int i = n; i < n + 100; ++i) {
+			snprintf (key, sizeof (key), (i % 4) ? "key-%d" : "a-long-key-that-goes-to-the-arena-%d", i);
+			assert (dht_insert (ht, key, &i, &err) == 1);
+		}
+		dht_free (ht);
+
+		ht = dht_open (db_path, dht_zero_opts (), O_RDONLY, &err);
+		assert (ht);
+		assert ((int)dht_size (ht) == n - (n + 2) / 3 + 100);
+		for (int i = 0; i < n + 100; ++i) {
+			snprintf (key, sizeof (key), (i % 4) ? "key-%d" : "a-long-key-that-goes-to-the-arena-%d", i);
+			int * read_val = (int *)dht_lookup (ht, key);
+			if (i < n && i % 3 == 0) {
+				assert (read_val == NULL);
+			} else {
+				assert (read_val && *read_val == i);
+			}
+		}
+		assert (dht_relayout (ht, &err) == -EACCES);
+		free (err);
+
+		free ((char *)db_path);
+		dht_free (ht);
+	}
+}
+
+void diskhash_relayout_by_access_packs_hot_entries ()
+{
+	const unsigned int flags[] = {
+		0,
+		DHT_OPT_ROBIN_HOOD | DHT_OPT_FINGERPRINTS,
+		DHT_OPT_CUCKOO | DHT_OPT_STORED_HASHES,
+		DHT_OPT_COLUMNAR | DHT_OPT_KEY_LENGTHS,
+	};
+	const int n = 2000;
+	for (unsigned int f : flags) {
+		const char * db_path = strdup (get_temp_db_path ().c_str ());
+		HashTableOpts opts = dht_zero_opts ();
+		opts.key_maxlen = 15;
+		opts.object_datalen = sizeof (int);
+		opts.flags = f;
+		char * err = NULL;
+		char key[16];
+		HashTable * ht = dht_open (db_path, opts, O_RDWR | O_CREAT, &err);
+		assert (ht);
+		for (int i = 0; i < n; ++i) {
+			snprintf (key, sizeof (key), "key-%d", i);
+			assert (dht_insert (ht, key, &i, &err) == 1);
+		}
+		assert (dht_sample_accesses (ht, 1, &err) == 1);
+		// keys that are multiples of 20 are looked up 10 times, the others once
+		for (int round = 0; round < 10; ++round) {
+			for (int i = 0; i < n; ++i) {
+				if (round && i % 20) continue;
+				snprintf (key, sizeof (key), "key-%d", i);
+				assert (dht_lookup (ht, key));
+			}
+		}
+		assert (dht_relayout_by_access (ht, &err) == 1);
+		assert ((int)dht_size (ht) == n);
+
+		char buffer[16];
+		char * key_ptr = buffer;
+		for (int i = 0; i < n / 20; ++i) {
+			int value;
+			assert (dht_indexed_lookup (ht, i, &key_ptr, &value, &err) == 1);
+			assert (value % 20 == 0);
+			snprintf (key, sizeof (key), "key-%d", value);
+			assert (!strcmp (buffer, key));
+		}
+		for (int i = 0; i < n; ++i) {
+			snprintf (key, sizeof (key), "key-%d", i);
+			int * read_val = (int *)dht_lookup (ht, key);
+			assert (read_val && *read_val == i);
+		}
+		assert (dht_sample_accesses (ht, 0, &err) == 1);
+
+		free ((char *)db_path);
+		dht_free (ht);
+	}
+}
+
+void diskhash_relayout_by_access_requires_sampling ()
+{
+	const char * db_path = strdup (get_temp_db_path ().c_str ());
+	HashTableOpts opts = dht_zero_opts ();
+	opts.key_maxlen = 15;
+	opts.object_datalen = sizeof (int);
+	char * err = NULL;
+	HashTable * ht = dht_open (db_path, opts, O_RDWR | O_CREAT, &err);
+	assert (ht);
+	int value = 1;
+	assert (dht_insert (ht, "key", &value, &err) == 1);
+	assert (dht_relayout_by_access (ht, &err) == -EINVAL);
+	assert (err);
+	free (err);
+	err = NULL;
+	assert (dht_sample_accesses (ht, 4, &err) == 1);
+	assert (dht_sample_accesses (ht, 0, &err) == 1);
+	assert (dht_relayout_by_access (ht, &err) == -EINVAL);
+	free (err);
+
+	free ((char *)db_path);
+	dht_free (ht);
+}
+
+void diskhash_inline_insert_lookup_delete_works ()
+{
+	const unsigned int flags[] = {
+		DHT_OPT_INLINE,
+		DHT_OPT_INLINE | DHT_OPT_FASTRANGE | DHT_OPT_WYHASH,
+		DHT_OPT_INLINE | DHT_OPT_KEY_LENGTHS | DHT_OPT_STORED_HASHES,
+		DHT_OPT_INLINE | DHT_OPT_CRC32C_HASH | DHT_OPT_FASTRANGE,
+	};
+	for (unsigned int f : flags) {
+		HashTableOpts opts = dht_zero_opts ();
+		opts.key_maxlen = 15;
+		opts.object_datalen = 3;
+		opts.flags = f;
+		check_table_roundtrip (opts, 5000);
+	}
+}
+
+void diskhash_inline_iterates_slots ()
+{
+	const char * db_path = strdup (get_temp_db_path ().c_str ());
+	HashTableOpts opts = dht_zero_opts ();
+	opts.key_maxlen = 15;
+	opts.object_datalen = sizeof (int);
+	opts.flags = DHT_OPT_INLINE | DHT_OPT_FASTRANGE;
+	char * err = NULL;
+	char key[16];
+	HashTable * ht = dht_open (db_path, opts, O_RDWR | O_CREAT, &err);
+	assert (ht);
+	const int n = 1000;
+	for (int i = 0; i < n; ++i) {
+		snprintf (key, sizeof (key), "key-%d", i);
+		assert (dht_insert (ht, key, &i, &err) == 1);
+	}
+	for (int i = 0; i < n; i += 3) {
+		snprintf (key, sizeof (key), "key-%d", i);
+		assert (dht_delete (ht, key, &err) == 1);
+	}
+	const int expected = n - (n + 2) / 3;
+	assert ((int)dht_size (ht) == expected);
+	// every slot is a store entry: the empty ones are the dirty ones
+	assert (dht_slots_used (ht) - dht_dirty_slots (ht) == dht_size (ht));
+	assert (dht_slots_used (ht) > dht_capacity (ht));
+
+	// indexed lookups visit every entry once, in slot order
+	std::vector<bool> seen (n, false);
+	int found = 0;
+	char buffer[16];
+	char * key_ptr = buffer;
+	for (size_t ix = 0; ix < dht_slots_used (ht); ++ix) {
+		int value;
+		const int r = dht_indexed_lookup (ht, ix, &key_ptr, &value, &err);
+		if (r == -EFAULT) {
+			free (err);
+			err = NULL;
+			continue;
+		}
+		assert (r == 1);
+		assert (value % 3 && !seen[value]);
+		snprintf (key, sizeof (key), "key-%d", value);
+		assert (!strcmp (buffer, key));
+		seen[value] = true;
+		++found;
+	}
+	assert (found == expected);
+
+	// nothing to reorder or drop
+	assert (dht_relayout (ht, &err) == 1);
+	assert (dht_shrink_to_fit (ht, &err) == 1);
+	assert ((int)dht_size (ht) == expected);
+	for (int i = 0; i < n; ++i) {
+		snprintf (key, sizeof (key), "key-%d", i);
+		int * read_val = (int *)dht_lookup (ht, key);
+		assert ((read_val != NULL) == (i % 3 != 0));
+		assert (!read_val || *read_val == i);
+	}
+
+	free ((char *)db_path);
+	dht_free (ht);
+}
+
+void diskhash_inline_with_robin_hood_returns_error ()
+{
+	const char * db_path = strdup (get_temp_db_path ().c_str ());
+	HashTableOpts opts = dht_zero_opts ();
+	opts.key_maxlen = 15;
+	opts.object_datalen = sizeof (int);
+	opts.flags = DHT_OPT_INLINE | DHT_OPT_ROBIN_HOOD;
+	char * err = NULL;
+	HashTable * ht = dht_open (db_path, opts, O_RDWR | O_CREAT, &err);
+	assert (!ht);
+	assert (!strcmp ("DHT_OPT_INLINE cannot be combined with DHT_OPT_CONTROL_BYTES, DHT_OPT_ROBIN_HOOD, "
+				"DHT_OPT_FINGERPRINTS, DHT_OPT_CUCKOO, DHT_OPT_KEY_ARENA or DHT_OPT_COLUMNAR.", err));
+
+	free ((char *)err);
+	free ((char *)db_path);
+}
+
+void diskhash_compact_insert_lookup_delete_works ()
+{
+	const unsigned int flags[] = {
+		DHT_OPT_COMPACT,
+		DHT_OPT_COMPACT | DHT_OPT_ROBIN_HOOD | DHT_OPT_FASTRANGE,
+		DHT_OPT_COMPACT | DHT_OPT_CONTROL_BYTES,
+		DHT_OPT_COMPACT | DHT_OPT_CUCKOO,
+		DHT_OPT_COMPACT | DHT_OPT_INLINE,
+		DHT_OPT_COMPACT | DHT_OPT_COLUMNAR | DHT_OPT_KEY_LENGTHS | DHT_OPT_STORED_HASHES,
+		DHT_OPT_COMPACT | DHT_OPT_KEY_LENGTHS | DHT_OPT_KEY_ARENA | DHT_OPT_WYHASH,
+	};
+	for (unsigned int f : flags) {
+		HashTableOpts opts = dht_zero_opts ();
+		opts.key_maxlen = 15;
+		opts.object_datalen = sizeof (int);
+		opts.flags = f;
+		check_table_roundtrip (opts, 5000);
+	}
+	// past 2^16 entries, the hash table slots take 3 bytes
+	HashTableOpts opts = dht_zero_opts ();
+	opts.key_maxlen = 15;
+	opts.object_datalen = sizeof (int);
+	opts.flags = DHT_OPT_COMPACT | DHT_OPT_ROBIN_HOOD;
+	check_table_roundtrip (opts, 70000);
+}
+
+void diskhash_compact_handles_long_probe_sequences ()
+{
+	// fixed-length keys are their own hash, so keys that share their first 8
+	// bytes all have the same home slot and most of their probe offsets do
+	// not fit in a byte
+	const unsigned int flags[] = {
+		DHT_OPT_COMPACT | DHT_OPT_FIXED_KEYS,
+		DHT_OPT_COMPACT | DHT_OPT_FIXED_KEYS | DHT_OPT_ROBIN_HOOD,
+		DHT_OPT_COMPACT | DHT_OPT_FIXED_KEYS | DHT_OPT_CONTROL_BYTES,
+		DHT_OPT_COMPACT | DHT_OPT_FIXED_KEYS | DHT_OPT_INLINE,
+	};
+	const int n = 600;
+	for (unsigned int f : flags) {
+		const char * db_path = strdup (get_temp_db_path ().c_str ());
+		HashTableOpts opts = dht_zero_opts ();
+		opts.key_maxlen = 16;
+		opts.object_datalen = sizeof (int);
+		opts.flags = f;
+		char * err = NULL;
+		char key[16] = { 0 };
+		HashTable * ht = dht_open (db_path, opts, O_RDWR | O_CREAT, &err);
+		assert (ht);
+		for (int i = 0; i < n; ++i) {
+			memcpy (key + 8, &i, sizeof (i));
+			assert (dht_insert_n (ht, key, sizeof (key), &i, &err) == 1);
+		}
+		for (int i = 0; i < n; i += 2) {
+			memcpy (key + 8, &i, sizeof (i));
+			assert (dht_delete_n (ht, key, sizeof (key), &err) == 1);
+		}
+		assert ((int)dht_size (ht) == n / 2);
+		for (int i = 0; i < n; ++i) {
+			memcpy (key + 8, &i, sizeof (i));
+			int * read_val = (int *)dht_lookup_n (ht, key, sizeof (key));
+			if (i % 2) {
+				assert (read_val && *read_val == i);
+			} else {
+				assert (read_val == NULL);
+			}
+		}
+		free ((char *)db_path);
+		dht_free (ht);
+	}
+}
+
+void diskhash_compact_with_fingerprints_returns_error ()
+{
+	const char * db_path = strdup (get_temp_db_path ().c_str ());
+	HashTableOpts opts = dht_zero_opts ();
+	opts.key_maxlen = 15;
+	opts.object_datalen = sizeof (int);
+	opts.flags = DHT_OPT_COMPACT | DHT_OPT_ROBIN_HOOD | DHT_OPT_FINGERPRINTS;
+	char * err = NULL;
+	HashTable * ht = dht_open (db_path, opts, O_RDWR | O_CREAT, &err);
+	assert (!ht);
+	assert (!strcmp ("DHT_OPT_COMPACT cannot be combined with DHT_OPT_FINGERPRINTS.", err));
+
+	free ((char *)err);
+	free ((char *)db_path);
+}
+
+void diskhash_delete_keeps_store_entries_in_place ()
+{
+	const unsigned int flags[] = { 0, DHT_OPT_CONTROL_BYTES, DHT_OPT_COMPACT };
+	for (unsigned int f : flags) {
+		const char * db_path = strdup (get_temp_db_path ().c_str ());
+		HashTableOpts opts = dht_zero_opts ();
+		opts.key_maxlen = 15;
+		opts.object_datalen = 256;
+		opts.flags = f;
+		char * err = NULL;
+		char key[16];
+		char value[256];
+		const int n = 2000;
+		HashTable * ht = dht_open (db_path, opts, O_RDWR | O_CREAT, &err);
+		assert (ht);
+		assert (dht_reserve (ht, n, &err) >= 1);
+		std::vector<void *> data (n);
+		for (int i = 0; i < n; ++i) {
+			snprintf (key, sizeof (key), "key-%d", i);
+			memset (value, i, sizeof (value));
+			assert (dht_insert (ht, key, value, &err) == 1);
+			data[i] = dht_lookup (ht, key);
+		}
+		for (int i = 0; i < n; i += 2) {
+			snprintf (key, sizeof (key), "key-%d", i);
+			assert (dht_delete (ht, key, &err) == 1);
+		}
+		// only hash table slots move to fill the holes: the data of the
+		// remaining keys is where it was, and every deleted entry is dirty
+		assert ((int)dht_dirty_slots (ht) == n / 2);
+		for (int i = 1; i < n; i += 2) {
+			snprintf (key, sizeof (key), "key-%d", i);
+			char * read_val = (char *)dht_lookup (ht, key);
+			assert (read_val == data[i]);
+			assert (read_val[0] == (char)i && read_val[255] == (char)i);
+		}
+		free ((char *)db_path);
+		dht_free (ht);
+	}
+}
+
+void diskhash_initial_capacity_avoids_growth ()
+{
+	const unsigned int flags[] = { 0, DHT_OPT_ROBIN_HOOD, DHT_OPT_CUCKOO, DHT_OPT_INLINE };
+	for (unsigned int f : flags) {
+		const char * db_path = strdup (get_temp_db_path ().c_str ());
+		HashTableOpts opts = dht_zero_opts ();
+		opts.key_maxlen = 15;
+		opts.object_datalen = sizeof (int);
+		opts.flags = f;
+		opts.initial_capacity = 10000;
+		char * err = NULL;
+		char key[16];
+		HashTable * ht = dht_open (db_path, opts, O_RDWR | O_CREAT, &err);
+		assert (ht);
+		const size_t capacity = dht_capacity (ht);
+		assert (capacity >= 10000);
+		for (int i = 0; i < 10000; ++i) {
+			snprintf (key, sizeof (key), "key-%d", i);
+			assert (dht_insert (ht, key, &i, &err) == 1);
+		}
+		assert (dht_capacity (ht) == capacity);
+		free ((char *)db_path);
+		dht_free (ht);
+	}
+}
+
+void diskhash_sizing_options_are_stored ()
+{
+	const char * db_path = strdup (get_temp_db_path ().c_str ());
+	HashTableOpts opts = dht_zero_opts ();
+	opts.key_maxlen = 15;
+	opts.object_datalen = sizeof (int);
+	opts.max_load_percent = 90;
+	opts.growth_percent = 400;
+	char * err = NULL;
+	char key[16];
+	int next_key = 0;
+	HashTable * ht = dht_open (db_path, opts, O_RDWR | O_CREAT, &err);
+	assert (ht);
+	size_t capacity = fill_until_growth (ht, &next_key);
+	assert (dht_capacity (ht) >= 4 * capacity);
+	dht_free (ht);
+
+	// the options apply after reopening the table, and are checked if given
+	opts.max_load_percent = 50;
+	ht = dht_open (db_path, opts, O_RDWR, &err);
+	assert (!ht);
+	assert (!strcmp ("Options mismatch (diskhash table on disk was not created with the same options used to open it).", err));
+	free (err);
+	err = NULL;
+
+	ht = dht_open (db_path, dht_zero_opts (), O_RDWR, &err);
+	assert (ht);
+	capacity = fill_until_growth (ht, &next_key);
+	assert (dht_capacity (ht) >= 4 * capacity);
+	assert ((int)dht_size (ht) == next_key);
+	for (int i = 0; i < next_key; ++i) {
+		snprintf (key, sizeof (key), "key-%d", i);
+		int * read_val = (int *)dht_lookup (ht, key);
+		assert (read_val && *read_val == i);
+	}
+	free ((char *)db_path);
+	dht_free (ht);
+
+	const unsigned int loads[] = { 10, 95 };
+	for (unsigned int load : loads) {
+		HashTableOpts load_opts = dht_zero_opts ();
+		load_opts.key_maxlen = 15;
+		load_opts.object_datalen = sizeof (int);
+		load_opts.max_load_percent = load;
+		check_table_roundtrip (load_opts, 5000);
+	}
+}
+
+void diskhash_invalid_sizing_options_return_error ()
+{
+	const char * db_path = strdup (get_temp_db_path ().c_str ());
+	const unsigned int loads[] = { 5, 96, 0, 0 };
+	const unsigned int growths[] = { 0, 0, 100, 1001 };
+	const char * messages[] = {
+		"max_load_percent must be between 10 and 95.",
+		"max_load_percent must be between 10 and 95.",
+		"growth_percent must be more than 100 and at most 1000.",
+		"growth_percent must be more than 100 and at most 1000.",
+	};
+	for (int i = 0; i < 4; ++i) {
+		HashTableOpts opts = dht_zero_opts ();
+		opts.key_maxlen = 15;
+		opts.object_datalen = sizeof (int);
+		opts.max_load_percent = loads[i];
+		opts.growth_percent = growths[i];
+		char * err = NULL;
+		HashTable * ht = dht_open (db_path, opts, O_RDWR | O_CREAT, &err);
+		assert (!ht);
+		assert (!strcmp (messages[i], err));
+		free ((char *)err);
+	}
+	free ((char *)db_path);
+}
+
+void diskhash_too_large_initial_capacity_returns_error ()
+{
+	const char * db_path = strdup (get_temp_db_path ().c_str ());
+	const size_t capacities[] = { (size_t)1 << 50, SIZE_MAX / 100 + 1, SIZE_MAX, (size_t)1 << 50 };
+	const unsigned int flags[] = { 0, 0, 0, DHT_OPT_CUCKOO };
+	for (int i = 0; i < 4; ++i) {
+		HashTableOpts opts = dht_zero_opts ();
+		opts.key_maxlen = 15;
+		opts.object_datalen = sizeof (int);
+		opts.flags = flags[i];
+		opts.initial_capacity = capacities[i];
+		char * err = NULL;
+		HashTable * ht = dht_open (db_path, opts, O_RDWR | O_CREAT, &err);
+		assert (!ht);
+		assert (!strcmp ("initial_capacity is too large.", err));
+		free ((char *)err);
+	}
+	free ((char *)db_path);
+}
@@ -1,5 +1,7 @@
 #include <utility>
 #include <cassert>
+#include <cstdint>
+#include <cstring>
 
 #include <os_wrappers.h>
 
@@ -7,6 +9,9 @@
 
 void os_wrappers_dht_delete_file_works ();
 void os_wrappers_dht_open_file_creates_file ();
+void os_wrappers_dht_memory_map_file_huge_works ();
+void os_wrappers_dht_huge_alloc_works ();
+void os_wrappers_dht_memory_remap_file_works ();
 
 int main (int argc, char ** argv)
 {
@@ -15,6 +20,15 @@ int main (int argc, char ** argv)
 
 	printf ("os_wrappers_dht_open_file_creates_file ():\n");
 	os_wrappers_dht_open_file_creates_file ();
+
+	printf ("os_wrappers_dht_memory_map_file_huge_works ():\n");
+	os_wrappers_dht_memory_map_file_huge_works ();
+
+	printf ("os_wrappers_dht_huge_alloc_works ():\n");
+	os_wrappers_dht_huge_alloc_works ();
+
+	printf ("os_wrappers_dht_memory_remap_file_works ():\n");
+	os_wrappers_dht_memory_remap_file_works ();
 }
 
 void os_wrappers_dht_delete_file_works ()
@@ -40,3 +54,65 @@ void os_wrappers_dht_open_file_creates_file ()
 	assert (db_exists (file_path_str));
 }
 
+
+void os_wrappers_dht_memory_map_file_huge_works ()
+{
+	auto file_path = unique_path() / "test_file.dht";
+	const char* file_path_str = (const char*)(file_path.c_str ());
+	const size_t size = 3 * DHT_HUGE_PAGE_SIZE;
+	dht_file_t file_descriptor = dht_open_file (file_path_str, O_RDWR | O_CREAT, false);
+	assert (file_descriptor > 0);
+	assert (dht_truncate_file (file_descriptor, size));
+
+	void* data = nullptr;
+	assert (dht_memory_map_file_huge (file_descriptor, &data, size, PROT_READ | PROT_WRITE));
+	assert ((uintptr_t)data % DHT_HUGE_PAGE_SIZE == 0);
+	memset (data, 'x', size);
+	assert (dht_memory_huge_page_bytes (data, size) <= size);
+	assert (dht_memory_unmap_file (data, size));
+
+	// the writes went to the file
+	assert (dht_memory_map_file (file_descriptor, &data, size, PROT_READ));
+	assert (((const char*)data)[size - 1] == 'x');
+	assert (dht_memory_unmap_file (data, size));
+	dht_close_file (file_descriptor);
+	dht_delete_file (file_path_str);
+}
+
+void os_wrappers_dht_huge_alloc_works ()
+{
+	const size_t size = DHT_HUGE_PAGE_SIZE + 1;
+	char* data = (char*)dht_huge_alloc (size);
+	assert (data);
+	memset (data, 'x', size);
+	assert (data[size - 1] == 'x');
+	assert (dht_memory_huge_page_bytes (data, size) <= 2 * DHT_HUGE_PAGE_SIZE);
+	dht_huge_free (data, size);
+}
+
+void os_wrappers_dht_memory_remap_file_works ()
+{
+	auto file_path = unique_path() / "test_file.dht";
+	const char* file_path_str = (const char*)(file_path.c_str ());
+	const size_t size = 4096;
+	dht_file_t file_descriptor = dht_open_file (file_path_str, O_RDWR | O_CREAT, false);
+	assert (file_descriptor > 0);
+	assert (dht_truncate_file (file_descriptor, size));
+
+	void* data = nullptr;
+	assert (dht_memory_map_file (file_descriptor, &data, size, PROT_READ | PROT_WRITE));
+	memset (data, 'x', size);
+	assert (dht_truncate_file (file_descriptor, 4 * size));
+	assert (dht_memory_remap_file (file_descriptor, &data, size, 4 * size, PROT_READ | PROT_WRITE));
+	// the old contents are kept and the new part of the file is mapped
+	assert (((const char*)data)[size - 1] == 'x');
+	assert (((const char*)data)[size] == 0);
+	((char*)data)[4 * size - 1] = 'y';
+	assert (dht_memory_unmap_file (data, 4 * size));
+
+	assert (dht_memory_map_file (file_descriptor, &data, 4 * size, PROT_READ));
+	assert (((const char*)data)[4 * size - 1] == 'y');
+	assert (dht_memory_unmap_file (data, 4 * size));
+	dht_close_file (file_descriptor);
+	dht_delete_file (file_path_str);
+}